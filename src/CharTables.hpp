@@ -0,0 +1,194 @@
+#pragma once
+
+#include <cstdint>
+
+
+
+
+
+namespace Http { namespace CharTables {
+
+
+
+
+
+/** A table of values for all 256 byte values, indexed directly by the character.
+The characters are always indexed as unsigned, so that bytes above 0x7f don't need special care at the call sites. */
+struct Table
+{
+	uint8_t mValues[256];
+
+	constexpr uint8_t operator [] (char aChar) const
+	{
+		return mValues[static_cast<unsigned char>(aChar)];
+	}
+};
+
+
+
+
+
+/** Flags of the character classes, as stored in the CLASS table. */
+enum
+{
+	ccTChar      = 0x01,  ///< RFC 7230 tchar, the characters allowed in tokens (method, header name, ...)
+	ccWhitespace = 0x02,  ///< SP or HTAB
+	ccControl    = 0x04,  ///< CTL: 0x00 - 0x1f and 0x7f (including HTAB, CR and LF)
+};
+
+/** The value stored in HEX_VALUE and BASE64_VALUE for characters outside the alphabet. */
+const uint8_t INVALID = 0xff;
+
+/** The value stored in BASE64_VALUE for the padding character, '='. */
+const uint8_t BASE64_PADDING = 0xfe;
+
+
+
+
+
+/** Builds the HEX_VALUE table. */
+constexpr Table makeHexValueTable()
+{
+	Table res{};
+	for (unsigned i = 0; i < 256; ++i)
+	{
+		res.mValues[i] = INVALID;
+	}
+	for (unsigned i = 0; i < 10; ++i)
+	{
+		res.mValues['0' + i] = static_cast<uint8_t>(i);
+	}
+	for (unsigned i = 0; i < 6; ++i)
+	{
+		res.mValues['a' + i] = static_cast<uint8_t>(10 + i);
+		res.mValues['A' + i] = static_cast<uint8_t>(10 + i);
+	}
+	return res;
+}
+
+
+
+/** Builds the BASE64_VALUE table. */
+constexpr Table makeBase64ValueTable()
+{
+	Table res{};
+	for (unsigned i = 0; i < 256; ++i)
+	{
+		res.mValues[i] = INVALID;
+	}
+	for (unsigned i = 0; i < 26; ++i)
+	{
+		res.mValues['A' + i] = static_cast<uint8_t>(i);
+		res.mValues['a' + i] = static_cast<uint8_t>(26 + i);
+	}
+	for (unsigned i = 0; i < 10; ++i)
+	{
+		res.mValues['0' + i] = static_cast<uint8_t>(52 + i);
+	}
+	res.mValues['+'] = 62;
+	res.mValues['/'] = 63;
+	res.mValues['='] = BASE64_PADDING;
+	return res;
+}
+
+
+
+/** Builds the CLASS table. */
+constexpr Table makeClassTable()
+{
+	Table res{};
+	for (unsigned i = 0; i < 0x20; ++i)
+	{
+		res.mValues[i] = ccControl;
+	}
+	res.mValues[0x7f] = ccControl;
+	res.mValues[' '] = ccWhitespace;
+	res.mValues['\t'] = ccWhitespace | ccControl;
+
+	// tchar = "!" / "#" / "$" / "%" / "&" / "'" / "*" / "+" / "-" / "." / "^" / "_" / "`" / "|" / "~" / DIGIT / ALPHA
+	const char * specials = "!#$%&'*+-.^_`|~";
+	for (const char * c = specials; *c != 0; ++c)
+	{
+		res.mValues[static_cast<unsigned char>(*c)] = ccTChar;
+	}
+	for (unsigned i = 0; i < 10; ++i)
+	{
+		res.mValues['0' + i] = ccTChar;
+	}
+	for (unsigned i = 0; i < 26; ++i)
+	{
+		res.mValues['A' + i] = ccTChar;
+		res.mValues['a' + i] = ccTChar;
+	}
+	return res;
+}
+
+
+
+
+
+/** The value of each hex digit (either case), INVALID for all other characters. */
+inline constexpr Table HEX_VALUE = makeHexValueTable();
+
+/** The 6-bit value of each Base64 character, BASE64_PADDING for '=', INVALID for all other characters. */
+inline constexpr Table BASE64_VALUE = makeBase64ValueTable();
+
+/** The character class flags (cc*) of each character. */
+inline constexpr Table CLASS = makeClassTable();
+
+
+
+
+
+/** Returns the value of the hex digit, or INVALID if the character is not a hex digit. */
+inline uint8_t hexValue(char aChar)
+{
+	return HEX_VALUE[aChar];
+}
+
+
+
+/** Returns the 6-bit value of the Base64 character, BASE64_PADDING for '=', or INVALID for other characters. */
+inline uint8_t base64Value(char aChar)
+{
+	return BASE64_VALUE[aChar];
+}
+
+
+
+/** Returns true if the character may be a part of a RFC 7230 token. */
+inline bool isTChar(char aChar)
+{
+	return (CLASS[aChar] & ccTChar) != 0;
+}
+
+
+
+/** Returns true if the character is a SP or a HTAB. */
+inline bool isWhitespace(char aChar)
+{
+	return (CLASS[aChar] & ccWhitespace) != 0;
+}
+
+
+
+/** Returns true if the character is a control character (CTL). */
+inline bool isControl(char aChar)
+{
+	return (CLASS[aChar] & ccControl) != 0;
+}
+
+
+
+/** Returns true if the character is a SP or a control character, the characters that separate the
+words in the parameter lists and are skipped around them. */
+inline bool isSpaceOrControl(char aChar)
+{
+	return (CLASS[aChar] & (ccWhitespace | ccControl)) != 0;
+}
+
+
+
+
+
+}}  // namespace Http::CharTables
@@ -0,0 +1,684 @@
+#include "Compression.hpp"
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include "Utils.hpp"
+
+#ifdef HTTP_PARSER_ZLIB
+	#include <zlib.h>
+#endif
+
+
+
+
+
+namespace Http {
+
+
+
+
+
+// Compression helpers:
+
+namespace {
+
+/** The qvalue of the codings not mentioned in the header, lower than any valid one, including q=0. */
+const int QVALUE_NONE = -1;
+
+
+
+/** Parses the qvalue (RFC 7231 @ 5.3.1) into thousandths. Returns false if not valid. */
+bool parseQValue(std::string_view aText, int & aThousandths)
+{
+	if (aText.empty() || ((aText[0] != '0') && (aText[0] != '1')))
+	{
+		return false;
+	}
+	if ((aText.size() > 1) && ((aText[1] != '.') || (aText.size() > 5)))
+	{
+		return false;
+	}
+	int value = (aText[0] - '0') * 1000;
+	int scale = 100;
+	for (size_t i = 2; i < aText.size(); ++i, scale /= 10)
+	{
+		if ((aText[i] < '0') || (aText[i] > '9'))
+		{
+			return false;
+		}
+		value += (aText[i] - '0') * scale;
+	}
+	if (value > 1000)
+	{
+		return false;
+	}
+	aThousandths = value;
+	return true;
+}
+
+
+
+/** Splits the Accept-Encoding list element into the coding and its qvalue (1000 if not given).
+Returns false if the parameters are malformed. */
+bool parseAcceptedCoding(std::string_view aElement, std::string_view & aCoding, int & aQValue)
+{
+	auto idxSemicolon = aElement.find(';');
+	aCoding = Utils::trimOws(aElement.substr(0, idxSemicolon));
+	aQValue = 1000;
+	while (idxSemicolon != std::string_view::npos)
+	{
+		aElement.remove_prefix(idxSemicolon + 1);
+		idxSemicolon = aElement.find(';');
+		auto param = Utils::trimOws(aElement.substr(0, idxSemicolon));
+		if ((param.size() >= 2) && ((param[0] == 'q') || (param[0] == 'Q')) && (param[1] == '='))
+		{
+			if (!parseQValue(param.substr(2), aQValue))
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+
+
+/** Returns true if the media type (without parameters) is worth compressing. */
+bool isCompressibleType(std::string_view aMediaType)
+{
+	static const std::string_view TEXTUAL_TYPES[] =
+	{
+		"application/javascript",
+		"application/json",
+		"application/xml",
+		"application/xhtml+xml",
+		"application/rss+xml",
+		"application/atom+xml",
+		"application/wasm",
+		"application/x-javascript",
+		"image/svg+xml",
+	};
+	if ((aMediaType.size() > 5) && Utils::noCaseEqual(aMediaType.substr(0, 5), "text/"))
+	{
+		return true;
+	}
+	for (const auto & type: TEXTUAL_TYPES)
+	{
+		if (Utils::noCaseEqual(aMediaType, type))
+		{
+			return true;
+		}
+	}
+	// The structured syntax suffixes (RFC 6839), such as application/ld+json:
+	auto idxPlus = aMediaType.rfind('+');
+	return (
+		(idxPlus != std::string_view::npos) &&
+		(Utils::noCaseEqual(aMediaType.substr(idxPlus), "+json") || Utils::noCaseEqual(aMediaType.substr(idxPlus), "+xml"))
+	);
+}
+
+}  // anonymous namespace
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Compressor::Stream:
+
+#ifdef HTTP_PARSER_ZLIB
+
+	struct Compressor::Stream
+	{
+		z_stream mZStream;
+
+		/** Initializes the zlib stream; returns nullptr on failure. */
+		static std::unique_ptr<Stream> create(Coding aCoding, int aLevel)
+		{
+			std::unique_ptr<Stream> res(new Stream);
+			res->mZStream.zalloc = Z_NULL;
+			res->mZStream.zfree = Z_NULL;
+			res->mZStream.opaque = Z_NULL;
+			// The window bits select the format: 16 + 15 for gzip, 15 for zlib:
+			auto windowBits = (aCoding == ccGzip) ? (16 + MAX_WBITS) : MAX_WBITS;
+			if (deflateInit2(&res->mZStream, aLevel, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+			{
+				return nullptr;
+			}
+			return res;
+		}
+
+		~Stream()
+		{
+			deflateEnd(&mZStream);
+		}
+
+		/** Compresses the data with the zlib flush mode, appending the output to aOutput.
+		zlib counts the input and output in uInt, so larger data is fed in slices of at most MAX_SLICE bytes,
+		the flush mode applying only to the last one.
+		Returns false if the compression failed. */
+		bool deflateAppend(const char * aData, size_t aSize, int aFlush, std::string & aOutput)
+		{
+			const size_t MAX_SLICE = std::numeric_limits<uInt>::max();
+			auto & zs = mZStream;
+			zs.avail_in = 0;
+			for (;;)
+			{
+				if ((zs.avail_in == 0) && (aSize > 0))
+				{
+					auto slice = std::min(aSize, MAX_SLICE);
+					zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(aData));
+					zs.avail_in = static_cast<uInt>(slice);
+					aData += slice;
+					aSize -= slice;
+				}
+				auto flush = (aSize > 0) ? Z_NO_FLUSH : aFlush;
+
+				// Grow the output in steps, deflateBound() of the pending input being a good first estimate:
+				auto used = aOutput.size();
+				auto step = std::min<size_t>(std::max<size_t>(deflateBound(&zs, zs.avail_in), 4096), MAX_SLICE);
+				aOutput.resize(used + step);
+				zs.next_out = reinterpret_cast<Bytef *>(&aOutput[used]);
+				zs.avail_out = static_cast<uInt>(step);
+				auto res = deflate(&zs, flush);
+				aOutput.resize(aOutput.size() - zs.avail_out);
+				if ((aSize == 0) && ((res == Z_STREAM_END) || ((zs.avail_in == 0) && (zs.avail_out > 0))))
+				{
+					// All input consumed and all the output the flush mode requires produced:
+					return true;
+				}
+				if ((res != Z_OK) && (res != Z_BUF_ERROR))
+				{
+					return false;
+				}
+			}
+		}
+	};
+
+#else
+
+	struct Compressor::Stream
+	{
+	};
+
+#endif
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Compressor:
+
+Compressor::Compressor(Coding aCoding, int aLevel):
+	mCoding(ccIdentity),
+	mLevel(aLevel),
+	mBytesIn(0),
+	mBytesOut(0)
+{
+	reset(aCoding, aLevel);
+}
+
+
+
+
+
+Compressor::~Compressor()
+{
+}
+
+
+
+
+
+void Compressor::reset(Coding aCoding, int aLevel)
+{
+	mBytesIn = 0;
+	mBytesOut = 0;
+	#ifdef HTTP_PARSER_ZLIB
+		if (aCoding == ccIdentity)
+		{
+			mCoding = ccIdentity;
+			return;
+		}
+		if ((mStream != nullptr) && (aCoding == mCoding) && (aLevel == mLevel) && (deflateReset(&mStream->mZStream) == Z_OK))
+		{
+			return;
+		}
+		mStream = Stream::create(aCoding, aLevel);
+		mCoding = (mStream == nullptr) ? ccIdentity : aCoding;
+		mLevel = aLevel;
+	#else
+		(void)aCoding;
+		mCoding = ccIdentity;
+		mLevel = aLevel;
+	#endif
+}
+
+
+
+
+
+bool Compressor::write(const char * aData, size_t aSize, std::string & aDest)
+{
+	mBytesIn += aSize;
+	if (mCoding == ccIdentity)
+	{
+		mBytesOut += aSize;
+		appendChunk(aDest, aData, aSize);
+		return true;
+	}
+	#ifdef HTTP_PARSER_ZLIB
+		return compress(aData, aSize, Z_NO_FLUSH, aDest);
+	#else
+		return false;
+	#endif
+}
+
+
+
+
+
+bool Compressor::flush(std::string & aDest)
+{
+	if (mCoding == ccIdentity)
+	{
+		return true;
+	}
+	#ifdef HTTP_PARSER_ZLIB
+		return compress(nullptr, 0, Z_SYNC_FLUSH, aDest);
+	#else
+		(void)aDest;
+		return false;
+	#endif
+}
+
+
+
+
+
+bool Compressor::finish(std::string & aDest)
+{
+	if (mCoding != ccIdentity)
+	{
+		#ifdef HTTP_PARSER_ZLIB
+			if (!compress(nullptr, 0, Z_FINISH, aDest))
+			{
+				return false;
+			}
+		#else
+			return false;
+		#endif
+	}
+	aDest.append("0\r\n\r\n");
+	return true;
+}
+
+
+
+
+
+bool Compressor::isAvailable()
+{
+	#ifdef HTTP_PARSER_ZLIB
+		return true;
+	#else
+		return false;
+	#endif
+}
+
+
+
+
+
+Compressor::Coding Compressor::negotiate(std::string_view aAcceptEncoding)
+{
+	if (!isAvailable())
+	{
+		return ccIdentity;
+	}
+	int gzipQ = QVALUE_NONE, deflateQ = QVALUE_NONE, anyQ = QVALUE_NONE;
+	std::string_view element, coding;
+	int qValue;
+	while (Utils::nextListElement(aAcceptEncoding, element))
+	{
+		if (!parseAcceptedCoding(element, coding, qValue))
+		{
+			continue;
+		}
+		if (Utils::noCaseEqual(coding, "gzip") || Utils::noCaseEqual(coding, "x-gzip"))
+		{
+			gzipQ = std::max(gzipQ, qValue);
+		}
+		else if (Utils::noCaseEqual(coding, "deflate"))
+		{
+			deflateQ = std::max(deflateQ, qValue);
+		}
+		else if (coding == "*")
+		{
+			anyQ = std::max(anyQ, qValue);
+		}
+	}
+
+	// "*" applies to the codings not listed explicitly:
+	if (gzipQ == QVALUE_NONE)
+	{
+		gzipQ = anyQ;
+	}
+	if (deflateQ == QVALUE_NONE)
+	{
+		deflateQ = anyQ;
+	}
+	if ((gzipQ <= 0) && (deflateQ <= 0))
+	{
+		return ccIdentity;
+	}
+	return (gzipQ >= deflateQ) ? ccGzip : ccDeflate;
+}
+
+
+
+
+
+std::string_view Compressor::codingName(Coding aCoding)
+{
+	switch (aCoding)
+	{
+		case ccGzip:    return "gzip";
+		case ccDeflate: return "deflate";
+		case ccIdentity:
+		{
+			break;
+		}
+	}
+	return {};
+}
+
+
+
+
+
+bool Compressor::shouldCompress(std::string_view aContentType, size_t aBodySize)
+{
+	if ((aBodySize != std::string::npos) && (aBodySize < MIN_BODY_SIZE))
+	{
+		return false;
+	}
+	auto idxSemicolon = aContentType.find(';');
+	return isCompressibleType(Utils::trimOws(aContentType.substr(0, idxSemicolon)));
+}
+
+
+
+
+
+void Compressor::setHeaders(OutgoingResponse & aResponse, Coding aCoding, size_t aContentLength)
+{
+	// The representation depends on the Accept-Encoding of the request, even if it is not compressed:
+	aResponse.addHeader("Vary", "Accept-Encoding");
+	if (aCoding != ccIdentity)
+	{
+		aResponse.removeHeader("Content-Encoding");
+		aResponse.addHeader("Content-Encoding", std::string(codingName(aCoding)));
+
+		// The compressed bytes differ from the identity ones, so a strong ETag no longer holds for them;
+		// a weak one still matches the If-None-Match of either representation:
+		std::string_view etag;
+		if (aResponse.findHeader("ETag", etag) && !etag.empty() && (etag[0] == '"'))
+		{
+			std::string weakETag("W/");
+			weakETag.append(etag);
+			aResponse.removeHeader("ETag");
+			aResponse.addHeader("ETag", weakETag);
+		}
+	}
+	if (aContentLength == std::string::npos)
+	{
+		aResponse.removeHeader("Content-Length");
+		aResponse.removeHeader("Transfer-Encoding");
+		aResponse.addHeader("Transfer-Encoding", "chunked");
+	}
+	else
+	{
+		aResponse.setContentLength(aContentLength);
+	}
+}
+
+
+
+
+
+bool Compressor::compressWhole(Coding aCoding, std::string_view aBody, std::string & aDest, int aLevel)
+{
+	aDest.clear();
+	#ifdef HTTP_PARSER_ZLIB
+		if (aCoding == ccIdentity)
+		{
+			return false;
+		}
+		auto stream = Stream::create(aCoding, aLevel);
+		if (stream == nullptr)
+		{
+			return false;
+		}
+		if (!stream->deflateAppend(aBody.data(), aBody.size(), Z_FINISH, aDest))
+		{
+			aDest.clear();
+			return false;
+		}
+		return true;
+	#else
+		(void)aCoding;
+		(void)aBody;
+		(void)aLevel;
+		return false;
+	#endif
+}
+
+
+
+
+
+bool Compressor::compress(const char * aData, size_t aSize, int aFlush, std::string & aDest)
+{
+	#ifdef HTTP_PARSER_ZLIB
+		mOutput.clear();
+		if (!mStream->deflateAppend(aData, aSize, aFlush, mOutput))
+		{
+			return false;
+		}
+		mBytesOut += mOutput.size();
+		appendChunk(aDest, mOutput.data(), mOutput.size());
+		return true;
+	#else
+		(void)aData;
+		(void)aSize;
+		(void)aFlush;
+		(void)aDest;
+		return false;
+	#endif
+}
+
+
+
+
+
+void Compressor::appendChunk(std::string & aDest, const char * aData, size_t aSize)
+{
+	if (aSize == 0)
+	{
+		return;
+	}
+	static const char HEX_DIGITS[] = "0123456789abcdef";
+	char chunkSize[2 * sizeof(size_t)];
+	size_t idx = sizeof(chunkSize);
+	for (auto left = aSize; left > 0; left >>= 4)
+	{
+		chunkSize[--idx] = HEX_DIGITS[left & 0x0f];
+	}
+	aDest.append(chunkSize + idx, sizeof(chunkSize) - idx);
+	aDest.append("\r\n");
+	aDest.append(aData, aSize);
+	aDest.append("\r\n");
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// CompressionCache:
+
+size_t CompressionCache::Entry::memoryUsed() const
+{
+	// The list and index nodes and the shared body's control block are approximated by a fixed overhead:
+	return sizeof(Entry) + 64 + mOriginal.capacity() + ((mCompressed == nullptr) ? 0 : mCompressed->capacity());
+}
+
+
+
+
+
+CompressionCache::CompressionCache(size_t aMaxMemory, int aLevel):
+	mMaxMemory(aMaxMemory),
+	mLevel(aLevel),
+	mMemoryUsed(0),
+	mHits(0),
+	mMisses(0)
+{
+}
+
+
+
+
+
+CompressionCache::BodyPtr CompressionCache::get(std::string_view aBody, Compressor::Coding aCoding)
+{
+	if ((aCoding == Compressor::ccIdentity) || !Compressor::isAvailable())
+	{
+		return nullptr;
+	}
+	auto key = makeKey(aBody, aCoding);
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		auto itr = mIndex.find(key);
+		if ((itr != mIndex.end()) && (itr->second->mOriginal == aBody))
+		{
+			mHits += 1;
+			mEntries.splice(mEntries.begin(), mEntries, itr->second);
+			return itr->second->mCompressed;
+		}
+		mMisses += 1;
+	}
+
+	// Compress outside the lock; concurrent misses for the same body both compress, the last one is kept:
+	Entry entry;
+	entry.mKey = key;
+	entry.mOriginal.assign(aBody.data(), aBody.size());
+	auto compressed = std::make_shared<std::string>();
+	if (Compressor::compressWhole(aCoding, aBody, *compressed, mLevel) && (compressed->size() < aBody.size()))
+	{
+		compressed->shrink_to_fit();
+		entry.mCompressed = std::move(compressed);
+	}
+	auto res = entry.mCompressed;
+	auto entrySize = entry.memoryUsed();
+	if (entrySize > mMaxMemory)
+	{
+		return res;
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	auto itr = mIndex.find(key);
+	if (itr != mIndex.end())
+	{
+		remove(itr->second);
+	}
+	while (!mEntries.empty() && (mMemoryUsed + entrySize > mMaxMemory))
+	{
+		remove(std::prev(mEntries.end()));
+	}
+	mEntries.push_front(std::move(entry));
+	mIndex[key] = mEntries.begin();
+	mMemoryUsed += entrySize;
+	return res;
+}
+
+
+
+
+
+void CompressionCache::clear()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mIndex.clear();
+	mEntries.clear();
+	mMemoryUsed = 0;
+}
+
+
+
+
+
+size_t CompressionCache::size() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mEntries.size();
+}
+
+
+
+
+
+size_t CompressionCache::memoryUsed() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mMemoryUsed;
+}
+
+
+
+
+
+uint64_t CompressionCache::hits() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mHits;
+}
+
+
+
+
+
+uint64_t CompressionCache::misses() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mMisses;
+}
+
+
+
+
+
+uint64_t CompressionCache::makeKey(std::string_view aBody, Compressor::Coding aCoding)
+{
+	return static_cast<uint64_t>(std::hash<std::string_view>()(aBody)) * 3 + static_cast<uint64_t>(aCoding);
+}
+
+
+
+
+
+void CompressionCache::remove(Entries::iterator aEntry)
+{
+	mMemoryUsed -= aEntry->memoryUsed();
+	mIndex.erase(aEntry->mKey);
+	mEntries.erase(aEntry);
+}
+
+
+
+
+
+}  // namespace Http
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "Message.hpp"
+
+
+
+
+
+namespace Http {
+
+
+
+
+
+/** Compresses a response body with a content coding negotiated from the Accept-Encoding header, streaming
+the output in the chunked transfer coding, so that the body can be sent while it is being produced.
+The compression uses the system zlib, if the library has been built with it (LIBCPPHTTPPARSER_ZLIB);
+without it, isAvailable() returns false, negotiate() always returns ccIdentity and the bodies pass through.
+Usage:
+	auto coding = Compressor::negotiate(acceptEncodingValue);
+	if (!Compressor::shouldCompress(response.contentType(), bodySize)) coding = Compressor::ccIdentity;
+	Compressor compressor(coding);
+	Compressor::setHeaders(response, compressor.coding());
+	send(response.serialize(200));
+	compressor.write(data, size, out); send(out); ...
+	compressor.finish(out); send(out);
+A zlib stream keeps about 256 KiB of state; recycle the compressors by reset() rather than creating new ones. */
+class Compressor
+{
+public:
+
+	/** The content codings (RFC 7231 @ 3.1.2.1). */
+	enum Coding
+	{
+		ccIdentity,  ///< No compression
+		ccGzip,      ///< The gzip format (RFC 1952)
+		ccDeflate,   ///< The zlib format (RFC 1950), as the "deflate" coding is defined
+	};
+
+	/** The compression level used for the streamed bodies, a balance between the ratio and the CPU use. */
+	static const int DEFAULT_LEVEL = 6;
+
+	/** The compression level used for the bodies that are compressed once and cached. */
+	static const int BEST_LEVEL = 9;
+
+	/** Bodies smaller than this are not worth compressing, the framing and the CPU cost outweigh the savings. */
+	static const size_t MIN_BODY_SIZE = 256;
+
+
+	/** Creates a compressor for the coding; ccIdentity if the coding is not available. */
+	explicit Compressor(Coding aCoding, int aLevel = DEFAULT_LEVEL);
+
+	~Compressor();
+
+	Compressor(const Compressor &) = delete;
+	Compressor & operator = (const Compressor &) = delete;
+
+	/** Prepares the compressor for a new body, keeping the zlib state allocated when possible. */
+	void reset(Coding aCoding, int aLevel = DEFAULT_LEVEL);
+
+	/** Returns the coding actually used, which is ccIdentity if the requested one is not available. */
+	Coding coding() const { return mCoding; }
+
+	/** Compresses the data and appends the output produced so far, as a chunk, to aDest.
+	zlib buffers the input, so small writes may produce no output at all.
+	Returns false if the compression failed. */
+	bool write(const char * aData, size_t aSize, std::string & aDest);
+
+	/** Appends all the output for the data written so far, as a chunk, to aDest, so that the client can
+	decompress it without waiting for more data (such as for server-sent events). Costs some ratio.
+	Returns false if the compression failed. */
+	bool flush(std::string & aDest);
+
+	/** Ends the body: appends the rest of the output as a chunk and the terminating zero-length chunk to aDest.
+	Returns false if the compression failed. */
+	bool finish(std::string & aDest);
+
+	/** Returns the number of body bytes written. */
+	uint64_t bytesIn() const { return mBytesIn; }
+
+	/** Returns the number of compressed bytes produced, without the chunked framing. */
+	uint64_t bytesOut() const { return mBytesOut; }
+
+
+	/** Returns true if the library has been built with zlib. */
+	static bool isAvailable();
+
+	/** Returns the best coding acceptable according to the Accept-Encoding header value (RFC 7231 @ 5.3.4):
+	the one with the highest qvalue, gzip being preferred over deflate when they are equal.
+	Returns ccIdentity if neither is acceptable, or if zlib is not available. */
+	static Coding negotiate(std::string_view aAcceptEncoding);
+
+	/** Returns the name of the coding, as used in the Content-Encoding header; empty for ccIdentity. */
+	static std::string_view codingName(Coding aCoding);
+
+	/** Returns true if a body of the content type and size is worth compressing: text and the textual
+	application types (JSON, JavaScript, XML, SVG, ...), at least MIN_BODY_SIZE bytes long.
+	aBodySize is std::string::npos if not known beforehand. */
+	static bool shouldCompress(std::string_view aContentType, size_t aBodySize);
+
+	/** Sets the response headers for a body compressed with the coding: Content-Encoding and Vary.
+	A strong ETag already set on the response is weakened (prefixed with W/) for the compressed codings,
+	since it describes the identity bytes; If-None-Match still matches it, If-Range and If-Match no longer do.
+	aContentLength is the size of the compressed body; std::string::npos for the streamed body, which then
+	removes Content-Length and sets the chunked Transfer-Encoding. */
+	static void setHeaders(OutgoingResponse & aResponse, Coding aCoding, size_t aContentLength = std::string::npos);
+
+	/** Compresses the whole body with the coding, replacing the contents of aDest.
+	Returns false if the coding is ccIdentity, not available, or the compression failed. */
+	static bool compressWhole(Coding aCoding, std::string_view aBody, std::string & aDest, int aLevel = BEST_LEVEL);
+
+
+protected:
+
+	/** The zlib state, defined in the implementation so that zlib.h is not needed by the users. */
+	struct Stream;
+
+
+	/** The coding used. */
+	Coding mCoding;
+
+	/** The compression level of mStream. */
+	int mLevel;
+
+	/** The zlib stream; nullptr for ccIdentity. Kept across reset() for the same coding and level. */
+	std::unique_ptr<Stream> mStream;
+
+	/** The compressed output before it is framed as a chunk, kept to avoid reallocating it. */
+	std::string mOutput;
+
+	/** The number of body bytes written. */
+	uint64_t mBytesIn;
+
+	/** The number of compressed bytes produced. */
+	uint64_t mBytesOut;
+
+
+	/** Runs the compression of the data with the zlib flush mode, and appends the output as a chunk to aDest.
+	Returns false if the compression failed. */
+	bool compress(const char * aData, size_t aSize, int aFlush, std::string & aDest);
+
+	/** Appends the data as a single chunk to aDest; nothing for empty data. */
+	static void appendChunk(std::string & aDest, const char * aData, size_t aSize);
+};
+
+
+
+
+
+/** A bounded cache of the compressed variants of repeatedly sent bodies, such as static files, so that
+the same bytes are compressed only once (at the BEST_LEVEL) rather than on each request.
+The entries are keyed by the content itself (and the coding), the least recently used ones are evicted
+once the memory limit is reached. The original body is kept in the entry as well, so that a lookup never
+returns the variant of a different body; its size counts towards the limit.
+Thread-safe; the compression runs outside the lock. */
+class CompressionCache
+{
+public:
+
+	typedef std::shared_ptr<const std::string> BodyPtr;
+
+	/** The default limit on the memory used by the entries. */
+	static const size_t DEFAULT_MAX_MEMORY = 16 * 1024 * 1024;
+
+
+	CompressionCache(size_t aMaxMemory = DEFAULT_MAX_MEMORY, int aLevel = Compressor::BEST_LEVEL);
+
+	/** Returns the body compressed with the coding, compressing and caching it on the first request.
+	Returns nullptr if the body is to be sent as is: for ccIdentity, without zlib, or if the compression
+	doesn't make the body smaller (which is cached as well). The returned body stays valid after eviction. */
+	BodyPtr get(std::string_view aBody, Compressor::Coding aCoding);
+
+	/** Removes all entries. */
+	void clear();
+
+	/** Returns the number of entries. */
+	size_t size() const;
+
+	/** Returns the memory used by the entries. */
+	size_t memoryUsed() const;
+
+	/** Returns the number of lookups served from the cache. */
+	uint64_t hits() const;
+
+	/** Returns the number of lookups that had to compress the body. */
+	uint64_t misses() const;
+
+
+protected:
+
+	/** A single cached variant. */
+	struct Entry
+	{
+		/** The key of the entry in mIndex. */
+		uint64_t mKey;
+
+		/** The original body. */
+		std::string mOriginal;
+
+		/** The compressed body; nullptr if the compression doesn't pay off. */
+		BodyPtr mCompressed;
+
+		/** Returns the memory used by the entry. */
+		size_t memoryUsed() const;
+	};
+
+	typedef std::list<Entry> Entries;
+
+
+	/** Protects all the members below. */
+	mutable std::mutex mMutex;
+
+	/** The limit on the memory used by the entries. */
+	size_t mMaxMemory;
+
+	/** The compression level. */
+	int mLevel;
+
+	/** The entries, the most recently used first. */
+	Entries mEntries;
+
+	/** The entries by their key. */
+	std::unordered_map<uint64_t, Entries::iterator> mIndex;
+
+	/** The memory used by the entries. */
+	size_t mMemoryUsed;
+
+	/** The number of lookups served from the cache. */
+	uint64_t mHits;
+
+	/** The number of lookups that had to compress the body. */
+	uint64_t mMisses;
+
+
+	/** Returns the key for the body and coding. Different bodies may share a key, the original decides. */
+	static uint64_t makeKey(std::string_view aBody, Compressor::Coding aCoding);
+
+	/** Removes the entry. The caller holds the lock. */
+	void remove(Entries::iterator aEntry);
+};
+
+
+
+
+
+}  // namespace Http
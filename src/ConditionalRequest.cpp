@@ -0,0 +1,262 @@
+#include "ConditionalRequest.hpp"
+#include "CharTables.hpp"
+#include "Utils.hpp"
+
+
+
+
+
+namespace Http {
+
+
+
+
+
+// Entity tag helpers:
+
+namespace {
+
+/** Splits the next entity tag off the comma-separated list, storing it (with the W/ prefix and the quotes)
+into aTag. The tags may contain commas inside the quotes, so the list can't be split on commas only.
+Returns false if there are no more tags or the list is malformed. */
+bool nextETag(std::string_view & aList, std::string_view & aTag)
+{
+	size_t i = 0;
+	auto size = aList.size();
+	while ((i < size) && ((aList[i] == ',') || CharTables::isWhitespace(aList[i])))
+	{
+		i++;
+	}
+	auto start = i;
+	if ((i + 1 < size) && (aList[i] == 'W') && (aList[i + 1] == '/'))
+	{
+		i += 2;
+	}
+	if ((i >= size) || (aList[i] != '"'))
+	{
+		return false;
+	}
+	auto idxClosingQuote = aList.find('"', i + 1);
+	if (idxClosingQuote == std::string_view::npos)
+	{
+		return false;
+	}
+	aTag = aList.substr(start, idxClosingQuote + 1 - start);
+	aList.remove_prefix(idxClosingQuote + 1);
+	return true;
+}
+
+
+
+/** Returns true if the entity tag is weak (has the W/ prefix). */
+inline bool isWeakETag(std::string_view aTag)
+{
+	return ((aTag.size() >= 2) && (aTag[0] == 'W') && (aTag[1] == '/'));
+}
+
+
+
+/** Returns the entity tag without the W/ prefix. */
+inline std::string_view opaqueTag(std::string_view aTag)
+{
+	return isWeakETag(aTag) ? aTag.substr(2) : aTag;
+}
+
+
+
+/** Compares the entity tags (RFC 7232 @ 2.3.2). */
+bool etagsMatch(std::string_view aTag1, std::string_view aTag2, bool aIsWeakComparison)
+{
+	if (!aIsWeakComparison && (isWeakETag(aTag1) || isWeakETag(aTag2)))
+	{
+		return false;
+	}
+	return (opaqueTag(aTag1) == opaqueTag(aTag2));
+}
+
+}  // anonymous namespace
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// ConditionalRequest::Header:
+
+void ConditionalRequest::Header::add(std::string_view aValue)
+{
+	if (!mIsPresent)
+	{
+		mValue = aValue;
+		mIsPresent = true;
+		return;
+	}
+	if (mCombined.empty())
+	{
+		mCombined.assign(mValue);
+	}
+	mCombined.append(", ");
+	mCombined.append(aValue);
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// ConditionalRequest:
+
+ConditionalRequest::ConditionalRequest()
+{
+}
+
+
+
+
+
+ConditionalRequest::ConditionalRequest(const IncomingRequest & aRequest):
+	ConditionalRequest()
+{
+	// findHeader() combines the repeated headers already:
+	mIfMatch.mIsPresent           = aRequest.findHeader("If-Match",            mIfMatch.mValue);
+	mIfNoneMatch.mIsPresent       = aRequest.findHeader("If-None-Match",       mIfNoneMatch.mValue);
+	mIfModifiedSince.mIsPresent   = aRequest.findHeader("If-Modified-Since",   mIfModifiedSince.mValue);
+	mIfUnmodifiedSince.mIsPresent = aRequest.findHeader("If-Unmodified-Since", mIfUnmodifiedSince.mValue);
+	mIfRange.mIsPresent           = aRequest.findHeader("If-Range",            mIfRange.mValue);
+}
+
+
+
+
+
+bool ConditionalRequest::addHeader(HeaderId aId, std::string_view aValue)
+{
+	switch (aId)
+	{
+		case hiIfMatch:           mIfMatch.add(aValue);           return true;
+		case hiIfNoneMatch:       mIfNoneMatch.add(aValue);       return true;
+		case hiIfModifiedSince:   mIfModifiedSince.add(aValue);   return true;
+		case hiIfUnmodifiedSince: mIfUnmodifiedSince.add(aValue); return true;
+		case hiIfRange:           mIfRange.add(aValue);           return true;
+		default:
+		{
+			return false;
+		}
+	}
+}
+
+
+
+
+
+ConditionalRequest::Outcome ConditionalRequest::evaluate(
+	std::string_view aMethod,
+	std::string_view aETag,
+	std::time_t aLastModified,
+	bool aResourceExists
+) const
+{
+	std::time_t date;
+
+	// 1. If-Match, strong comparison; else 2. If-Unmodified-Since:
+	if (mIfMatch.mIsPresent)
+	{
+		if (!etagListMatches(mIfMatch.value(), aETag, false, aResourceExists))
+		{
+			return coPreconditionFailed;
+		}
+	}
+	else if (
+		mIfUnmodifiedSince.mIsPresent &&
+		(aLastModified != NO_DATE) &&
+		Utils::parseHttpDate(Utils::trimOws(mIfUnmodifiedSince.value()), date) &&
+		(aLastModified > date)
+	)
+	{
+		return coPreconditionFailed;
+	}
+
+	// 3. If-None-Match, weak comparison; else 4. If-Modified-Since, for GET and HEAD only:
+	auto isGetOrHead = ((aMethod == "GET") || (aMethod == "HEAD"));
+	if (mIfNoneMatch.mIsPresent)
+	{
+		if (etagListMatches(mIfNoneMatch.value(), aETag, true, aResourceExists))
+		{
+			return isGetOrHead ? coNotModified : coPreconditionFailed;
+		}
+	}
+	else if (
+		isGetOrHead &&
+		mIfModifiedSince.mIsPresent &&
+		(aLastModified != NO_DATE) &&
+		Utils::parseHttpDate(Utils::trimOws(mIfModifiedSince.value()), date) &&
+		(aLastModified <= date)
+	)
+	{
+		return coNotModified;
+	}
+	return coProceed;
+}
+
+
+
+
+
+bool ConditionalRequest::isRangeApplicable(std::string_view aETag, std::time_t aLastModified) const
+{
+	if (!mIfRange.mIsPresent)
+	{
+		return true;
+	}
+	auto value = Utils::trimOws(mIfRange.value());
+	if (!value.empty() && ((value[0] == '"') || isWeakETag(value)))
+	{
+		return (!aETag.empty() && etagsMatch(value, aETag, false));
+	}
+	std::time_t date;
+	return (
+		(aLastModified != NO_DATE) &&
+		Utils::parseHttpDate(value, date) &&
+		(date == aLastModified)
+	);
+}
+
+
+
+
+
+bool ConditionalRequest::etagListMatches(
+	std::string_view aList,
+	std::string_view aETag,
+	bool aIsWeakComparison,
+	bool aResourceExists
+)
+{
+	if (!aResourceExists)
+	{
+		return false;
+	}
+	if (Utils::trimOws(aList) == "*")
+	{
+		return true;
+	}
+	if (aETag.empty())
+	{
+		return false;
+	}
+	std::string_view tag;
+	while (nextETag(aList, tag))
+	{
+		if (etagsMatch(tag, aETag, aIsWeakComparison))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+
+
+
+
+}  // namespace Http
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <ctime>
+#include <string>
+#include <string_view>
+#include "HeaderTape.hpp"
+#include "Message.hpp"
+
+
+
+
+
+namespace Http {
+
+
+
+
+
+/** Evaluates the conditional headers of a request (RFC 7232) against the validators of the selected resource:
+If-Match, If-Unmodified-Since, If-None-Match and If-Modified-Since, as well as If-Range (RFC 7233 @ 3.2).
+The header values are kept as views, they must stay valid until the evaluation. Repeated headers are combined
+into a comma-separated list, the same way as Message combines them.
+Usage:
+	ConditionalRequest conditions(request);
+	switch (conditions.evaluate(request.method(), etag, lastModified, resourceExists))
+	{
+		case ConditionalRequest::coNotModified:        send(response.serializeNotModified()); break;
+		case ConditionalRequest::coPreconditionFailed: send 412; break;
+		case ConditionalRequest::coProceed:            send the resource; break;
+	}
+*/
+class ConditionalRequest
+{
+public:
+
+	/** The outcome of the evaluation. */
+	enum Outcome
+	{
+		coProceed,             ///< The conditions don't prevent the request from being processed normally
+		coNotModified,         ///< The client's copy is current, respond with 304 (Not Modified)
+		coPreconditionFailed,  ///< A precondition doesn't hold, respond with 412 (Precondition Failed)
+	};
+
+	/** The value of aLastModified for resources whose modification time is not known. */
+	static const std::time_t NO_DATE = -1;
+
+
+	/** Creates an evaluator without any conditions; add them by addHeader(). */
+	ConditionalRequest();
+
+	/** Creates an evaluator for the conditional headers of the request.
+	The request must not be modified while the evaluator is in use. */
+	explicit ConditionalRequest(const IncomingRequest & aRequest);
+
+	/** Records the header, if it is one of the conditional headers, such as when iterating over a HeaderTape.
+	A repeated header is combined with the values recorded before it.
+	Returns true if the header has been recorded. */
+	bool addHeader(HeaderId aId, std::string_view aValue);
+
+	/** Evaluates the preconditions in the order given by RFC 7232 @ 6 for the request method and the
+	validators of the resource: aETag is its entity tag including the quotes (and the W/ prefix for weak ones),
+	empty if it has none; aLastModified is its modification time, NO_DATE if not known.
+	aResourceExists is false if the target resource has no current representation, such as for a PUT that
+	creates it; "*" then matches neither in If-Match nor in If-None-Match. */
+	Outcome evaluate(
+		std::string_view aMethod,
+		std::string_view aETag,
+		std::time_t aLastModified,
+		bool aResourceExists = true
+	) const;
+
+	/** Returns true if a Range header is to be honored according to the If-Range header (RFC 7233 @ 3.2):
+	if there's no If-Range, or if it holds the current strong entity tag or the exact modification time. */
+	bool isRangeApplicable(std::string_view aETag, std::time_t aLastModified) const;
+
+	/** Returns true if any entity tag in the If-Match / If-None-Match style list matches aETag.
+	"*" matches any existing representation, that is any aETag including an empty one, as long as
+	aResourceExists is true. Nothing matches a resource that doesn't exist.
+	With the weak comparison, the W/ prefixes are ignored; with the strong one, weak tags never match. */
+	static bool etagListMatches(
+		std::string_view aList,
+		std::string_view aETag,
+		bool aIsWeakComparison,
+		bool aResourceExists = true
+	);
+
+
+protected:
+
+	/** The value of a single conditional header. */
+	struct Header
+	{
+		/** The value, as a view; unused once the header is repeated. */
+		std::string_view mValue;
+
+		/** The values of a repeated header, combined into a list; empty unless the header is repeated. */
+		std::string mCombined;
+
+		/** True if the header is present. */
+		bool mIsPresent = false;
+
+		/** Returns the value of the header, combined if it is repeated. */
+		std::string_view value() const { return mCombined.empty() ? mValue : std::string_view(mCombined); }
+
+		/** Records the value, combining it with the previous one if the header is already present. */
+		void add(std::string_view aValue);
+	};
+
+
+	/** The conditional headers. */
+	Header mIfMatch;
+	Header mIfNoneMatch;
+	Header mIfModifiedSince;
+	Header mIfUnmodifiedSince;
+	Header mIfRange;
+};
+
+
+
+
+
+}  // namespace Http
@@ -0,0 +1,108 @@
+#include "DateCache.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include "Utils.hpp"
+
+
+
+
+
+namespace Http {
+
+
+
+
+
+namespace {
+
+/** Number of 64-bit words needed to store the formatted date. */
+const size_t NUM_WORDS = (Utils::HTTP_DATE_LENGTH + 7) / 8;
+
+/** The sequence counter of the seqlock. Odd while the date is being rewritten. */
+std::atomic<uint32_t> gSequence(0);
+
+/** The second for which the stored date has been formatted; -1 before the first use. */
+std::atomic<long long> gSecond(-1);
+
+/** The formatted date, stored in atomic words so that the readers racing a writer are well-defined. */
+std::atomic<uint64_t> gWords[NUM_WORDS];
+
+
+
+
+
+/** Formats the date for the specified second and publishes it, unless another thread is already doing so. */
+void update(long long aSecond)
+{
+	auto seq = gSequence.load(std::memory_order_relaxed);
+	if (((seq & 1) != 0) || !gSequence.compare_exchange_strong(seq, seq + 1, std::memory_order_acquire))
+	{
+		// Another thread is writing the new value, let it finish
+		return;
+	}
+	std::atomic_thread_fence(std::memory_order_release);
+
+	uint64_t words[NUM_WORDS] = {};
+	Utils::formatHttpDate(reinterpret_cast<char *>(words), static_cast<std::time_t>(aSecond));
+	for (size_t i = 0; i < NUM_WORDS; ++i)
+	{
+		gWords[i].store(words[i], std::memory_order_relaxed);
+	}
+	gSecond.store(aSecond, std::memory_order_relaxed);
+	gSequence.store(seq + 2, std::memory_order_release);
+}
+
+}  // anonymous namespace
+
+
+
+
+
+void DateCache::current(char * aDest)
+{
+	auto now = static_cast<long long>(std::time(nullptr));
+	if (gSecond.load(std::memory_order_relaxed) != now)
+	{
+		update(now);
+	}
+
+	// Read the words, retrying if a writer has been active in the meantime:
+	uint64_t words[NUM_WORDS];
+	for (;;)
+	{
+		auto seqBefore = gSequence.load(std::memory_order_acquire);
+		if ((seqBefore & 1) != 0)
+		{
+			continue;
+		}
+		for (size_t i = 0; i < NUM_WORDS; ++i)
+		{
+			words[i] = gWords[i].load(std::memory_order_relaxed);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (gSequence.load(std::memory_order_relaxed) == seqBefore)
+		{
+			break;
+		}
+	}
+	memcpy(aDest, words, Utils::HTTP_DATE_LENGTH);
+}
+
+
+
+
+
+std::string DateCache::current()
+{
+	char date[Utils::HTTP_DATE_LENGTH];
+	current(date);
+	return std::string(date, sizeof(date));
+}
+
+
+
+
+
+}  // namespace Http
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+
+
+
+
+
+namespace Http {
+
+
+
+
+
+/** Provides the current date formatted for the Date header (RFC 7231 @ 7.1.1.2), shared by all threads.
+The formatted string is regenerated at most once per second, by whichever thread first notices that the
+second has changed, and published through a seqlock. Readers never block each other and never take a lock. */
+class DateCache
+{
+public:
+
+	/** Copies the current date, formatted for the Date header, into aDest.
+	aDest must have room for at least Utils::HTTP_DATE_LENGTH chars. No terminating NUL is written. */
+	static void current(char * aDest);
+
+	/** Returns the current date, formatted for the Date header. */
+	static std::string current();
+};
+
+
+
+
+
+}  // namespace Http
@@ -1,5 +1,8 @@
 #include "EnvelopeParser.hpp"
 #include <cassert>
+#include <cstring>
+#include <limits>
+#include "CharTables.hpp"
 
 
 
@@ -11,9 +14,72 @@ namespace Http {
 
 
 
+// Line parsing helpers:
+
+namespace {
+
+/** Returns the index of the first character at or after aStart that is not a SP or HTAB, or aEnd if none. */
+size_t skipOws(const char * aData, size_t aStart, size_t aEnd)
+{
+	while ((aStart < aEnd) && CharTables::isWhitespace(aData[aStart]))
+	{
+		aStart++;
+	}
+	return aStart;
+}
+
+
+
+/** Returns the index of the CRLF terminating the line starting at aStart, or std::string::npos if none. */
+size_t findCrLf(const char * aData, size_t aStart, size_t aSize)
+{
+	while (aStart < aSize)
+	{
+		auto lf = static_cast<const char *>(memchr(aData + aStart, '\n', aSize - aStart));
+		if (lf == nullptr)
+		{
+			return std::string::npos;
+		}
+		auto idxLF = static_cast<size_t>(lf - aData);
+		if ((idxLF > 0) && (aData[idxLF - 1] == '\r'))
+		{
+			return idxLF - 1;
+		}
+		aStart = idxLF + 1;
+	}
+	return std::string::npos;
+}
+
+}  // anonymous namespace
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// EnvelopeParser::Limits:
+
+EnvelopeParser::Limits::Limits():
+	mMaxLineLength(8 * 1024),
+	mMaxBlockSize(64 * 1024),
+	mMaxHeaderCount(100)
+{
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// EnvelopeParser:
+
 EnvelopeParser::EnvelopeParser(Callbacks & aCallbacks) :
 	mCallbacks(aCallbacks),
-	mIsInHeaders(true)
+	mIsInHeaders(true),
+	mStats(nullptr),
+	mErrorCode(ecNone),
+	mBlockSize(0),
+	mNumHeaders(0)
 {
 }
 
@@ -32,12 +98,21 @@ size_t EnvelopeParser::parse(const char * aData, size_t aSize)
 	auto searchStart = mIncomingData.size();
 	searchStart = (searchStart > 1) ? searchStart - 1 : 0;
 
-	mIncomingData.append(aData, aSize);
+	HTTP_STATS_CODE(auto oldCapacity = mIncomingData.capacity();)
+	if (!mMemoryAccount.append(mIncomingData, aData, aSize))
+	{
+		return fail(ecMemoryLimit);
+	}
+	HTTP_STATS(mStats, addBuffered(aSize, oldCapacity, mIncomingData.capacity()));
 
 	size_t idxCRLF = mIncomingData.find("\r\n", searchStart);
 	if (idxCRLF == std::string::npos)
 	{
 		// Not a complete line yet, all input consumed:
+		if (!checkPartialLine())
+		{
+			return std::string::npos;
+		}
 		return aSize;
 	}
 
@@ -45,6 +120,10 @@ size_t EnvelopeParser::parse(const char * aData, size_t aSize)
 	size_t last = 0;
 	do
 	{
+		if (mBlockSize + idxCRLF + 2 > mLimits.mMaxBlockSize)
+		{
+			return fail(ecBlockTooLarge);
+		}
 		if (idxCRLF == last)
 		{
 			// This was the last line of the data. Finish whatever value has been cached and return:
@@ -52,16 +131,25 @@ size_t EnvelopeParser::parse(const char * aData, size_t aSize)
 			mIsInHeaders = false;
 			return aSize - (mIncomingData.size() - idxCRLF) + 2;
 		}
+		if (idxCRLF - last > mLimits.mMaxLineLength)
+		{
+			return fail(ecLineTooLong);
+		}
 		if (!parseLine(mIncomingData.c_str() + last, idxCRLF - last))
 		{
 			// An error has occurred
-			mIsInHeaders = false;
-			return std::string::npos;
+			return fail((mErrorCode == ecNone) ? ecMalformedLine : mErrorCode);
 		}
 		last = idxCRLF + 2;
 		idxCRLF = mIncomingData.find("\r\n", idxCRLF + 2);
 	} while (idxCRLF != std::string::npos);
 	mIncomingData.erase(0, last);
+	mBlockSize += last;
+	HTTP_STATS(mStats, add(ParserStats::scBufferCompactions, 1));
+	if (!checkPartialLine())
+	{
+		return std::string::npos;
+	}
 
 	// Parsed all lines and still expecting more
 	return aSize;
@@ -77,6 +165,111 @@ void EnvelopeParser::reset()
 	mIncomingData.clear();
 	mLastKey.clear();
 	mLastValue.clear();
+	mErrorCode = ecNone;
+	mBlockSize = 0;
+	mNumHeaders = 0;
+}
+
+
+
+
+
+size_t EnvelopeParser::parseTape(const char * aData, size_t aSize, HeaderTape & aTape)
+{
+	aTape.clear();
+
+	// The offsets must fit the tape entries, so the block must end within the first 4 GiB:
+	bool isTruncated = (aSize > std::numeric_limits<uint32_t>::max());
+	if (isTruncated)
+	{
+		aSize = std::numeric_limits<uint32_t>::max();
+	}
+	size_t last = 0;
+	for (;;)
+	{
+		auto idxCRLF = findCrLf(aData, last, aSize);
+		if (idxCRLF == std::string::npos)
+		{
+			// Not a complete block yet
+			aTape.clear();
+			return isTruncated ? std::string::npos : 0;
+		}
+		if (idxCRLF == last)
+		{
+			// The empty line terminating the block
+			aTape.mBlockSize = idxCRLF + 2;
+			return aTape.mBlockSize;
+		}
+
+		if (CharTables::isSpaceOrControl(aData[last]))
+		{
+			// This line is a continuation for the previous line, extend the previous value over it:
+			if (aTape.mEntries.empty())
+			{
+				return std::string::npos;
+			}
+			auto & prev = aTape.mEntries.back();
+			prev.mValueLength = static_cast<uint32_t>(idxCRLF - prev.mValueOffset);
+			prev.mFlags |= HeaderTape::efFolded;
+			last = idxCRLF + 2;
+			continue;
+		}
+
+		// This is a line with a new key:
+		auto colon = static_cast<const char *>(memchr(aData + last, ':', idxCRLF - last));
+		if (colon == nullptr)
+		{
+			// No colon was found, key-less header??
+			return std::string::npos;
+		}
+		auto idxColon = static_cast<size_t>(colon - aData);
+		if (idxColon - last > std::numeric_limits<uint16_t>::max())
+		{
+			return std::string::npos;
+		}
+		auto valueStart = skipOws(aData, idxColon + 1, idxCRLF);
+		HeaderTape::Entry entry;
+		entry.mNameOffset = static_cast<uint32_t>(last);
+		entry.mValueOffset = static_cast<uint32_t>(valueStart);
+		entry.mValueLength = static_cast<uint32_t>(idxCRLF - valueStart);
+		entry.mNameLength = static_cast<uint16_t>(idxColon - last);
+		entry.mId = HeaderTape::headerId(std::string_view(aData + last, idxColon - last));
+		entry.mFlags = 0;
+		aTape.mEntries.push_back(entry);
+		last = idxCRLF + 2;
+	}
+}
+
+
+
+
+
+size_t EnvelopeParser::fail(ErrorCode aErrorCode)
+{
+	mErrorCode = aErrorCode;
+	mIsInHeaders = false;
+	return std::string::npos;
+}
+
+
+
+
+
+bool EnvelopeParser::checkPartialLine()
+{
+	// The partial line may already include the CR of its terminating CRLF:
+	auto partialSize = mIncomingData.size();
+	if ((partialSize > 0) && (partialSize - 1 > mLimits.mMaxLineLength))
+	{
+		fail(ecLineTooLong);
+		return false;
+	}
+	if (mBlockSize + partialSize > mLimits.mMaxBlockSize)
+	{
+		fail(ecBlockTooLarge);
+		return false;
+	}
+	return true;
 }
 
 
@@ -100,7 +293,7 @@ void EnvelopeParser::notifyLast()
 bool EnvelopeParser::parseLine(const char * aData, size_t aSize)
 {
 	assert(aSize > 0);
-	if (aData[0] <= ' ')
+	if (CharTables::isSpaceOrControl(aData[0]))
 	{
 		// This line is a continuation for the previous line
 		if (mLastKey.empty())
@@ -108,25 +301,29 @@ bool EnvelopeParser::parseLine(const char * aData, size_t aSize)
 			return false;
 		}
 		// Append, including the whitespace in aData[0]
+		if (mLastKey.size() + mLastValue.size() + aSize > mLimits.mMaxLineLength)
+		{
+			mErrorCode = ecLineTooLong;
+			return false;
+		}
 		mLastValue.append(aData, aSize);
 		return true;
 	}
 
 	// This is a line with a new key:
 	notifyLast();
+	if (++mNumHeaders > mLimits.mMaxHeaderCount)
+	{
+		mErrorCode = ecTooManyHeaders;
+		return false;
+	}
 	for (size_t i = 0; i < aSize; i++)
 	{
 		if (aData[i] == ':')
 		{
 			mLastKey.assign(aData, i);
-			if (aSize > i + 1)
-			{
-				mLastValue.assign(aData + i + 2, aSize - i - 2);
-			}
-			else
-			{
-				mLastValue.clear();
-			}
+			auto valueStart = skipOws(aData, i + 1, aSize);
+			mLastValue.assign(aData + valueStart, aSize - valueStart);
 			return true;
 		}
 	}  // for i - aData[]
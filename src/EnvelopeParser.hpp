@@ -1,6 +1,9 @@
 #pragma once
 
 #include <string>
+#include "HeaderTape.hpp"
+#include "MemoryGovernor.hpp"
+#include "ParserStats.hpp"
 
 
 
@@ -31,6 +34,37 @@ public:
 	};
 
 
+	/** Limits on the parsed envelope, bounding the memory used by the parser to roughly mMaxLineLength + mMaxBlockSize plus the size of the data passed
+	to a single parse() call. A limit may be set to std::numeric_limits<size_t>::max() to disable it. */
+	struct Limits
+	{
+		/** Maximum length of a single header, excluding the CRLF; for headers with continuation lines,
+		the combined length of the key and value. */
+		size_t mMaxLineLength;
+
+		/** Maximum size of the whole envelope, including the terminating empty line. */
+		size_t mMaxBlockSize;
+
+		/** Maximum number of headers. */
+		size_t mMaxHeaderCount;
+
+		/** Creates the default limits: 8 KiB line, 64 KiB block, 100 headers. */
+		Limits();
+	};
+
+
+	/** The reasons for the parser to fail. */
+	enum ErrorCode
+	{
+		ecNone,             ///< No error
+		ecMalformedLine,    ///< A line is not a valid header (no colon, continuation without a header)
+		ecLineTooLong,      ///< A header is longer than Limits::mMaxLineLength
+		ecBlockTooLarge,    ///< The envelope is larger than Limits::mMaxBlockSize
+		ecTooManyHeaders,   ///< There are more headers than Limits::mMaxHeaderCount
+		ecMemoryLimit,      ///< The MemoryGovernor watermark has been crossed, the data couldn't be buffered
+	};
+
+
 	EnvelopeParser(Callbacks & aCallbacks);
 
 	/** Parses the incoming data.
@@ -42,6 +76,31 @@ public:
 	/** Makes the parser forget everything parsed so far, so that it can be reused for parsing another datastream */
 	void reset();
 
+	/** Parses a complete header block in a single pass, without any callbacks, filling aTape with the offsets of
+	the headers within aData. The continuation lines are handled the same way as by parse().
+	Returns the size of the block, including the terminating empty line, as also stored in aTape.
+	Returns 0 if the block is not complete yet (aTape is then to be ignored), or std::string::npos on error. */
+	static size_t parseTape(const char * aData, size_t aSize, HeaderTape & aTape);
+
+	/** Attaches the statistics object to be updated by the parser; nullptr to detach.
+	The statistics are only collected if the library is compiled with HTTP_PARSER_STATS. */
+	void setStats(ParserStats * aStats) { mStats = aStats; }
+
+	/** Sets the limits to be enforced by parse(). */
+	void setLimits(const Limits & aLimits) { mLimits = aLimits; }
+
+	/** Returns the limits enforced by parse(). */
+	const Limits & limits() const { return mLimits; }
+
+	/** Returns the reason of the last failure of parse(); ecNone if it hasn't failed since the last reset(). */
+	ErrorCode errorCode() const { return mErrorCode; }
+
+	/** Returns the approximate amount of memory held by the parser's buffers. */
+	size_t retainedMemory() const
+	{
+		return mIncomingData.capacity() + mLastKey.capacity() + mLastValue.capacity();
+	}
+
 	/** Returns true if more input is expected for the envelope header */
 	bool isInHeaders() const { return mIsInHeaders; }
 
@@ -60,12 +119,37 @@ public:
 	/** Buffer for the incoming data until it is parsed */
 	std::string mIncomingData;
 
+	/** The MemoryGovernor charges for the growth of mIncomingData. */
+	MemoryGovernor::Account mMemoryAccount;
+
 	/** Holds the last parsed key; used for line-wrapped values */
 	std::string mLastKey;
 
 	/** Holds the last parsed value; used for line-wrapped values */
 	std::string mLastValue;
 
+	/** The statistics to update, or nullptr if not collecting. */
+	ParserStats * mStats;
+
+	/** The limits enforced by parse(). */
+	Limits mLimits;
+
+	/** The reason of the last failure of parse(). */
+	ErrorCode mErrorCode;
+
+	/** Size of the complete lines of the envelope parsed so far. */
+	size_t mBlockSize;
+
+	/** Number of headers parsed so far. */
+	size_t mNumHeaders;
+
+
+	/** Sets the error code and stops parsing. Returns std::string::npos, for the callers to return. */
+	size_t fail(ErrorCode aErrorCode);
+
+	/** Checks the limits for the incomplete line left in mIncomingData.
+	Returns false (having called fail()) if exceeded. */
+	bool checkPartialLine();
 
 	/** Notifies the callback of the key / value stored in mLastKey / mLastValue, then erases them */
 	void notifyLast();
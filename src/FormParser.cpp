@@ -2,6 +2,7 @@
 #include <vector>
 #include <cassert>
 #include <cstring>
+#include "CharTables.hpp"
 #include "Utils.hpp"
 #include "Message.hpp"
 #include "MultipartParser.hpp"
@@ -17,11 +18,134 @@ namespace Http {
 
 
 
+// Parsing helpers:
+
+namespace {
+
+/** Splits the input on the separator the same way as Utils::stringSplit() does (an empty trailing piece is
+dropped), storing up to aMaxPieces pieces into aPieces. Returns the total number of pieces. */
+size_t splitView(std::string_view aInput, char aSeparator, std::string_view * aPieces, size_t aMaxPieces)
+{
+	size_t numPieces = 0;
+	size_t prev = 0;
+	size_t cutAt;
+	while ((cutAt = aInput.find(aSeparator, prev)) != std::string_view::npos)
+	{
+		if (numPieces < aMaxPieces)
+		{
+			aPieces[numPieces] = aInput.substr(prev, cutAt - prev);
+		}
+		numPieces += 1;
+		prev = cutAt + 1;
+	}
+	if (prev < aInput.size())
+	{
+		if (numPieces < aMaxPieces)
+		{
+			aPieces[numPieces] = aInput.substr(prev);
+		}
+		numPieces += 1;
+	}
+	return numPieces;
+}
+
+
+
+/** Copies the value of the parameter into aDest, or clears aDest if the parameter is not present. */
+void copyParam(const NameValueParser & aParser, const char * aName, std::string & aDest)
+{
+	auto itr = aParser.find(aName);
+	if (itr == aParser.end())
+	{
+		aDest.clear();
+	}
+	else
+	{
+		aDest = itr->second;
+	}
+}
+
+}  // anonymous namespace
+
+
+
+
+
 FormParser::FormParser(const IncomingRequest & aRequest, Callbacks & aCallbacks) :
-	mCallbacks(aCallbacks),
+	mCallbacks(&aCallbacks),
+	mIsValid(true),
+	mIsCurrentPartFile(false),
+	mFileHasBeenAnnounced(false),
+	mStats(nullptr)
+{
+	init(aRequest);
+}
+
+
+
+
+
+FormParser::FormParser(Kind aKind, const char * aData, size_t aSize, Callbacks & aCallbacks) :
+	mCallbacks(&aCallbacks),
+	mKind(aKind),
 	mIsValid(true),
 	mIsCurrentPartFile(false),
-	mFileHasBeenAnnounced(false)
+	mFileHasBeenAnnounced(false),
+	mStats(nullptr)
+{
+	parse(aData, aSize);
+}
+
+
+
+
+
+void FormParser::reset(const IncomingRequest & aRequest, Callbacks & aCallbacks)
+{
+	mSpareNodes.reclaim(*this);
+	mCallbacks = &aCallbacks;
+	mIncomingData.clear();
+	mIsValid = true;
+	mCurrentPartName.clear();
+	mIsCurrentPartFile = false;
+	mCurrentPartFileName.clear();
+	mFileHasBeenAnnounced = false;
+	init(aRequest);
+}
+
+
+
+
+
+void FormParser::setStats(ParserStats * aStats)
+{
+	mStats = aStats;
+	if (mMultipartParser != nullptr)
+	{
+		mMultipartParser->setStats(aStats);
+	}
+}
+
+
+
+
+
+size_t FormParser::retainedMemory() const
+{
+	size_t res = sizeof(*this) + mIncomingData.capacity() + mCurrentPartName.capacity() + mCurrentPartFileName.capacity();
+	res += mDecodedName.capacity() + mDecodedValue.capacity() + mSpareNodes.retainedMemory();
+	for (const auto & value: *this)
+	{
+		res += mSpareNodes.nodeOverhead() + value.first.capacity() + value.second.capacity();
+	}
+	return res;
+}
+
+
+
+
+
+void FormParser::init(const IncomingRequest & aRequest)
 {
 	if (aRequest.method() == "GET")
 	{
@@ -58,20 +182,6 @@ FormParser::FormParser(const IncomingRequest & aRequest, Callbacks & aCallbacks)
 
 
 
-FormParser::FormParser(Kind aKind, const char * aData, size_t aSize, Callbacks & aCallbacks) :
-	mCallbacks(aCallbacks),
-	mKind(aKind),
-	mIsValid(true),
-	mIsCurrentPartFile(false),
-	mFileHasBeenAnnounced(false)
-{
-	parse(aData, aSize);
-}
-
-
-
-
-
 void FormParser::parse(const char * aData, size_t aSize)
 {
 	if (!mIsValid)
@@ -79,19 +189,31 @@ void FormParser::parse(const char * aData, size_t aSize)
 		return;
 	}
 
+	HTTP_STATS(mStats, add(ParserStats::scFormBytes, aSize));
 	switch (mKind)
 	{
 		case fpkURL:
 		case fpkFormUrlEncoded:
 		{
 			// This format is used for smaller forms (not file uploads), so we can delay parsing it until Finish()
-			mIncomingData.append(aData, aSize);
+			HTTP_STATS_CODE(auto oldCapacity = mIncomingData.capacity();)
+			if (!mMemoryAccount.append(mIncomingData, aData, aSize))
+			{
+				HTTP_STATS(mStats, add(ParserStats::scErrors, 1));
+				mIsValid = false;
+				return;
+			}
+			HTTP_STATS(mStats, addBuffered(aSize, oldCapacity, mIncomingData.capacity()));
 			break;
 		}
 		case fpkMultipart:
 		{
 			assert(mMultipartParser.get() != nullptr);
 			mMultipartParser->parse(aData, aSize);
+			if (!mMultipartParser->isValid())
+			{
+				mIsValid = false;
+			}
 			break;
 		}
 	}
@@ -144,8 +266,14 @@ bool FormParser::hasFormData(const IncomingRequest & aRequest)
 
 void FormParser::beginMultipart(const IncomingRequest & aRequest)
 {
-	assert(mMultipartParser.get() == nullptr);
+	if (mMultipartParser != nullptr)
+	{
+		// Reuse the parser from the previous request (after reset()):
+		mMultipartParser->reset(aRequest.contentType());
+		return;
+	}
 	mMultipartParser.reset(new MultipartParser(aRequest.contentType(), *this));
+	mMultipartParser->setStats(mStats);
 }
 
 
@@ -155,42 +283,52 @@ void FormParser::beginMultipart(const IncomingRequest & aRequest)
 void FormParser::parseFormUrlEncoded()
 {
 	// Parse mIncomingData for all the variables; no more data is incoming, since this is called from Finish()
-	// This may not be the most performant version, but we don't care, the form data is small enough and we're not a full-fledged web server anyway
-	auto lines = Utils::stringSplit(mIncomingData, "&");
-	for (auto itr = lines.begin(), end = lines.end(); itr != end; ++itr)
+	// The pieces are split the same way as Utils::stringSplit() would, but without copying:
+	std::string_view pieces[3];
+	auto numItems = splitView(mIncomingData, '&', nullptr, 0);
+	std::string_view data(mIncomingData);
+	for (size_t i = 0; i < numItems; ++i)
 	{
-		auto Components = Utils::stringSplit(*itr, "=");
-		switch (Components.size())
+		auto idxAmp = data.find('&');
+		auto item = data.substr(0, idxAmp);
+		data.remove_prefix((idxAmp == std::string_view::npos) ? data.size() : idxAmp + 1);
+		switch (splitView(item, '=', pieces, 3))
 		{
 			default:
 			{
 				// Neither name nor value, or too many "="s, mark this as invalid form:
+				HTTP_STATS(mStats, add(ParserStats::scErrors, 1));
 				mIsValid = false;
 				return;
 			}
 			case 1:
 			{
 				// Only name present
-				auto name = Utils::urlDecode(Utils::replaceAllCharOccurrences(Components[0], '+', ' '));
-				if (name.first)
+				mDecodedName.clear();
+				if (Utils::urlDecodeAppend(pieces[0], true, mDecodedName))
 				{
-					(*this)[name.second] = "";
+					mSpareNodes.assign(*this, mDecodedName, std::string_view());
+					HTTP_STATS(mStats, add(ParserStats::scFormFields, 1));
 				}
 				break;
 			}
 			case 2:
 			{
 				// name=value format:
-				auto name = Utils::urlDecode(Components[0]);
-				auto value = Utils::urlDecode(Components[1]);
-				if (name.first && value.first)
+				mDecodedName.clear();
+				mDecodedValue.clear();
+				if (
+					Utils::urlDecodeAppend(pieces[0], true, mDecodedName) &&
+					Utils::urlDecodeAppend(pieces[1], true, mDecodedValue)
+				)
 				{
-					(*this)[name.second] = value.second;
+					mSpareNodes.assign(*this, mDecodedName, mDecodedValue);
+					HTTP_STATS(mStats, add(ParserStats::scFormFields, 1));
 				}
 				break;
 			}
 		}
-	}  // for itr - Lines[]
+	}  // for i - items
 	mIncomingData.clear();
 }
 
@@ -212,17 +350,18 @@ void FormParser::onPartStart()
 
 void FormParser::onPartHeader(const std::string & aKey, const std::string & aValue)
 {
-	if (Utils::noCaseCompare(aKey, "Content-Disposition") == 0)
+	if (Utils::noCaseEqual(aKey, "Content-Disposition"))
 	{
 		size_t len = aValue.size();
 		size_t ParamsStart = std::string::npos;
 		for (size_t i = 0; i < len; ++i)
 		{
-			if (aValue[i] > ' ')
+			if (!CharTables::isSpaceOrControl(aValue[i]))
 			{
 				if (strncmp(aValue.c_str() + i, "form-data", 9) != 0)
 				{
 					// Content disposition is not "form-data", mark the whole form invalid
+					HTTP_STATS(mStats, add(ParserStats::scErrors, 1));
 					mIsValid = false;
 					return;
 				}
@@ -233,21 +372,24 @@ void FormParser::onPartHeader(const std::string & aKey, const std::string & aVal
 		if (ParamsStart == std::string::npos)
 		{
 			// There is data missing in the Content-Disposition field, mark the whole form invalid:
+			HTTP_STATS(mStats, add(ParserStats::scErrors, 1));
 			mIsValid = false;
 			return;
 		}
 
 		// Parse the field name and optional filename from this header:
-		NameValueParser Parser(aValue.data() + ParamsStart, aValue.size() - ParamsStart);
-		Parser.finish();
-		mCurrentPartName = Parser["name"];
-		if (!Parser.isValid() || mCurrentPartName.empty())
+		mDispositionParser.reset();
+		mDispositionParser.parse(aValue.data() + ParamsStart, aValue.size() - ParamsStart);
+		mDispositionParser.finish();
+		copyParam(mDispositionParser, "name", mCurrentPartName);
+		if (!mDispositionParser.isValid() || mCurrentPartName.empty())
 		{
 			// The required parameter "name" is missing, mark the whole form invalid:
+			HTTP_STATS(mStats, add(ParserStats::scErrors, 1));
 			mIsValid = false;
 			return;
 		}
-		mCurrentPartFileName = Parser["filename"];
+		copyParam(mDispositionParser, "filename", mCurrentPartFileName);
 	}
 }
 
@@ -268,11 +410,16 @@ void FormParser::onPartData(const char * aData, size_t aSize)
 		iterator itr = find(mCurrentPartName);
 		if (itr == end())
 		{
-			(*this)[mCurrentPartName] = std::string(aData, aSize);
+			mSpareNodes.insert(*this, mCurrentPartName, std::string_view(aData, aSize));
+			HTTP_STATS(mStats, add(ParserStats::scFormFields, 1));
 		}
 		else
 		{
-			itr->second.append(aData, aSize);
+			if (!mMemoryAccount.append(itr->second, aData, aSize))
+			{
+				HTTP_STATS(mStats, add(ParserStats::scErrors, 1));
+				mIsValid = false;
+			}
 		}
 	}
 	else
@@ -280,10 +427,10 @@ void FormParser::onPartData(const char * aData, size_t aSize)
 		// This is a file, pass it on through the callbacks
 		if (!mFileHasBeenAnnounced)
 		{
-			mCallbacks.onFileStart(*this, mCurrentPartFileName);
+			mCallbacks->onFileStart(*this, mCurrentPartFileName);
 			mFileHasBeenAnnounced = true;
 		}
-		mCallbacks.onFileData(*this, aData, aSize);
+		mCallbacks->onFileData(*this, aData, aSize);
 	}
 }
 
@@ -295,7 +442,7 @@ void FormParser::onPartEnd()
 {
 	if (mFileHasBeenAnnounced)
 	{
-		mCallbacks.onFileEnd(*this);
+		mCallbacks->onFileEnd(*this);
 	}
 	mCurrentPartName.clear();
 	mCurrentPartFileName.clear();
@@ -3,7 +3,11 @@
 #include <map>
 #include <string>
 #include <memory>
+#include "MapNodePool.hpp"
+#include "MemoryGovernor.hpp"
 #include "MultipartParser.hpp"
+#include "NameValueParser.hpp"
+#include "ParserStats.hpp"
 
 
 
@@ -72,11 +76,21 @@ public:
 	/** Returns true if the headers suggest the request has form data parseable by this class */
 	static bool hasFormData(const IncomingRequest & aRequest);
 
+	/** Reinitializes the parser for a new request, as if newly constructed, keeping the buffers grown so far. */
+	void reset(const IncomingRequest & aRequest, Callbacks & aCallbacks);
+
+	/** Returns the approximate amount of memory held by the parser, including the buffers kept for reuse. */
+	size_t retainedMemory() const;
+
+	/** Attaches the statistics object to be updated by the parser (and its multipart parser); nullptr to detach.
+	The statistics are only collected if the library is compiled with HTTP_PARSER_STATS. */
+	void setStats(ParserStats * aStats);
+
 
 protected:
 
 	/** The callbacks to call for incoming file data */
-	Callbacks & mCallbacks;
+	Callbacks * mCallbacks;
 
 	/** The kind of the parser (decided in the constructor, used in Parse() */
 	Kind mKind;
@@ -84,6 +98,9 @@ protected:
 	/** Buffer for the incoming data until it's parsed */
 	std::string mIncomingData;
 
+	/** The MemoryGovernor charges for the growth of mIncomingData and of the multipart field values. */
+	MemoryGovernor::Account mMemoryAccount;
+
 	/** True if the information received so far is a valid form; set to false on first problem. Further parsing is skipped when false. */
 	bool mIsValid;
 
@@ -102,6 +119,22 @@ protected:
 	/** Set to true after mCallbacks.OnFileStart() has been called, reset to false on PartEnd */
 	bool mFileHasBeenAnnounced;
 
+	/** The statistics to update, or nullptr if not collecting. */
+	ParserStats * mStats;
+
+	/** Parser for the Content-Disposition parameters of multipart parts, kept for reuse. */
+	NameValueParser mDispositionParser;
+
+	/** Buffers for the decoded name and value in form-urlencoded data, kept for reuse. */
+	std::string mDecodedName;
+	std::string mDecodedValue;
+
+	/** Map nodes kept for reuse after reset(). */
+	MapNodePool<std::map<std::string, std::string>> mSpareNodes;
+
+
+	/** Decides the kind of the parser from the request and sets it up for parsing; used by the constructor and reset(). */
+	void init(const IncomingRequest & aRequest);
 
 	/** Sets up the object for parsing a fpkMultipart request */
 	void beginMultipart(const IncomingRequest & aRequest);
@@ -0,0 +1,141 @@
+#include "HeaderTape.hpp"
+#include "Utils.hpp"
+
+
+
+
+
+namespace Http {
+
+
+
+
+
+// HeaderId helpers:
+
+namespace {
+
+/** The names of the well-known headers, indexed by their HeaderId. */
+const std::string_view HEADER_NAMES[hiCount] =
+{
+	std::string_view(),
+	"Accept",
+	"Accept-Encoding",
+	"Accept-Language",
+	"Authorization",
+	"Cache-Control",
+	"Connection",
+	"Content-Disposition",
+	"Content-Encoding",
+	"Content-Length",
+	"Content-Range",
+	"Content-Type",
+	"Cookie",
+	"Date",
+	"ETag",
+	"Expect",
+	"Host",
+	"If-Match",
+	"If-Modified-Since",
+	"If-None-Match",
+	"If-Range",
+	"If-Unmodified-Since",
+	"Last-Modified",
+	"Location",
+	"Range",
+	"Set-Cookie",
+	"TE",
+	"Trailer",
+	"Transfer-Encoding",
+	"Upgrade",
+	"User-Agent",
+};
+
+}  // anonymous namespace
+
+static_assert(sizeof(HeaderTape::Entry) == 16, "The tape entries are expected to be compact");
+
+
+
+
+
+HeaderTape::HeaderTape():
+	mBlockSize(0)
+{
+}
+
+
+
+
+
+void HeaderTape::clear()
+{
+	mEntries.clear();
+	mBlockSize = 0;
+}
+
+
+
+
+
+void HeaderTape::unfoldedValue(const char * aBlock, const Entry & aEntry, std::string & aValue)
+{
+	auto raw = rawValue(aBlock, aEntry);
+	if ((aEntry.mFlags & efFolded) == 0)
+	{
+		aValue.assign(raw);
+		return;
+	}
+	aValue.clear();
+	size_t last = 0;
+	for (;;)
+	{
+		auto idxCRLF = raw.find("\r\n", last);
+		if (idxCRLF == std::string_view::npos)
+		{
+			aValue.append(raw.substr(last));
+			return;
+		}
+		aValue.append(raw.substr(last, idxCRLF - last));
+		last = idxCRLF + 2;
+	}
+}
+
+
+
+
+
+size_t HeaderTape::find(HeaderId aId, size_t aStart) const
+{
+	for (size_t i = aStart, count = mEntries.size(); i < count; ++i)
+	{
+		if (mEntries[i].mId == aId)
+		{
+			return i;
+		}
+	}
+	return std::string::npos;
+}
+
+
+
+
+
+HeaderId HeaderTape::headerId(std::string_view aName)
+{
+	// The lengths differ for most of the names, so the string comparison is rarely done more than once:
+	for (size_t i = 1; i < hiCount; ++i)
+	{
+		if ((HEADER_NAMES[i].size() == aName.size()) && Utils::noCaseEqual(HEADER_NAMES[i], aName))
+		{
+			return static_cast<HeaderId>(i);
+		}
+	}
+	return hiUnknown;
+}
+
+
+
+
+
+}  // namespace Http
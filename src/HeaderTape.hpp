@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+
+
+
+namespace Http {
+
+
+
+
+
+/** Identifiers of the well-known headers, so that the consumers of a HeaderTape can dispatch on the headers
+without comparing strings. */
+enum HeaderId: uint8_t
+{
+	hiUnknown,
+	hiAccept,
+	hiAcceptEncoding,
+	hiAcceptLanguage,
+	hiAuthorization,
+	hiCacheControl,
+	hiConnection,
+	hiContentDisposition,
+	hiContentEncoding,
+	hiContentLength,
+	hiContentRange,
+	hiContentType,
+	hiCookie,
+	hiDate,
+	hiETag,
+	hiExpect,
+	hiHost,
+	hiIfMatch,
+	hiIfModifiedSince,
+	hiIfNoneMatch,
+	hiIfRange,
+	hiIfUnmodifiedSince,
+	hiLastModified,
+	hiLocation,
+	hiRange,
+	hiSetCookie,
+	hiTE,
+	hiTrailer,
+	hiTransferEncoding,
+	hiUpgrade,
+	hiUserAgent,
+	hiCount,  ///< The number of the ids; not a header
+};
+
+
+
+
+
+/** An index of a complete header block, filled in a single pass by EnvelopeParser::parseTape().
+Each header is described by a compact 16-byte entry with the offsets of its name and value within the block
+and the id of the header, so that the headers can be processed without any callbacks or copying.
+The offsets are relative to the start of the block, so the tape stays valid when the block is moved or copied,
+and it can be handed over to another thread together with the block. */
+class HeaderTape
+{
+public:
+
+	/** Flags of the entries. */
+	enum
+	{
+		efFolded = 0x01,  ///< The value spans multiple lines (obs-fold); use unfoldedValue() to get it as a single line
+	};
+
+
+	/** A single header in the block. */
+	struct Entry
+	{
+		/** Offset of the header name within the block. */
+		uint32_t mNameOffset;
+
+		/** Offset of the header value within the block, past the colon and any whitespace after it. */
+		uint32_t mValueOffset;
+
+		/** Length of the raw header value; for folded values, including the CRLFs of the continuation lines. */
+		uint32_t mValueLength;
+
+		/** Length of the header name. */
+		uint16_t mNameLength;
+
+		/** The HeaderId of the header name. */
+		uint8_t mId;
+
+		/** The ef* flags of the entry. */
+		uint8_t mFlags;
+	};
+
+
+	/** Creates an empty tape. */
+	HeaderTape();
+
+	/** Removes all the entries, keeping the allocated memory for reuse. */
+	void clear();
+
+	/** Returns the number of headers in the tape. */
+	size_t size() const { return mEntries.size(); }
+
+	/** Returns true if there are no headers in the tape. */
+	bool empty() const { return mEntries.empty(); }
+
+	/** Returns the specified entry. */
+	const Entry & operator [] (size_t aIndex) const { return mEntries[aIndex]; }
+
+	std::vector<Entry>::const_iterator begin() const { return mEntries.begin(); }
+	std::vector<Entry>::const_iterator end() const { return mEntries.end(); }
+
+	/** Returns the size of the whole header block, including the terminating empty line. */
+	size_t blockSize() const { return mBlockSize; }
+
+	/** Returns the name of the header, as a view into the block. */
+	static std::string_view name(const char * aBlock, const Entry & aEntry)
+	{
+		return std::string_view(aBlock + aEntry.mNameOffset, aEntry.mNameLength);
+	}
+
+	/** Returns the raw value of the header, as a view into the block.
+	For folded values (efFolded), the view includes the CRLFs of the continuation lines. */
+	static std::string_view rawValue(const char * aBlock, const Entry & aEntry)
+	{
+		return std::string_view(aBlock + aEntry.mValueOffset, aEntry.mValueLength);
+	}
+
+	/** Stores the value of the header into aValue, with the continuation lines joined the same way as
+	EnvelopeParser does (the CRLFs removed, the leading whitespace of the continuation lines kept). */
+	static void unfoldedValue(const char * aBlock, const Entry & aEntry, std::string & aValue);
+
+	/** Returns the index of the first entry with the specified id, at or after aStart.
+	Returns std::string::npos if there's none. */
+	size_t find(HeaderId aId, size_t aStart = 0) const;
+
+	/** Returns the id of the specified header name (case-insensitive); hiUnknown if not a well-known header. */
+	static HeaderId headerId(std::string_view aName);
+
+
+protected:
+
+	friend class EnvelopeParser;
+
+	/** The headers in the block, in their order. */
+	std::vector<Entry> mEntries;
+
+	/** Size of the whole header block, including the terminating empty line. */
+	size_t mBlockSize;
+};
+
+
+
+
+
+}  // namespace Http
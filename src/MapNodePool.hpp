@@ -0,0 +1,101 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+
+
+
+namespace Http {
+
+
+
+
+
+/** Keeps the nodes removed from a std::map<std::string, std::string> (or a class derived from it) for reuse,
+so that refilling the map after it has been cleared doesn't allocate.
+Copying a pool yields an empty pool, so that the classes holding one stay copyable. */
+template <typename Map>
+class MapNodePool
+{
+public:
+
+	MapNodePool() {}
+	MapNodePool(const MapNodePool &) {}
+	MapNodePool(MapNodePool &&) = default;
+	MapNodePool & operator = (const MapNodePool &) { return *this; }
+	MapNodePool & operator = (MapNodePool &&) = default;
+
+	/** Moves all the nodes of the map into the pool, leaving the map empty. */
+	void reclaim(Map & aMap)
+	{
+		while (!aMap.empty())
+		{
+			mNodes.push_back(aMap.extract(aMap.begin()));
+		}
+	}
+
+	/** Moves the node at the iterator from the map into the pool. */
+	void reclaim(Map & aMap, typename Map::iterator aItr)
+	{
+		mNodes.push_back(aMap.extract(aItr));
+	}
+
+	/** Inserts the key and value into the map, reusing a node from the pool if available.
+	The key must not be present in the map yet. */
+	typename Map::iterator insert(Map & aMap, std::string_view aKey, std::string_view aValue)
+	{
+		if (mNodes.empty())
+		{
+			return aMap.emplace(std::string(aKey), std::string(aValue)).first;
+		}
+		auto node = std::move(mNodes.back());
+		mNodes.pop_back();
+		node.key().assign(aKey);
+		node.mapped().assign(aValue);
+		return aMap.insert(std::move(node)).position;
+	}
+
+	/** Sets the value for the key, inserting the key into the map (reusing a node from the pool) if not present. */
+	typename Map::iterator assign(Map & aMap, const std::string & aKey, std::string_view aValue)
+	{
+		auto itr = aMap.find(aKey);
+		if (itr == aMap.end())
+		{
+			return insert(aMap, aKey, aValue);
+		}
+		itr->second.assign(aValue);
+		return itr;
+	}
+
+	/** Returns the approximate amount of memory held by the pooled nodes. */
+	size_t retainedMemory() const
+	{
+		size_t res = mNodes.capacity() * sizeof(typename Map::node_type);
+		for (const auto & node: mNodes)
+		{
+			res += nodeOverhead() + node.key().capacity() + node.mapped().capacity();
+		}
+		return res;
+	}
+
+	/** Returns the approximate size of a map node, including the allocator overhead, excluding the strings' buffers. */
+	static size_t nodeOverhead()
+	{
+		return sizeof(typename Map::value_type) + 4 * sizeof(void *);
+	}
+
+
+protected:
+
+	/** The nodes available for reuse. */
+	std::vector<typename Map::node_type> mNodes;
+};
+
+
+
+
+
+}  // namespace Http
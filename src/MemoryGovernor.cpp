@@ -0,0 +1,199 @@
+#include "MemoryGovernor.hpp"
+#include <atomic>
+
+
+
+
+
+namespace Http {
+
+
+
+
+
+// Shared state:
+
+namespace {
+
+/** The watermark; 0 when disabled. */
+std::atomic<size_t> gWatermark(0);
+
+/** The total of the charges flushed by all threads. May temporarily be negative, when a thread flushes the
+release of memory charged by a thread that hasn't flushed the charge yet. */
+std::atomic<int64_t> gUsage(0);
+
+/** The number of refused charges. */
+std::atomic<uint64_t> gRefusals(0);
+
+
+
+/** The charges of a single thread not yet added to gUsage. */
+class ThreadBalance
+{
+public:
+
+	int64_t mPending = 0;
+
+	~ThreadBalance()
+	{
+		flush();
+	}
+
+	void flush()
+	{
+		if (mPending != 0)
+		{
+			gUsage.fetch_add(mPending, std::memory_order_relaxed);
+			mPending = 0;
+		}
+	}
+
+	void add(int64_t aDelta)
+	{
+		mPending += aDelta;
+		if ((mPending >= MemoryGovernor::FLUSH_THRESHOLD) || (mPending <= -MemoryGovernor::FLUSH_THRESHOLD))
+		{
+			flush();
+		}
+	}
+};
+
+
+
+ThreadBalance & threadBalance()
+{
+	thread_local ThreadBalance balance;
+	return balance;
+}
+
+}  // anonymous namespace
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MemoryGovernor::Account:
+
+void MemoryGovernor::Account::release()
+{
+	if (mCharged > 0)
+	{
+		MemoryGovernor::release(mCharged);
+		mCharged = 0;
+	}
+}
+
+
+
+
+
+bool MemoryGovernor::Account::appendGrowing(std::string & aBuffer, const char * aData, size_t aSize)
+{
+	if (gWatermark.load(std::memory_order_relaxed) == 0)
+	{
+		aBuffer.append(aData, aSize);
+		return true;
+	}
+
+	// Check the watermark against the minimum growth, then charge whatever the string has actually allocated:
+	auto oldCapacity = aBuffer.capacity();
+	auto needed = aBuffer.size() + aSize;
+	if (!charge(needed - oldCapacity))
+	{
+		return false;
+	}
+	aBuffer.append(aData, aSize);
+	auto newCapacity = aBuffer.capacity();
+	if (newCapacity > needed)
+	{
+		threadBalance().add(static_cast<int64_t>(newCapacity - needed));
+	}
+	mCharged += newCapacity - oldCapacity;
+	return true;
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MemoryGovernor:
+
+void MemoryGovernor::setWatermark(size_t aBytes)
+{
+	gWatermark.store(aBytes, std::memory_order_relaxed);
+}
+
+
+
+
+
+size_t MemoryGovernor::watermark()
+{
+	return gWatermark.load(std::memory_order_relaxed);
+}
+
+
+
+
+
+bool MemoryGovernor::charge(size_t aBytes)
+{
+	auto limit = gWatermark.load(std::memory_order_relaxed);
+	auto & balance = threadBalance();
+	if (limit != 0)
+	{
+		auto total = gUsage.load(std::memory_order_relaxed) + balance.mPending + static_cast<int64_t>(aBytes);
+		if (total > static_cast<int64_t>(limit))
+		{
+			gRefusals.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+	}
+	balance.add(static_cast<int64_t>(aBytes));
+	return true;
+}
+
+
+
+
+
+void MemoryGovernor::release(size_t aBytes)
+{
+	threadBalance().add(-static_cast<int64_t>(aBytes));
+}
+
+
+
+
+
+void MemoryGovernor::flushThread()
+{
+	threadBalance().flush();
+}
+
+
+
+
+
+size_t MemoryGovernor::usage()
+{
+	auto res = gUsage.load(std::memory_order_relaxed);
+	return (res > 0) ? static_cast<size_t>(res) : 0;
+}
+
+
+
+
+
+uint64_t MemoryGovernor::refusals()
+{
+	return gRefusals.load(std::memory_order_relaxed);
+}
+
+
+
+
+
+}  // namespace Http
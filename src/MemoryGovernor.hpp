@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+
+
+
+
+namespace Http {
+
+
+
+
+
+/** Process-wide accounting of the memory buffered by the parsers, with load shedding.
+The parsers (MessageParser, EnvelopeParser, MultipartParser and FormParser) charge the growth of their internal
+buffers through their Account. Once the total crosses the watermark set by setWatermark(), any further growth
+is refused and the parser fails (MessageParser through onError(), the others by becoming invalid), so that a
+traffic spike degrades into rejected requests instead of exhausting the memory of the process.
+The accounting is disabled (and costs nothing but a capacity check) until a watermark is set.
+Each thread accumulates its charges in a thread-local counter, which is added to the shared total only once it
+reaches FLUSH_THRESHOLD, so the charges don't contend on a shared cache line. As a consequence, the total may
+exceed the watermark by up to FLUSH_THRESHOLD per thread. */
+class MemoryGovernor
+{
+public:
+
+	/** The amount of charges (or releases) accumulated by a thread before they are added to the shared total. */
+	static const int64_t FLUSH_THRESHOLD = 64 * 1024;
+
+
+	/** The memory charged by a single parser; released when the account is destroyed.
+	Copying an account yields an empty account, the copy charges its buffers as they grow. */
+	class Account
+	{
+	public:
+
+		Account(): mCharged(0) {}
+		Account(const Account &): mCharged(0) {}
+		Account & operator = (const Account &) { return *this; }
+		~Account() { release(); }
+
+		/** Appends the data to the buffer, charging the growth of its capacity, if any.
+		Returns false, leaving the buffer unchanged, if the growth is refused because the watermark has been crossed. */
+		bool append(std::string & aBuffer, const char * aData, size_t aSize)
+		{
+			if (aBuffer.size() + aSize <= aBuffer.capacity())
+			{
+				aBuffer.append(aData, aSize);
+				return true;
+			}
+			return appendGrowing(aBuffer, aData, aSize);
+		}
+
+		/** Releases everything charged to the account. */
+		void release();
+
+		/** Returns the amount of memory charged to the account. */
+		size_t charged() const { return mCharged; }
+
+
+	protected:
+
+		/** The amount of memory charged to the account. */
+		size_t mCharged;
+
+
+		/** Implements append() for the case when the buffer needs to grow. */
+		bool appendGrowing(std::string & aBuffer, const char * aData, size_t aSize);
+	};
+
+
+	/** Sets the watermark, in bytes, above which any buffer growth is refused. 0 disables the accounting. */
+	static void setWatermark(size_t aBytes);
+
+	/** Returns the watermark; 0 if the accounting is disabled. */
+	static size_t watermark();
+
+	/** Charges the specified amount to the current thread.
+	Returns false, without charging, if the watermark would be crossed. Always succeeds when disabled. */
+	static bool charge(size_t aBytes);
+
+	/** Releases the specified amount, previously charged by charge(), possibly on another thread. */
+	static void release(size_t aBytes);
+
+	/** Adds the current thread's accumulated charges to the shared total. */
+	static void flushThread();
+
+	/** Returns the total memory charged, as of the last flushes of the threads. */
+	static size_t usage();
+
+	/** Returns the number of times a charge has been refused since the process start. */
+	static uint64_t refusals();
+};
+
+
+
+
+
+}  // namespace Http
@@ -1,5 +1,8 @@
 #include "Message.hpp"
+#include <algorithm>
+#include <atomic>
 #include <cstring>
+#include "DateCache.hpp"
 
 
 
@@ -11,11 +14,360 @@ namespace Http {
 
 
 
+////////////////////////////////////////////////////////////////////////////////
+// Serialization helpers:
+
+namespace {
+
+/** A standard status code with its reason phrase and the pre-rendered status line. */
+struct StandardStatus
+{
+	int mCode;
+	std::string_view mReason;
+	std::string_view mLine;
+};
+
+#define STANDARD_STATUS(Code, Reason) { Code, Reason, "HTTP/1.1 " #Code " " Reason "\r\n" }
+
+/** The standard status codes, sorted by the code. */
+constexpr StandardStatus gStandardStatuses[] =
+{
+	STANDARD_STATUS(100, "Continue"),
+	STANDARD_STATUS(101, "Switching Protocols"),
+	STANDARD_STATUS(103, "Early Hints"),
+	STANDARD_STATUS(200, "OK"),
+	STANDARD_STATUS(201, "Created"),
+	STANDARD_STATUS(202, "Accepted"),
+	STANDARD_STATUS(203, "Non-Authoritative Information"),
+	STANDARD_STATUS(204, "No Content"),
+	STANDARD_STATUS(205, "Reset Content"),
+	STANDARD_STATUS(206, "Partial Content"),
+	STANDARD_STATUS(300, "Multiple Choices"),
+	STANDARD_STATUS(301, "Moved Permanently"),
+	STANDARD_STATUS(302, "Found"),
+	STANDARD_STATUS(303, "See Other"),
+	STANDARD_STATUS(304, "Not Modified"),
+	STANDARD_STATUS(305, "Use Proxy"),
+	STANDARD_STATUS(307, "Temporary Redirect"),
+	STANDARD_STATUS(308, "Permanent Redirect"),
+	STANDARD_STATUS(400, "Bad Request"),
+	STANDARD_STATUS(401, "Unauthorized"),
+	STANDARD_STATUS(402, "Payment Required"),
+	STANDARD_STATUS(403, "Forbidden"),
+	STANDARD_STATUS(404, "Not Found"),
+	STANDARD_STATUS(405, "Method Not Allowed"),
+	STANDARD_STATUS(406, "Not Acceptable"),
+	STANDARD_STATUS(407, "Proxy Authentication Required"),
+	STANDARD_STATUS(408, "Request Timeout"),
+	STANDARD_STATUS(409, "Conflict"),
+	STANDARD_STATUS(410, "Gone"),
+	STANDARD_STATUS(411, "Length Required"),
+	STANDARD_STATUS(412, "Precondition Failed"),
+	STANDARD_STATUS(413, "Payload Too Large"),
+	STANDARD_STATUS(414, "URI Too Long"),
+	STANDARD_STATUS(415, "Unsupported Media Type"),
+	STANDARD_STATUS(416, "Range Not Satisfiable"),
+	STANDARD_STATUS(417, "Expectation Failed"),
+	STANDARD_STATUS(421, "Misdirected Request"),
+	STANDARD_STATUS(422, "Unprocessable Entity"),
+	STANDARD_STATUS(425, "Too Early"),
+	STANDARD_STATUS(426, "Upgrade Required"),
+	STANDARD_STATUS(428, "Precondition Required"),
+	STANDARD_STATUS(429, "Too Many Requests"),
+	STANDARD_STATUS(431, "Request Header Fields Too Large"),
+	STANDARD_STATUS(451, "Unavailable For Legal Reasons"),
+	STANDARD_STATUS(500, "Internal Server Error"),
+	STANDARD_STATUS(501, "Not Implemented"),
+	STANDARD_STATUS(502, "Bad Gateway"),
+	STANDARD_STATUS(503, "Service Unavailable"),
+	STANDARD_STATUS(504, "Gateway Timeout"),
+	STANDARD_STATUS(505, "HTTP Version Not Supported"),
+	STANDARD_STATUS(511, "Network Authentication Required"),
+};
+
+#undef STANDARD_STATUS
+
+
+
+
+
+/** Returns the standard status entry for the code, or nullptr if not a standard code. */
+const StandardStatus * findStandardStatus(int aStatusCode)
+{
+	auto itr = std::lower_bound(std::begin(gStandardStatuses), std::end(gStandardStatuses), aStatusCode,
+		[](const StandardStatus & aStatus, int aCode)
+		{
+			return aStatus.mCode < aCode;
+		}
+	);
+	if ((itr == std::end(gStandardStatuses)) || (itr->mCode != aStatusCode))
+	{
+		return nullptr;
+	}
+	return itr;
+}
+
+
+
+
+
+/** Copies the string into aDest, returns the pointer past the copied data. */
+inline char * put(char * aDest, std::string_view aString)
+{
+	memcpy(aDest, aString.data(), aString.size());
+	return aDest + aString.size();
+}
+
+
+
+
+
+/** The status line of a response, either pre-rendered or assembled from its parts.
+The size is known before writing it, so that the whole response can be allocated at once. */
+class StatusLine
+{
+public:
+
+	StatusLine(int aStatusCode, std::string_view aStatusText):
+		mText(aStatusText),
+		mCodeLength(0)
+	{
+		auto standard = findStandardStatus(aStatusCode);
+		if ((standard != nullptr) && (standard->mReason == aStatusText))
+		{
+			mPrerendered = standard->mLine;
+			return;
+		}
+		if (aStatusCode < 0)
+		{
+			// Not valid for HTTP anyway, but keep the printf behavior
+			mCode[mCodeLength++] = '-';
+			mCodeLength += Utils::formatNumber(mCode + 1, 0ULL - static_cast<unsigned long long>(aStatusCode));
+		}
+		else
+		{
+			mCodeLength = Utils::formatNumber(mCode, static_cast<unsigned long long>(aStatusCode));
+		}
+	}
+
+	size_t size() const
+	{
+		if (!mPrerendered.empty())
+		{
+			return mPrerendered.size();
+		}
+		return 9 + mCodeLength + 1 + mText.size() + 2;  // "HTTP/1.1 " + code + " " + text + "\r\n"
+	}
+
+	char * write(char * aDest) const
+	{
+		if (!mPrerendered.empty())
+		{
+			return put(aDest, mPrerendered);
+		}
+		aDest = put(aDest, "HTTP/1.1 ");
+		aDest = put(aDest, std::string_view(mCode, mCodeLength));
+		*aDest++ = ' ';
+		aDest = put(aDest, mText);
+		return put(aDest, "\r\n");
+	}
+
+protected:
+
+	std::string_view mPrerendered;
+	std::string_view mText;
+	char mCode[Utils::MAX_NUMBER_CHARS + 1];
+	size_t mCodeLength;
+};
+
+
+
+
+
+/** The request line of a request, assembled from its parts. */
+class RequestLine
+{
+public:
+
+	RequestLine(std::string_view aMethod, std::string_view aUrl):
+		mMethod(aMethod),
+		mUrl(aUrl)
+	{
+	}
+
+	size_t size() const
+	{
+		return mMethod.size() + 1 + mUrl.size() + 11;  // method + " " + url + " HTTP/1.1\r\n"
+	}
+
+	char * write(char * aDest) const
+	{
+		aDest = put(aDest, mMethod);
+		*aDest++ = ' ';
+		aDest = put(aDest, mUrl);
+		return put(aDest, " HTTP/1.1\r\n");
+	}
+
+protected:
+
+	std::string_view mMethod;
+	std::string_view mUrl;
+};
+
+
+
+
+
+/** Set to true if SimpleOutgoingResponse should add the Date header automatically. */
+std::atomic<bool> gSimpleAddDate(false);
+
+
+
+
+
+/** The value for the Date header that the serializer adds automatically, if any. */
+class AutoDate
+{
+public:
+
+	/** Fetches the current date if aShouldAdd is true, otherwise keeps the value empty. */
+	explicit AutoDate(bool aShouldAdd):
+		mSize(0)
+	{
+		if (aShouldAdd)
+		{
+			DateCache::current(mValue);
+			mSize = sizeof(mValue);
+		}
+	}
+
+	/** Returns the size of the header line, or 0 if the header is not to be added. */
+	size_t lineSize() const { return (mSize == 0) ? 0 : (6 + mSize + 2); }  // "Date: " + value + "\r\n"
+
+	/** Writes the header line, if the header is to be added. Returns the pointer past the written data. */
+	char * writeLine(char * aDest) const
+	{
+		if (mSize == 0)
+		{
+			return aDest;
+		}
+		aDest = put(aDest, "Date: ");
+		aDest = put(aDest, std::string_view(mValue, mSize));
+		return put(aDest, "\r\n");
+	}
+
+protected:
+
+	char mValue[Utils::HTTP_DATE_LENGTH];
+	size_t mSize;
+};
+
+
+
+
+
+/** Returns true if the range of key / value pairs contains the Date header. */
+template <typename Headers>
+bool hasDateHeader(const Headers & aHeaders)
+{
+	for (const auto & hdr: aHeaders)
+	{
+		if (Utils::noCaseEqual(hdr.first, "date"))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+
+
+
+
+/** Returns the size of the serialized message head - the status or request line, the headers and the empty line.
+aFirstLine is a StatusLine or a RequestLine, aHeaders is any range of key / value pairs. */
+template <typename FirstLine, typename Headers>
+size_t headSize(const FirstLine & aFirstLine, const Headers & aHeaders, const AutoDate & aDate)
+{
+	size_t res = aFirstLine.size() + aDate.lineSize() + 2;
+	for (const auto & hdr: aHeaders)
+	{
+		res += hdr.first.size() + 2 + hdr.second.size() + 2;
+	}
+	return res;
+}
+
+
+
+
+
+/** Writes the message head - the status or request line, the headers and the empty line - into aDest, which must
+be at least headSize() long. Returns the pointer past the written data. */
+template <typename FirstLine, typename Headers>
+char * writeHead(char * aDest, const FirstLine & aFirstLine, const Headers & aHeaders, const AutoDate & aDate)
+{
+	aDest = aFirstLine.write(aDest);
+	for (const auto & hdr: aHeaders)
+	{
+		aDest = put(aDest, hdr.first);
+		aDest = put(aDest, ": ");
+		aDest = put(aDest, hdr.second);
+		aDest = put(aDest, "\r\n");
+	}
+	aDest = aDate.writeLine(aDest);
+	return put(aDest, "\r\n");
+}
+
+
+
+
+
+/** Writes the message head into the caller-provided buffer, if it fits.
+Returns the size of the head, regardless of whether it was written or not. */
+template <typename FirstLine, typename Headers>
+size_t writeHeadIfFits(
+	char * aBuffer, size_t aBufferSize,
+	const FirstLine & aFirstLine, const Headers & aHeaders, const AutoDate & aDate
+)
+{
+	auto size = headSize(aFirstLine, aHeaders, aDate);
+	if (size <= aBufferSize)
+	{
+		writeHead(aBuffer, aFirstLine, aHeaders, aDate);
+	}
+	return size;
+}
+
+
+
+
+
+/** Fills the gather list with the head in the buffer and the body, if the head has fit in the buffer. */
+void fillIoVecs(IoVec (& aIoVecs)[2], char * aBuffer, size_t aHeadSize, size_t aBufferSize, const char * aBody, size_t aBodySize)
+{
+	if (aHeadSize > aBufferSize)
+	{
+		return;
+	}
+	aIoVecs[0].iov_base = aBuffer;
+	aIoVecs[0].iov_len = aHeadSize;
+	aIoVecs[1].iov_base = const_cast<char *>(aBody);
+	aIoVecs[1].iov_len = aBodySize;
+}
+
+}  // anonymous namespace
+
+
+
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // Message:
 
 Message::Message(Kind aKind) :
 	mKind(aKind),
+	mIsLazy(false),
+	mNumIndexed(0),
 	mContentLength(std::string::npos)
 {
 }
@@ -26,11 +378,17 @@ Message::Message(Kind aKind) :
 
 void Message::addHeader(const std::string & aKey, const std::string & aValue)
 {
-	auto Key = Utils::strToLower(aKey);
+	if (recordRawHeader(aKey, aValue))
+	{
+		return;
+	}
+	mLowerKey.assign(aKey);
+	Utils::asciiLowerInPlace(mLowerKey);
+	const auto & Key = mLowerKey;
 	auto itr = mHeaders.find(Key);
 	if (itr == mHeaders.end())
 	{
-		mHeaders[Key] = aValue;
+		mSpareNodes.insert(mHeaders, Key, aValue);
 	}
 	else
 	{
@@ -57,8 +415,114 @@ void Message::addHeader(const std::string & aKey, const std::string & aValue)
 
 
 
+void Message::removeHeader(const std::string & aKey)
+{
+	ensureIndexed();
+	auto key = Utils::strToLower(aKey);
+	auto itr = mHeaders.find(key);
+	if (itr != mHeaders.end())
+	{
+		mSpareNodes.reclaim(mHeaders, itr);
+	}
+	if (key == "content-type")
+	{
+		mContentType.clear();
+	}
+	else if (key == "content-length")
+	{
+		mContentLength = std::string::npos;
+	}
+}
+
+
+
+
+
+size_t Message::retainedMemory() const
+{
+	size_t res = mRawHeaders.capacity() + mRawIndex.capacity() * sizeof(RawHeader) + mLowerKey.capacity() + mContentType.capacity();
+	for (const auto & hdr: mHeaders)
+	{
+		res += MapNodePool<NameValueMap>::nodeOverhead() + hdr.first.capacity() + hdr.second.capacity();
+	}
+	return res + mSpareNodes.retainedMemory();
+}
+
+
+
+
+
+void Message::setLazyHeaders(bool aIsLazy)
+{
+	if (!aIsLazy)
+	{
+		ensureIndexed();
+	}
+	mIsLazy = aIsLazy;
+}
+
+
+
+
+
+std::string_view Message::rawHeaderKey(size_t aIndex) const
+{
+	const auto & hdr = mRawIndex[aIndex];
+	return std::string_view(mRawHeaders.data() + hdr.mKeyOffset, hdr.mKeyLength);
+}
+
+
+
+
+
+std::string_view Message::rawHeaderValue(size_t aIndex) const
+{
+	const auto & hdr = mRawIndex[aIndex];
+	return std::string_view(mRawHeaders.data() + hdr.mValueOffset, hdr.mValueLength);
+}
+
+
+
+
+
+bool Message::findHeader(std::string_view aKey, std::string_view & aValue) const
+{
+	// Until the map is first built, the raw headers are all there is; a single occurrence is the whole value:
+	if (mIsLazy && (mNumIndexed == 0) && mHeaders.empty())
+	{
+		size_t numFound = 0;
+		for (size_t i = 0, count = mRawIndex.size(); i < count; ++i)
+		{
+			if (Utils::noCaseEqual(rawHeaderKey(i), aKey))
+			{
+				aValue = rawHeaderValue(i);
+				numFound += 1;
+			}
+		}
+		if (numFound < 2)
+		{
+			return (numFound == 1);
+		}
+	}
+
+	// Repeated headers are combined by the map, which also reflects the modifications:
+	ensureIndexed();
+	auto itr = mHeaders.find(Utils::strToLower(aKey));
+	if (itr == mHeaders.end())
+	{
+		return false;
+	}
+	aValue = itr->second;
+	return true;
+}
+
+
+
+
+
 std::string Message::headerToValue(const std::string & aKey, const std::string & aDefault) const
 {
+	ensureIndexed();
 	auto itr = mHeaders.find(Utils::strToLower(aKey));
 	if (itr == mHeaders.cend())
 	{
@@ -71,8 +535,29 @@ std::string Message::headerToValue(const std::string & aKey, const std::string &
 
 
 
+std::string_view Message::reasonPhrase(int aStatusCode)
+{
+	auto standard = findStandardStatus(aStatusCode);
+	return (standard == nullptr) ? std::string_view() : standard->mReason;
+}
+
+
+
+
+
+std::string_view Message::statusLine(int aStatusCode)
+{
+	auto standard = findStandardStatus(aStatusCode);
+	return (standard == nullptr) ? std::string_view() : standard->mLine;
+}
+
+
+
+
+
 void Message::setContentType(const std::string & aContentType)
 {
+	ensureIndexed();
 	mHeaders["content-type"] = aContentType;
 	mContentType = aContentType;
 }
@@ -83,7 +568,9 @@ void Message::setContentType(const std::string & aContentType)
 
 void Message::setContentLength(size_t aContentLength)
 {
-	mHeaders["content-length"] = Utils::printf("%llu", (static_cast<unsigned long long>(aContentLength)));
+	ensureIndexed();
+	char number[Utils::MAX_NUMBER_CHARS];
+	mHeaders["content-length"].assign(number, Utils::formatNumber(number, aContentLength));
 	mContentLength = aContentLength;
 }
 
@@ -91,11 +578,66 @@ void Message::setContentLength(size_t aContentLength)
 
 
 
+bool Message::recordRawHeader(const std::string & aKey, const std::string & aValue)
+{
+	if (!mIsLazy)
+	{
+		return false;
+	}
+	RawHeader hdr;
+	hdr.mKeyOffset = static_cast<uint32_t>(mRawHeaders.size());
+	hdr.mKeyLength = static_cast<uint32_t>(aKey.size());
+	hdr.mValueOffset = static_cast<uint32_t>(hdr.mKeyOffset + aKey.size());
+	hdr.mValueLength = static_cast<uint32_t>(aValue.size());
+	mRawHeaders.append(aKey);
+	mRawHeaders.append(aValue);
+	mRawIndex.push_back(hdr);
+	return true;
+}
+
+
+
+
+
+void Message::clearHeaders()
+{
+	mSpareNodes.reclaim(mHeaders);
+	mRawHeaders.clear();
+	mRawIndex.clear();
+	mNumIndexed = 0;
+	mContentType.clear();
+	mContentLength = std::string::npos;
+}
+
+
+
+
+
+void Message::indexRawHeaders() const
+{
+	// The processed headers are only a cache of the raw ones, building them doesn't change the observable
+	// state of the message, hence the const_cast:
+	auto self = const_cast<Message *>(this);
+	auto isLazy = mIsLazy;
+	self->mIsLazy = false;
+	for (auto i = mNumIndexed, count = mRawIndex.size(); i < count; ++i)
+	{
+		self->addHeader(std::string(rawHeaderKey(i)), std::string(rawHeaderValue(i)));
+	}
+	self->mNumIndexed = mRawIndex.size();
+	self->mIsLazy = isLazy;
+}
+
+
+
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // OutgoingResponse:
 
 OutgoingResponse::OutgoingResponse() :
-	Super(mkResponse)
+	Super(mkResponse),
+	mAddDate(false)
 {
 }
 
@@ -105,21 +647,93 @@ OutgoingResponse::OutgoingResponse() :
 
 std::string OutgoingResponse::serialize(int aStatusCode, const std::string & aStatusText) const
 {
-	// Status line:
-	auto res = Utils::printf("HTTP/1.1 %d %s\r\n",
-		aStatusCode, aStatusText.c_str()
-	);
+	StatusLine statusLine(aStatusCode, aStatusText);
+	ensureIndexed();
+	AutoDate date(mAddDate && (mHeaders.find("date") == mHeaders.end()));
+	std::string res(headSize(statusLine, mHeaders, date), '\0');
+	writeHead(&res[0], statusLine, mHeaders, date);
+	return res;
+}
+
 
-	// Headers:
+
+
+
+std::string OutgoingResponse::serialize(int aStatusCode) const
+{
+	StatusLine statusLine(aStatusCode, reasonPhrase(aStatusCode));
+	ensureIndexed();
+	AutoDate date(mAddDate && (mHeaders.find("date") == mHeaders.end()));
+	std::string res(headSize(statusLine, mHeaders, date), '\0');
+	writeHead(&res[0], statusLine, mHeaders, date);
+	return res;
+}
+
+
+
+
+
+size_t OutgoingResponse::serialize(int aStatusCode, const std::string & aStatusText, char * aBuffer, size_t aBufferSize) const
+{
+	ensureIndexed();
+	AutoDate date(mAddDate && (mHeaders.find("date") == mHeaders.end()));
+	return writeHeadIfFits(aBuffer, aBufferSize, StatusLine(aStatusCode, aStatusText), mHeaders, date);
+}
+
+
+
+
+
+std::string OutgoingResponse::serializeNotModified() const
+{
+	ensureIndexed();
+	auto hasETag = (mHeaders.find("etag") != mHeaders.end());
+	std::vector<std::pair<std::string_view, std::string_view>> headers;
+	headers.reserve(mHeaders.size());
 	for (const auto & hdr: mHeaders)
 	{
-		res.append(hdr.first);
-		res.append(": ");
-		res.append(hdr.second);
-		res.append("\r\n");
-	}  // for itr - mHeaders[]
-	res.append("\r\n");
+		if (
+			((hdr.first.compare(0, 8, "content-") == 0) && (hdr.first != "content-location")) ||
+			(hdr.first == "transfer-encoding") ||
+			(hasETag && (hdr.first == "last-modified"))
+		)
+		{
+			continue;
+		}
+		headers.emplace_back(hdr.first, hdr.second);
+	}
+	StatusLine statusLine(304, reasonPhrase(304));
+	AutoDate date(mAddDate && (mHeaders.find("date") == mHeaders.end()));
+	std::string res(headSize(statusLine, headers, date), '\0');
+	writeHead(&res[0], statusLine, headers, date);
+	return res;
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// OutgoingRequest:
+
+OutgoingRequest::OutgoingRequest(const std::string & aMethod, const std::string & aUrl):
+	Super(mkRequest),
+	mMethod(aMethod),
+	mUrl(aUrl)
+{
+}
+
 
+
+
+
+std::string OutgoingRequest::serialize() const
+{
+	RequestLine requestLine(mMethod, mUrl);
+	ensureIndexed();
+	AutoDate date(false);
+	std::string res(headSize(requestLine, mHeaders, date), '\0');
+	writeHead(&res[0], requestLine, mHeaders, date);
 	return res;
 }
 
@@ -127,21 +741,46 @@ std::string OutgoingResponse::serialize(int aStatusCode, const std::string & aSt
 
 
 
+size_t OutgoingRequest::serialize(char * aBuffer, size_t aBufferSize) const
+{
+	ensureIndexed();
+	return writeHeadIfFits(aBuffer, aBufferSize, RequestLine(mMethod, mUrl), mHeaders, AutoDate(false));
+}
+
+
+
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // SimpleOutgoingResponse:
 
+void SimpleOutgoingResponse::setAddDate(bool aAddDate)
+{
+	gSimpleAddDate.store(aAddDate, std::memory_order_relaxed);
+}
+
+
+
+
+
+
 std::string SimpleOutgoingResponse::serialize(
 	int aStatusCode,
 	const std::string & aStatusText,
 	const std::string & aBody
 )
 {
-	return serialize(
-		aStatusCode,
-		aStatusText,
-		{ {"Content-Length", Utils::printf("%llu", aBody.size())} },
-		aBody
-	);
+	char contentLength[Utils::MAX_NUMBER_CHARS];
+	std::pair<std::string_view, std::string_view> headers[] =
+	{
+		{ "Content-Length", { contentLength, Utils::formatNumber(contentLength, aBody.size()) } },
+	};
+	StatusLine statusLine(aStatusCode, aStatusText);
+	AutoDate date(gSimpleAddDate.load(std::memory_order_relaxed));
+	auto size = headSize(statusLine, headers, date);
+	std::string res(size + aBody.size(), '\0');
+	put(writeHead(&res[0], statusLine, headers, date), aBody);
+	return res;
 }
 
 
@@ -155,17 +794,18 @@ std::string SimpleOutgoingResponse::serialize(
 	const std::string & aBody
 )
 {
-	std::map<std::string, std::string> headers =
+	char contentLength[Utils::MAX_NUMBER_CHARS];
+	std::pair<std::string_view, std::string_view> headers[] =
 	{
+		{ "Content-Length", { contentLength, Utils::formatNumber(contentLength, aBody.size()) } },
 		{ "Content-Type", aContentType },
-		{ "Content-Length", Utils::printf("%llu", aBody.size()) },
 	};
-	return serialize(
-		aStatusCode,
-		aStatusText,
-		headers,
-		aBody
-	);
+	StatusLine statusLine(aStatusCode, aStatusText);
+	AutoDate date(gSimpleAddDate.load(std::memory_order_relaxed));
+	auto size = headSize(statusLine, headers, date);
+	std::string res(size + aBody.size(), '\0');
+	put(writeHead(&res[0], statusLine, headers, date), aBody);
+	return res;
 }
 
 
@@ -179,13 +819,11 @@ std::string SimpleOutgoingResponse::serialize(
 	const std::string & aBody
 )
 {
-	std::string res = Utils::printf("HTTP/1.1 %d %s\r\n", aStatusCode, aStatusText.c_str());
-	for (const auto & hdr: aHeaders)
-	{
-		res.append(Utils::printf("%s: %s\r\n", hdr.first.c_str(), hdr.second.c_str()));
-	}
-	res.append("\r\n");
-	res.append(aBody);
+	StatusLine statusLine(aStatusCode, aStatusText);
+	AutoDate date(gSimpleAddDate.load(std::memory_order_relaxed) && !hasDateHeader(aHeaders));
+	auto size = headSize(statusLine, aHeaders, date);
+	std::string res(size + aBody.size(), '\0');
+	put(writeHead(&res[0], statusLine, aHeaders, date), aBody);
 	return res;
 }
 
@@ -193,31 +831,375 @@ std::string SimpleOutgoingResponse::serialize(
 
 
 
+size_t SimpleOutgoingResponse::serialize(
+	int aStatusCode,
+	const std::string & aStatusText,
+	const std::string & aContentType,
+	const char * aBody,
+	size_t aBodySize,
+	char * aBuffer,
+	size_t aBufferSize,
+	IoVec (& aIoVecs)[2]
+)
+{
+	auto size = serializeHead(aStatusCode, aStatusText, aContentType, aBodySize, aBuffer, aBufferSize);
+	fillIoVecs(aIoVecs, aBuffer, size, aBufferSize, aBody, aBodySize);
+	return size;
+}
+
+
+
+
+
+size_t SimpleOutgoingResponse::serialize(
+	int aStatusCode,
+	const std::string & aStatusText,
+	const std::map<std::string, std::string> & aHeaders,
+	const char * aBody,
+	size_t aBodySize,
+	char * aBuffer,
+	size_t aBufferSize,
+	IoVec (& aIoVecs)[2]
+)
+{
+	AutoDate date(gSimpleAddDate.load(std::memory_order_relaxed) && !hasDateHeader(aHeaders));
+	auto size = writeHeadIfFits(aBuffer, aBufferSize, StatusLine(aStatusCode, aStatusText), aHeaders, date);
+	fillIoVecs(aIoVecs, aBuffer, size, aBufferSize, aBody, aBodySize);
+	return size;
+}
+
+
+
+
+
+size_t SimpleOutgoingResponse::serializeHead(
+	int aStatusCode,
+	const std::string & aStatusText,
+	const std::string & aContentType,
+	unsigned long long aContentLength,
+	char * aBuffer,
+	size_t aBufferSize
+)
+{
+	char contentLength[Utils::MAX_NUMBER_CHARS];
+	std::pair<std::string_view, std::string_view> headers[] =
+	{
+		{ "Content-Length", { contentLength, Utils::formatNumber(contentLength, aContentLength) } },
+		{ "Content-Type", aContentType },
+	};
+	AutoDate date(gSimpleAddDate.load(std::memory_order_relaxed));
+	return writeHeadIfFits(aBuffer, aBufferSize, StatusLine(aStatusCode, aStatusText), headers, date);
+}
+
+
+
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // IncomingRequest:
 
-IncomingRequest::IncomingRequest(const std::string & aMethod, const std::string & aURL):
+IncomingRequest::IncomingRequest(const std::string & aMethod, const std::string & aURL, const std::string & aVersion):
 	Super(mkRequest),
 	mMethod(aMethod),
 	mURL(aURL),
-	mHasAuth(false)
+	mVersion(aVersion),
+	mHasAuth(false),
+	mAllowKeepAlive(Utils::isPersistentHttpVersion(aVersion)),
+	mHasConnectionClose(false),
+	mIsUpgradeRequested(false),
+	mIsBodyUnbounded(false),
+	mIsUrlSplit(false),
+	mUrlPathEnd(0),
+	mUrlQueryEnd(0),
+	mHasUrlPath(false),
+	mArePathSegmentsParsed(false),
+	mAreQueryParamsParsed(false)
+{
+}
+
+
+
+
+
+void IncomingRequest::reset(std::string_view aMethod, std::string_view aURL, std::string_view aVersion)
+{
+	clearHeaders();
+	mMethod.assign(aMethod);
+	mURL.assign(aURL);
+	mVersion.assign(aVersion);
+	mHasAuth = false;
+	mAuthUsername.clear();
+	mAuthPassword.clear();
+	mAllowKeepAlive = Utils::isPersistentHttpVersion(aVersion);
+	mHasConnectionClose = false;
+	mIsUpgradeRequested = false;
+	mIsBodyUnbounded = false;
+	mUserData.reset();
+	mIsUrlSplit = false;
+	mUrlPathEnd = 0;
+	mUrlQueryEnd = 0;
+	mUrlPath.clear();
+	mHasUrlPath = false;
+	mUrlDecoded.clear();
+	mPathSegments.clear();
+	mArePathSegmentsParsed = false;
+	mQueryParams.clear();
+	mAreQueryParamsParsed = false;
+}
+
+
+
+
+
+size_t IncomingRequest::retainedMemory() const
+{
+	return
+		sizeof(*this) + Super::retainedMemory() +
+		mMethod.capacity() + mURL.capacity() + mVersion.capacity() + mAuthUsername.capacity() + mAuthPassword.capacity() +
+		mUrlPath.capacity() + mUrlDecoded.capacity() +
+		mPathSegments.capacity() * sizeof(UrlSpan) + mQueryParams.capacity() * sizeof(QueryParam);
+}
+
+
+
+
+
+const std::string & IncomingRequest::urlPath() const
 {
+	if (!mHasUrlPath)
+	{
+		mUrlPath.assign(urlPathView());
+		mHasUrlPath = true;
+	}
+	return mUrlPath;
 }
 
 
 
 
 
-std::string IncomingRequest::urlPath() const
+std::string_view IncomingRequest::urlPathView() const
 {
+	splitUrl();
+	return std::string_view(mURL.data(), mUrlPathEnd);
+}
+
+
+
+
+
+std::string_view IncomingRequest::urlQuery() const
+{
+	splitUrl();
+	if (mUrlPathEnd == mUrlQueryEnd)
+	{
+		return std::string_view();
+	}
+	return std::string_view(mURL.data() + mUrlPathEnd + 1, mUrlQueryEnd - mUrlPathEnd - 1);
+}
+
+
+
+
+
+std::string_view IncomingRequest::urlFragment() const
+{
+	splitUrl();
+	if (mUrlQueryEnd == mURL.size())
+	{
+		return std::string_view();
+	}
+	return std::string_view(mURL.data() + mUrlQueryEnd + 1, mURL.size() - mUrlQueryEnd - 1);
+}
+
+
+
+
+
+size_t IncomingRequest::pathSegmentCount() const
+{
+	parsePathSegments();
+	return mPathSegments.size();
+}
+
+
+
+
+
+std::string_view IncomingRequest::pathSegment(size_t aIndex) const
+{
+	parsePathSegments();
+	return decodedView(mPathSegments[aIndex]);
+}
+
+
+
+
+
+size_t IncomingRequest::queryParamCount() const
+{
+	parseQueryParams();
+	return mQueryParams.size();
+}
+
+
+
+
+
+std::string_view IncomingRequest::queryParamName(size_t aIndex) const
+{
+	parseQueryParams();
+	return decodedView(mQueryParams[aIndex].mName);
+}
+
+
+
+
+
+std::string_view IncomingRequest::queryParamValue(size_t aIndex) const
+{
+	parseQueryParams();
+	return decodedView(mQueryParams[aIndex].mValue);
+}
+
+
+
+
+
+bool IncomingRequest::queryParam(std::string_view aName, std::string_view & aValue) const
+{
+	parseQueryParams();
+	for (const auto & param: mQueryParams)
+	{
+		if (decodedView(param.mName) == aName)
+		{
+			aValue = decodedView(param.mValue);
+			return true;
+		}
+	}
+	return false;
+}
+
+
+
+
+
+void IncomingRequest::splitUrl() const
+{
+	if (mIsUrlSplit)
+	{
+		return;
+	}
+	auto idxHash = mURL.find('#');
+	mUrlQueryEnd = (idxHash == std::string::npos) ? mURL.size() : idxHash;
 	auto idxQuestionMark = mURL.find('?');
-	if (idxQuestionMark == std::string::npos)
+	mUrlPathEnd = ((idxQuestionMark == std::string::npos) || (idxQuestionMark > mUrlQueryEnd)) ? mUrlQueryEnd : idxQuestionMark;
+	mIsUrlSplit = true;
+}
+
+
+
+
+
+IncomingRequest::UrlSpan IncomingRequest::appendDecoded(std::string_view aText, bool aIsPlusSpace) const
+{
+	// The decoded parts are never longer than the URL, so the buffer never reallocates once it has the URL's size.
+	// The views returned earlier by pathSegment() and queryParam() stay valid while the other index is built:
+	mUrlDecoded.reserve(mURL.size());
+	auto start = mUrlDecoded.size();
+	if (!Utils::urlDecodeAppend(aText, aIsPlusSpace, mUrlDecoded))
 	{
-		return mURL;
+		mUrlDecoded.resize(start);
+		mUrlDecoded.append(aText);
 	}
-	else
+	return { static_cast<uint32_t>(start), static_cast<uint32_t>(mUrlDecoded.size() - start) };
+}
+
+
+
+
+
+void IncomingRequest::parsePathSegments() const
+{
+	if (mArePathSegmentsParsed)
+	{
+		return;
+	}
+	mArePathSegmentsParsed = true;
+	auto path = urlPathView();
+	if (!path.empty() && (path[0] == '/'))
+	{
+		path.remove_prefix(1);
+	}
+	if (path.empty())
+	{
+		return;
+	}
+	for (;;)
 	{
-		return mURL.substr(0, idxQuestionMark);
+		auto idxSlash = path.find('/');
+		mPathSegments.push_back(appendDecoded(path.substr(0, idxSlash), false));
+		if (idxSlash == std::string_view::npos)
+		{
+			break;
+		}
+		path.remove_prefix(idxSlash + 1);
+	}
+}
+
+
+
+
+
+void IncomingRequest::parseQueryParams() const
+{
+	if (mAreQueryParamsParsed)
+	{
+		return;
+	}
+	mAreQueryParamsParsed = true;
+	auto query = urlQuery();
+	while (!query.empty())
+	{
+		auto idxAmp = query.find('&');
+		auto param = query.substr(0, idxAmp);
+		if (!param.empty())
+		{
+			auto idxEq = param.find('=');
+			auto name = appendDecoded(param.substr(0, idxEq), true);
+			auto value = (idxEq == std::string_view::npos) ? UrlSpan{0, 0} : appendDecoded(param.substr(idxEq + 1), true);
+			mQueryParams.push_back({name, value});
+		}
+		if (idxAmp == std::string_view::npos)
+		{
+			break;
+		}
+		query.remove_prefix(idxAmp + 1);
+	}
+}
+
+
+
+
+
+void IncomingRequest::processConnectionOptions(std::string_view aValue)
+{
+	std::string_view list(aValue), option;
+	while (Utils::nextListElement(list, option))
+	{
+		if (Utils::noCaseEqual(option, "close"))
+		{
+			mHasConnectionClose = true;
+			mAllowKeepAlive = false;
+		}
+		else if (Utils::noCaseEqual(option, "keep-alive"))
+		{
+			mAllowKeepAlive = !mHasConnectionClose;
+		}
+		else if (Utils::noCaseEqual(option, "upgrade"))
+		{
+			mIsUpgradeRequested = true;
+		}
 	}
 }
 
@@ -227,12 +1209,18 @@ std::string IncomingRequest::urlPath() const
 
 void IncomingRequest::addHeader(const std::string & aKey, const std::string & aValue)
 {
+	if (recordRawHeader(aKey, aValue))
+	{
+		return;
+	}
 	if (
-		(Utils::noCaseCompare(aKey, "Authorization") == 0) &&
+		Utils::noCaseEqual(aKey, "Authorization") &&
 		(strncmp(aValue.c_str(), "Basic ", 6) == 0)
 	)
 	{
-		std::string UserPass = Utils::base64Decode(aValue.substr(6));
+		std::string UserPass;
+		UserPass.resize(Utils::base64DecodedMaxSize(aValue.size() - 6));
+		UserPass.resize(Utils::base64Decode(aValue.data() + 6, aValue.size() - 6, &UserPass[0], UserPass.size()));
 		size_t idxCol = UserPass.find(':');
 		if (idxCol != std::string::npos)
 		{
@@ -241,9 +1229,19 @@ void IncomingRequest::addHeader(const std::string & aKey, const std::string & aV
 			mHasAuth = true;
 		}
 	}
-	if ((aKey == "Connection") && (Utils::noCaseCompare(aValue, "keep-alive") == 0))
+	if (Utils::noCaseEqual(aKey, "Connection"))
 	{
-		mAllowKeepAlive = true;
+		processConnectionOptions(aValue);
+	}
+	else if (Utils::noCaseEqual(aKey, "Transfer-Encoding"))
+	{
+		// Only a body whose final coding is chunked has a known end (RFC 7230 @ 3.3.3):
+		std::string_view list(aValue), coding, lastCoding;
+		while (Utils::nextListElement(list, coding))
+		{
+			lastCoding = coding;
+		}
+		mIsBodyUnbounded = !Utils::noCaseEqual(lastCoding, "chunked");
 	}
 	Super::addHeader(aKey, aValue);
 }
@@ -1,11 +1,19 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <map>
 #include <memory>
+#include <vector>
+#include <cstdint>
 #include "EnvelopeParser.hpp"
+#include "MapNodePool.hpp"
 #include "Utils.hpp"
 
+#ifndef _WIN32
+	#include <sys/uio.h>
+#endif
+
 
 
 
@@ -16,10 +24,30 @@ namespace Http {
 
 
 
+#ifdef _WIN32
+	/** A single entry of a gather list, mirroring the POSIX struct iovec. */
+	struct IoVec
+	{
+		void * iov_base;
+		size_t iov_len;
+	};
+#else
+	/** A single entry of a gather list, directly usable with writev(). */
+	typedef struct ::iovec IoVec;
+#endif
+
+
+
+
+
 /** Base for all HTTP messages.
 Provides storage and basic handling for headers.
 Note that the headers are stored / compared with their keys lowercased.
-Multiple header values are concatenated using commas (RFC 2616 @ 4.2) uppon addition. */
+Multiple header values are concatenated using commas (RFC 2616 @ 4.2) uppon addition.
+In the lazy mode (setLazyHeaders()), addHeader() only appends the raw header to a compact buffer; the map
+and all the derived values are built on the first access to any of them. A header that occurs only once can be
+queried without building the map using findHeader(). Note that the first access modifies the internal state,
+so a lazy message must not be accessed from multiple threads without synchronization. */
 class Message
 {
 public:
@@ -51,9 +79,32 @@ public:
 	Descendants may override to recognize and process other headers. */
 	virtual void addHeader(const std::string & aKey, const std::string & aValue);
 
+	/** Removes the header (case-insensitive) from the message, if present. */
+	void removeHeader(const std::string & aKey);
+
+	/** Sets whether the headers are processed lazily, on first access, rather than in addHeader().
+	Should be set before any headers are added. */
+	void setLazyHeaders(bool aIsLazy);
+
 	/** Returns all the headers within the message.
 	The header keys are in lowercase. */
-	const NameValueMap & headers() const { return mHeaders; }
+	const NameValueMap & headers() const { ensureIndexed(); return mHeaders; }
+
+	/** Returns the number of raw headers recorded in the lazy mode, one per addHeader() call. */
+	size_t rawHeaderCount() const { return mRawIndex.size(); }
+
+	/** Returns the key of the specified raw header, as it was added (not lowercased). Lazy mode only. */
+	std::string_view rawHeaderKey(size_t aIndex) const;
+
+	/** Returns the value of the specified raw header. Lazy mode only. */
+	std::string_view rawHeaderValue(size_t aIndex) const;
+
+	/** Looks up the header (case-insensitive) and returns its value, combined from all its occurrences, the same
+	in both modes and reflecting any later modifications. In the lazy mode, a header that occurs only once is
+	returned straight from the raw headers while the map hasn't been built yet; otherwise the map is built.
+	The returned view is valid until the message is modified.
+	Returns true if found, false if there's no such header. */
+	bool findHeader(std::string_view aKey, std::string_view & aValue) const;
 
 	/** If the specified header key is found (case-insensitive), returns the header's value.
 	Returns the default when header the key is not found. */
@@ -65,33 +116,73 @@ public:
 	template <typename T>
 	T headerToNumber(const std::string & aKey, T aDefault) const
 	{
-		auto v = headerToValue(aKey, std::string());
-		if (v.empty())
+		ensureIndexed();
+		auto itr = mHeaders.find(Utils::strToLower(aKey));
+		if ((itr == mHeaders.end()) || itr->second.empty())
 		{
 			return aDefault;
 		}
 		T out;
-		if (Utils::stringToInteger(v, out))
+		if (Utils::stringToInteger(itr->second, out))
 		{
 			return out;
 		}
 		return aDefault;
 	}
 
+	/** Returns the standard reason phrase for the specified status code ("Not Found" for 404).
+	Returns an empty view for codes that are not known. */
+	static std::string_view reasonPhrase(int aStatusCode);
+
+	/** Returns the pre-rendered "HTTP/1.1 <code> <reason>\r\n" status line for the specified status code.
+	Returns an empty view for codes that are not known. */
+	static std::string_view statusLine(int aStatusCode);
+
 	void setContentType  (const std::string & aContentType);
 	void setContentLength(size_t aContentLength);
 
-	const std::string & contentType  () const { return mContentType; }
-	size_t              contentLength() const { return mContentLength; }
+	const std::string & contentType  () const { ensureIndexed(); return mContentType; }
+	size_t              contentLength() const { ensureIndexed(); return mContentLength; }
+
+	/** Returns the approximate amount of memory held by the message, including the buffers kept for reuse. */
+	size_t retainedMemory() const;
 
 
 protected:
 
+	/** A header recorded in the lazy mode, as offsets into mRawHeaders. */
+	struct RawHeader
+	{
+		uint32_t mKeyOffset;
+		uint32_t mKeyLength;
+		uint32_t mValueOffset;
+		uint32_t mValueLength;
+	};
+
+
 	Kind mKind;
 
+	/** If true, addHeader() only records the raw headers, their processing is postponed until first access. */
+	bool mIsLazy;
+
+	/** The keys and values of the headers recorded in the lazy mode, stored back to back. */
+	std::string mRawHeaders;
+
+	/** The headers recorded in the lazy mode, in the order of addition. */
+	std::vector<RawHeader> mRawIndex;
+
+	/** The number of headers in mRawIndex that have already been processed by addHeader(). */
+	size_t mNumIndexed;
+
 	/** Map of headers, with their keys lowercased. */
 	NameValueMap mHeaders;
 
+	/** Map nodes removed from mHeaders, reused by addHeader() so that a recycled message doesn't allocate. */
+	MapNodePool<NameValueMap> mSpareNodes;
+
+	/** Scratch buffer for the lowercased header key in addHeader(). */
+	std::string mLowerKey;
+
 	/** Type of the content; parsed by addHeader(), set directly by setContentLength() */
 	std::string mContentType;
 
@@ -99,6 +190,27 @@ protected:
 	std::string::npos when the object is created.
 	Parsed by addHeader() or set directly by setContentLength() */
 	size_t mContentLength;
+
+
+	/** In the lazy mode, records the raw header and returns true, the caller should then skip processing it.
+	In the eager mode, returns false. To be called first thing by addHeader() and all its overrides. */
+	bool recordRawHeader(const std::string & aKey, const std::string & aValue);
+
+	/** Removes all headers, keeping the map nodes and buffers for reuse. Keeps the lazy mode setting.
+	To be used by the reset() methods of descendants. */
+	void clearHeaders();
+
+	/** Processes any raw headers that haven't been processed yet. */
+	void ensureIndexed() const
+	{
+		if (mNumIndexed != mRawIndex.size())
+		{
+			indexRawHeaders();
+		}
+	}
+
+	/** Processes the raw headers that haven't been processed yet, by replaying them through addHeader(). */
+	void indexRawHeaders() const;
 } ;
 
 
@@ -115,10 +227,72 @@ public:
 
 	OutgoingResponse();
 
+	/** Sets whether the serializers add the Date header with the current date (from DateCache) automatically.
+	A Date header added explicitly takes precedence. Off by default. */
+	void setAddDate(bool aAddDate) { mAddDate = aAddDate; }
+
 	/** Returns the beginning of a response datastream, containing the specified status code, text, and all
 	serialized headers.
 	The users should send this, then the actual body of the response. */
 	std::string serialize(int aStatusCode, const std::string & StatusText) const;
+
+	/** Returns the beginning of a response datastream, containing the specified status code with its
+	standard reason phrase, and all serialized headers. */
+	std::string serialize(int aStatusCode) const;
+
+	/** Serializes the beginning of a response datastream into the caller-provided buffer.
+	Returns the number of bytes the serialized data takes. If that is larger than aBufferSize, nothing is
+	written and the caller should retry with a large enough buffer (so passing a zero size queries the size). */
+	size_t serialize(int aStatusCode, const std::string & aStatusText, char * aBuffer, size_t aBufferSize) const;
+
+	/** Returns the complete 304 (Not Modified) response for a request whose conditions say the client's copy is
+	current (ConditionalRequest). Keeps the headers that a 304 is to carry (RFC 7232 @ 4.1), such as ETag,
+	Cache-Control or Set-Cookie, and leaves out the representation metadata (Content-Type, Content-Length,
+	Content-Encoding, and Last-Modified if there's an ETag), since the response has no body. */
+	std::string serializeNotModified() const;
+
+
+protected:
+
+	/** If true, the serializers add the Date header automatically. */
+	bool mAddDate;
+} ;
+
+
+
+
+
+/** Stores outgoing request headers and serializes them to an HTTP/1.1 data stream, for the client side.
+The response to the request can be parsed by a MessageParser switched by expectResponse(method()). */
+class OutgoingRequest:
+	public Message
+{
+	typedef Message Super;
+
+public:
+
+	OutgoingRequest(const std::string & aMethod, const std::string & aUrl);
+
+	const std::string & method() const { return mMethod; }
+	const std::string & url() const { return mUrl; }
+
+	/** Returns the beginning of a request datastream, containing the request line and all serialized headers.
+	The users should send this, then the actual body of the request, if any. HTTP/1.1 requires the Host header. */
+	std::string serialize() const;
+
+	/** Serializes the beginning of a request datastream into the caller-provided buffer.
+	Returns the number of bytes the serialized data takes. If that is larger than aBufferSize, nothing is
+	written and the caller should retry with a large enough buffer (so passing a zero size queries the size). */
+	size_t serialize(char * aBuffer, size_t aBufferSize) const;
+
+
+protected:
+
+	/** The method of the request. */
+	std::string mMethod;
+
+	/** The request target, as sent in the request line. */
+	std::string mUrl;
 } ;
 
 
@@ -131,6 +305,10 @@ class SimpleOutgoingResponse
 {
 public:
 
+	/** Sets whether the serializers add the Date header with the current date (from DateCache) automatically.
+	A Date header passed explicitly takes precedence. Process-wide setting, off by default. */
+	static void setAddDate(bool aAddDate);
+
 	/** Returns HTTP response data that represents the specified parameters.
 	This overload provides only the Content-Length header. */
 	static std::string serialize(
@@ -156,6 +334,54 @@ public:
 		const std::map<std::string, std::string> & aHeaders,
 		const std::string & aBody
 	);
+
+	/** Serializes the status line and headers of the response into the caller-provided buffer, without
+	copying the body. Fills aIoVecs with the head (in aBuffer) and the body (referenced in place), ready
+	to be sent using writev().
+	This overload provides only the Content-Type and Content-Length headers.
+	Returns the size of the head. If that is larger than aBufferSize, nothing is written and the caller
+	should retry with a large enough buffer (so passing a zero size queries the size). */
+	static size_t serialize(
+		int aStatusCode,
+		const std::string & aStatusText,
+		const std::string & aContentType,
+		const char * aBody,
+		size_t aBodySize,
+		char * aBuffer,
+		size_t aBufferSize,
+		IoVec (& aIoVecs)[2]
+	);
+
+	/** Serializes the status line and headers of the response into the caller-provided buffer, without
+	copying the body. Fills aIoVecs with the head (in aBuffer) and the body (referenced in place), ready
+	to be sent using writev().
+	The headers are used as given, the caller is responsible for providing the Content-Length.
+	Returns the size of the head. If that is larger than aBufferSize, nothing is written and the caller
+	should retry with a large enough buffer (so passing a zero size queries the size). */
+	static size_t serialize(
+		int aStatusCode,
+		const std::string & aStatusText,
+		const std::map<std::string, std::string> & aHeaders,
+		const char * aBody,
+		size_t aBodySize,
+		char * aBuffer,
+		size_t aBufferSize,
+		IoVec (& aIoVecs)[2]
+	);
+
+	/** Serializes only the status line and headers of the response into the caller-provided buffer, for
+	bodies that are sent separately, such as by sendfile().
+	This overload provides only the Content-Type and Content-Length headers.
+	Returns the size of the head. If that is larger than aBufferSize, nothing is written and the caller
+	should retry with a large enough buffer (so passing a zero size queries the size). */
+	static size_t serializeHead(
+		int aStatusCode,
+		const std::string & aStatusText,
+		const std::string & aContentType,
+		unsigned long long aContentLength,
+		char * aBuffer,
+		size_t aBufferSize
+	);
 };
 
 
@@ -181,8 +407,17 @@ public:
 	typedef std::shared_ptr<UserData> UserDataPtr;
 
 
-	/** Creates a new instance of the class, containing the method and URL provided by the client. */
-	IncomingRequest(const std::string & aMethod, const std::string & aURL);
+	/** Creates a new instance of the class, containing the method, URL and protocol version ("HTTP/1.1")
+	provided by the client in the request line. The version decides whether the connection is persistent by
+	default, so there's no default for it: an HTTP/1.0 client must not be kept alive unless it asks for it. */
+	IncomingRequest(const std::string & aMethod, const std::string & aURL, const std::string & aVersion);
+
+	/** Reinitializes the request for reuse with a new method, URL and version, as if newly constructed.
+	Keeps the buffers and header map nodes grown so far, as well as the lazy headers setting. */
+	void reset(std::string_view aMethod, std::string_view aURL, std::string_view aVersion);
+
+	/** Returns the approximate amount of memory held by the request, including the buffers kept for reuse. */
+	size_t retainedMemory() const;
 
 	/** Returns the method used in the request */
 	const std::string & method() const { return mMethod; }
@@ -190,19 +425,72 @@ public:
 	/** Returns the entire URL used in the request, including the parameters after '?'. */
 	const std::string & url() const { return mURL; }
 
-	/** Returns the path part of the URL (without the parameters after '?'). */
-	std::string urlPath() const;
+	/** Returns the protocol version of the request, such as "HTTP/1.1". */
+	const std::string & version() const { return mVersion; }
+
+	/** Returns the path part of the URL (without the parameters after '?' and the fragment after '#').
+	The value is computed on the first call and cached. */
+	const std::string & urlPath() const;
+
+	/** Returns the path part of the URL (without the parameters after '?' and the fragment after '#'),
+	as a view into url(). */
+	std::string_view urlPathView() const;
+
+	/** Returns the query part of the URL (between the '?' and the '#', excluding both), as a view into url().
+	Returns an empty view if there's no query. */
+	std::string_view urlQuery() const;
+
+	/** Returns the fragment part of the URL (after the '#'), as a view into url().
+	Returns an empty view if there's no fragment. */
+	std::string_view urlFragment() const;
+
+	/** Returns the number of segments in the URL path. The path is split on each '/', not counting the
+	leading one, so "/" has no segments and "/a/b/" has three segments ("a", "b" and ""). */
+	size_t pathSegmentCount() const;
+
+	/** Returns the specified URL path segment, percent-decoded ('+' is kept as-is).
+	A segment that fails to decode is returned verbatim. The view is valid for the lifetime of the request. */
+	std::string_view pathSegment(size_t aIndex) const;
+
+	/** Returns the number of parameters in the URL query. */
+	size_t queryParamCount() const;
+
+	/** Returns the name of the specified URL query parameter, URL-decoded.
+	The view is valid for the lifetime of the request. */
+	std::string_view queryParamName(size_t aIndex) const;
+
+	/** Returns the value of the specified URL query parameter, URL-decoded.
+	The view is valid for the lifetime of the request. */
+	std::string_view queryParamValue(size_t aIndex) const;
+
+	/** Looks up the first URL query parameter of the specified name (case-sensitive).
+	If found, stores its URL-decoded value into aValue and returns true. The view is valid for the lifetime
+	of the request. Unlike FormParser, the parameters are indexed only once and nothing is copied per lookup. */
+	bool queryParam(std::string_view aName, std::string_view & aValue) const;
 
 	/** Returns true if the request has had the Auth header present. */
-	bool hasAuth() const { return mHasAuth; }
+	bool hasAuth() const { ensureIndexed(); return mHasAuth; }
 
 	/** Returns the username that the request presented. Only valid if hasAuth() is true */
-	const std::string & authUsername() const { return mAuthUsername; }
+	const std::string & authUsername() const { ensureIndexed(); return mAuthUsername; }
 
 	/** Returns the password that the request presented. Only valid if hasAuth() is true */
-	const std::string & authPassword() const { return mAuthPassword; }
+	const std::string & authPassword() const { ensureIndexed(); return mAuthPassword; }
 
-	bool doesAllowKeepAlive() const { return mAllowKeepAlive; }
+	/** Returns true if the client wants the connection kept open after the response (RFC 7230 @ 6.3):
+	HTTP/1.1 connections are persistent unless the Connection header has the "close" option,
+	HTTP/1.0 connections only if the Connection header has the "keep-alive" option. */
+	bool doesAllowKeepAlive() const { ensureIndexed(); return mAllowKeepAlive; }
+
+	/** Returns true if the Connection header has the "upgrade" option, asking to switch protocols. */
+	bool isUpgradeRequested() const { ensureIndexed(); return mIsUpgradeRequested; }
+
+	/** Returns true if the server can read another request from the connection once this request's body has
+	been fully read and the response sent. False if the client doesn't allow keep-alive, or if the end of the
+	body can't be determined (a Transfer-Encoding other than chunked, RFC 7230 @ 3.3.3).
+	A server that switches protocols in response to isUpgradeRequested() doesn't use HTTP on the connection
+	any more, regardless of this value. */
+	bool canReuseConnection() const { ensureIndexed(); return mAllowKeepAlive && !mIsBodyUnbounded; }
 
 	/** Attaches any kind of data to this request, to be later retrieved by userData(). */
 	void setUserData(UserDataPtr aUserData) { mUserData = aUserData; }
@@ -211,7 +499,7 @@ public:
 	UserDataPtr userData() { return mUserData; }
 
 	/** Adds the specified header into the internal list of headers.
-	Overrides the parent to add recognizing additional headers: auth and keepalive. */
+	Overrides the parent to add recognizing additional headers: auth, connection options and transfer encoding. */
 	virtual void addHeader(const std::string & aKey, const std::string & aValue) override;
 
 
@@ -223,6 +511,9 @@ protected:
 	/** Full URL of the request */
 	std::string mURL;
 
+	/** Protocol version of the request ("HTTP/1.1") */
+	std::string mVersion;
+
 	/** Set to true if the request contains auth data that was understood by the parser */
 	bool mHasAuth;
 
@@ -232,12 +523,89 @@ protected:
 	/** The password used for auth */
 	std::string mAuthPassword;
 
-	/** Set to true if the request indicated that it supports keepalives.
-	If false, the server will close the connection once the request is finished */
+	/** Set to true if the request indicated that it supports keepalives, either by its version or by the
+	Connection header options. If false, the server will close the connection once the request is finished */
 	bool mAllowKeepAlive;
 
+	/** Set to true if the Connection header had the "close" option; it takes precedence over "keep-alive". */
+	bool mHasConnectionClose;
+
+	/** Set to true if the Connection header had the "upgrade" option. */
+	bool mIsUpgradeRequested;
+
+	/** Set to true if the request has a Transfer-Encoding whose last coding is not chunked, so the end of
+	the body can't be determined. */
+	bool mIsBodyUnbounded;
+
 	/** Any data attached to the request by the class client. */
 	UserDataPtr mUserData;
+
+	/** A decoded part of the URL, as offsets into mUrlDecoded. */
+	struct UrlSpan
+	{
+		uint32_t mOffset;
+		uint32_t mLength;
+	};
+
+	/** A decoded query parameter, as offsets into mUrlDecoded. */
+	struct QueryParam
+	{
+		UrlSpan mName;
+		UrlSpan mValue;
+	};
+
+	/** Set to true once the mUrlPathEnd and mUrlQueryEnd have been computed. */
+	mutable bool mIsUrlSplit;
+
+	/** Index of the first char in mURL past the path (the '?', the '#' or the end). Valid if mIsUrlSplit. */
+	mutable size_t mUrlPathEnd;
+
+	/** Index of the first char in mURL past the query (the '#' or the end). Valid if mIsUrlSplit. */
+	mutable size_t mUrlQueryEnd;
+
+	/** The cached value for urlPath(). Empty until the first call. */
+	mutable std::string mUrlPath;
+
+	/** Set to true once mUrlPath has been filled. */
+	mutable bool mHasUrlPath;
+
+	/** The percent-decoded path segments and query parameters, stored back to back.
+	Reserved to the size of the URL before the first append, so that it never reallocates under the returned views. */
+	mutable std::string mUrlDecoded;
+
+	/** The decoded path segments, filled on first use. */
+	mutable std::vector<UrlSpan> mPathSegments;
+
+	/** Set to true once mPathSegments has been filled. */
+	mutable bool mArePathSegmentsParsed;
+
+	/** The decoded query parameters, filled on first use. */
+	mutable std::vector<QueryParam> mQueryParams;
+
+	/** Set to true once mQueryParams has been filled. */
+	mutable bool mAreQueryParamsParsed;
+
+
+	/** Updates the keep-alive and upgrade flags from the options in the Connection header value. */
+	void processConnectionOptions(std::string_view aValue);
+
+	/** Computes mUrlPathEnd and mUrlQueryEnd, if not already computed. */
+	void splitUrl() const;
+
+	/** Decodes the text and appends it to mUrlDecoded, returning its span. Appends verbatim if decoding fails. */
+	UrlSpan appendDecoded(std::string_view aText, bool aIsPlusSpace) const;
+
+	/** Returns the view of the span in mUrlDecoded. */
+	std::string_view decodedView(const UrlSpan & aSpan) const
+	{
+		return std::string_view(mUrlDecoded.data() + aSpan.mOffset, aSpan.mLength);
+	}
+
+	/** Fills mPathSegments, if not already filled. */
+	void parsePathSegments() const;
+
+	/** Fills mQueryParams, if not already filled. */
+	void parseQueryParams() const;
 };
 
 
@@ -1,7 +1,13 @@
 #include "MessageParser.hpp"
 #include <cassert>
+#include <utility>
+#include <algorithm>
 #include "Utils.hpp"
 
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	#include <xmmintrin.h>
+#endif
+
 
 
 
@@ -12,9 +18,64 @@ namespace Http {
 
 
 
+// Prefetching helpers:
+
+namespace {
+
+/** The size of the cache line assumed for prefetching. */
+const size_t CACHE_LINE_SIZE = 64;
+
+/** The number of cache lines prefetched from the start of the incoming data, enough to cover the first few
+lines of a typical request. */
+const size_t PREFETCH_DATA_LINES = 4;
+
+/** Hints the CPU to bring the memory at the specified address into the cache for reading. */
+inline void prefetchLine(const void * aAddress)
+{
+	#if defined(__GNUC__) || defined(__clang__)
+		__builtin_prefetch(aAddress, 0, 3);
+	#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		_mm_prefetch(static_cast<const char *>(aAddress), _MM_HINT_T0);
+	#else
+		(void)aAddress;
+	#endif
+}
+
+/** Prefetches all cache lines of the specified memory range. */
+inline void prefetchRange(const void * aAddress, size_t aSize)
+{
+	auto start = static_cast<const char *>(aAddress);
+	for (size_t ofs = 0; ofs < aSize; ofs += CACHE_LINE_SIZE)
+	{
+		prefetchLine(start + ofs);
+	}
+}
+
+}  // anonymous namespace
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MessageParser::Limits:
+
+MessageParser::Limits::Limits():
+	mMaxFirstLineLength(8 * 1024)
+{
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MessageParser:
+
 MessageParser::MessageParser(MessageParser::Callbacks & aCallbacks):
-	mCallbacks(aCallbacks),
-	mEnvelopeParser(*this)
+	mCallbacks(&aCallbacks),
+	mEnvelopeParser(*this),
+	mStats(nullptr)
 {
 	reset();
 }
@@ -31,12 +92,29 @@ size_t MessageParser::parse(const char * aData, size_t aSize)
 		return 0;
 	}
 
+	HTTP_STATS_CODE(
+		if ((mStats != nullptr) && (mFirstByteTime == 0) && (aSize > 0))
+		{
+			mFirstByteTime = ParserStats::now();
+		}
+	)
+
 	// If still waiting for the status line, add to buffer and try parsing it:
 	auto inBufferSoFar = mBuffer.size();
 	if (mFirstLine.empty())
 	{
-		mBuffer.append(aData, aSize);
+		HTTP_STATS_CODE(auto oldCapacity = mBuffer.capacity();)
+		if (!mMemoryAccount.append(mBuffer, aData, aSize))
+		{
+			error(ecMemoryLimit, "Memory watermark exceeded");
+			return std::string::npos;
+		}
+		HTTP_STATS(mStats, addBuffered(aSize, oldCapacity, mBuffer.capacity()));
 		auto bytesConsumedFirstLine = parseFirstLine();
+		if (mHasHadError)
+		{
+			return std::string::npos;
+		}
 		assert(bytesConsumedFirstLine <= inBufferSoFar + aSize);  // Haven't consumed more data than there is in the buffer
 		assert(bytesConsumedFirstLine > inBufferSoFar);  // Have consumed at least the previous buffer contents
 		if (mFirstLine.empty())
@@ -44,23 +122,24 @@ size_t MessageParser::parse(const char * aData, size_t aSize)
 			// All data used, but not a complete status line yet.
 			return aSize;
 		}
-		if (mHasHadError)
-		{
-			return std::string::npos;
-		}
 		// Status line completed, feed the rest of the buffer into the envelope parser:
 		auto bytesConsumedEnvelope = mEnvelopeParser.parse(mBuffer.data(), mBuffer.size());
 		if (bytesConsumedEnvelope == std::string::npos)
 		{
-			mHasHadError = true;
-			mCallbacks.onError("Failed to parse the envelope");
+			envelopeError();
 			return std::string::npos;
 		}
 		assert(bytesConsumedEnvelope <= bytesConsumedFirstLine + aSize);  // Haven't consumed more data than there was in the buffer
+		HTTP_STATS(mStats, add(ParserStats::scHeaderBytes, bytesConsumedEnvelope));
 		mBuffer.erase(0, bytesConsumedEnvelope);
+		HTTP_STATS(mStats, add(ParserStats::scBufferCompactions, 1));
 		if (!mEnvelopeParser.isInHeaders())
 		{
 			headersFinished();
+			if (mHasHadError)
+			{
+				return std::string::npos;
+			}
 			// Process any data still left in the buffer as message body:
 			auto bytesConsumedBody = parseBody(mBuffer.data(), mBuffer.size());
 			if (bytesConsumedBody == std::string::npos)
@@ -79,13 +158,17 @@ size_t MessageParser::parse(const char * aData, size_t aSize)
 		auto bytesConsumed = mEnvelopeParser.parse(aData, aSize);
 		if (bytesConsumed == std::string::npos)
 		{
-			mHasHadError = true;
-			mCallbacks.onError("Failed to parse the envelope");
+			envelopeError();
 			return std::string::npos;
 		}
+		HTTP_STATS(mStats, add(ParserStats::scHeaderBytes, bytesConsumed));
 		if (!mEnvelopeParser.isInHeaders())
 		{
 			headersFinished();
+			if (mHasHadError)
+			{
+				return std::string::npos;
+			}
 			// Process any data still left as message body:
 			auto bytesConsumedBody = parseBody(aData + bytesConsumed, aSize - bytesConsumed);
 			if (bytesConsumedBody == std::string::npos)
@@ -93,6 +176,7 @@ size_t MessageParser::parse(const char * aData, size_t aSize)
 				// Error has already been reported by ParseBody, just bail out:
 				return std::string::npos;
 			}
+			return bytesConsumed + bytesConsumedBody;
 		}
 		return aSize;
 	}
@@ -105,32 +189,263 @@ size_t MessageParser::parse(const char * aData, size_t aSize)
 
 
 
+void MessageParser::parseBatch(BatchEntry * aEntries, size_t aCount)
+{
+	// Warm up the first entries:
+	for (size_t i = 0, count = std::min(aCount, size_t(BATCH_PREFETCH_DISTANCE)); i < count; ++i)
+	{
+		aEntries[i].mParser->prefetch(aEntries[i].mData, aEntries[i].mSize);
+	}
+
+	for (size_t i = 0; i < aCount; ++i)
+	{
+		if (i + BATCH_PREFETCH_DISTANCE < aCount)
+		{
+			const auto & ahead = aEntries[i + BATCH_PREFETCH_DISTANCE];
+			ahead.mParser->prefetch(ahead.mData, ahead.mSize);
+		}
+		auto & entry = aEntries[i];
+		entry.mResult = entry.mParser->parse(entry.mData, entry.mSize);
+	}
+}
+
+
+
+
+
 void MessageParser::reset()
 {
 	mHasHadError = false;
 	mIsFinished = false;
+	mHasExpectContinue = false;
+	mIsBodyRejected = false;
+	mShouldCloseConnection = false;
+	mIsResponseMode = false;
+	mRequestMethod.clear();
+	mStatusCode = 0;
+	mIsPersistentVersion = false;
+	mHasConnectionClose = false;
+	mHasConnectionKeepAlive = false;
+	mIsBodyUntilClose = false;
+	mIsSwitchingProtocols = false;
 	mFirstLine.clear();
 	mBuffer.clear();
 	mEnvelopeParser.reset();
-	mTransferEncodingParser.reset();
 	mTransferEncoding.clear();
-	mContentLength = 0;
+	mContentLength = std::string::npos;
+	mFirstByteTime = 0;
+	mNumHeaders = 0;
+	mErrorCode = ecNone;
+}
+
+
+
+
+
+void MessageParser::reset(Callbacks & aCallbacks)
+{
+	mCallbacks = &aCallbacks;
+	reset();
+}
+
+
+
+
+
+void MessageParser::finish()
+{
+	// Nothing to finish if the message is complete, broken, or hasn't started at all:
+	if (mIsFinished || mHasHadError || (mFirstLine.empty() && mBuffer.empty()))
+	{
+		return;
+	}
+	if (mFirstLine.empty() || mEnvelopeParser.isInHeaders())
+	{
+		error(ecIncompleteMessage, "The connection was closed before the end of the message head");
+		return;
+	}
+	if (mTransferEncodingParser == nullptr)
+	{
+		error(ecIncompleteMessage, "The connection was closed before the end of the message body");
+		return;
+	}
+
+	// Let the transfer encoding parser decide; a truncated body is reported through onError():
+	mErrorCode = ecIncompleteMessage;
+	mTransferEncodingParser->finish();
+	if (!mHasHadError)
+	{
+		mErrorCode = ecNone;
+	}
+}
+
+
+
+
+
+void MessageParser::expectResponse(std::string_view aRequestMethod)
+{
+	mIsResponseMode = true;
+	mRequestMethod.assign(aRequestMethod.data(), aRequestMethod.size());
+}
+
+
+
+
+
+bool MessageParser::canReuseConnection() const
+{
+	if (
+		!mIsFinished ||
+		mHasHadError ||
+		mShouldCloseConnection ||
+		mIsBodyUntilClose ||
+		mIsSwitchingProtocols ||
+		mHasConnectionClose
+	)
+	{
+		return false;
+	}
+	return (mIsPersistentVersion || mHasConnectionKeepAlive);
+}
+
+
+
+
+
+void MessageParser::setStats(ParserStats * aStats)
+{
+	mStats = aStats;
+	mEnvelopeParser.setStats(aStats);
+}
+
+
+
+
+
+void MessageParser::setLimits(const Limits & aLimits)
+{
+	mLimits = aLimits;
+	mEnvelopeParser.setLimits(aLimits.mHeaders);
+}
+
+
+
+
+
+int MessageParser::errorStatusCode(ErrorCode aErrorCode)
+{
+	switch (aErrorCode)
+	{
+		case ecFirstLineTooLong:        return 414;
+		case ecHeaderLineTooLong:       return 431;
+		case ecHeaderBlockTooLarge:     return 431;
+		case ecTooManyHeaders:          return 431;
+		case ecUnknownTransferEncoding: return 501;
+		case ecMemoryLimit:             return 503;
+		case ecNone:
+		case ecMalformedHeader:
+		case ecInvalidContentLength:
+		case ecInvalidBody:
+		case ecInvalidStatusLine:
+		case ecIncompleteMessage:
+		{
+			break;
+		}
+	}
+	return 400;
+}
+
+
+
+
+
+size_t MessageParser::retainedMemory() const
+{
+	return
+		sizeof(*this) + mFirstLine.capacity() + mBuffer.capacity() + mTransferEncoding.capacity() +
+		mEnvelopeParser.retainedMemory() +
+		((mTransferEncodingParser == nullptr) ? 0 : mTransferEncodingParser->retainedMemory()) +
+		((mSpareTransferEncodingParser == nullptr) ? 0 : mSpareTransferEncodingParser->retainedMemory());
 }
 
 
 
 
+void MessageParser::prefetch(const char * aData, size_t aSize) const
+{
+	prefetchRange(this, sizeof(*this));
+	prefetchLine(mCallbacks);
+	if (mFirstLine.empty())
+	{
+		prefetchLine(mBuffer.data());
+	}
+	else if (mEnvelopeParser.isInHeaders())
+	{
+		prefetchLine(mEnvelopeParser.mIncomingData.data());
+	}
+	else if (mTransferEncodingParser != nullptr)
+	{
+		prefetchLine(mTransferEncodingParser.get());
+	}
+	prefetchRange(aData, std::min(aSize, PREFETCH_DATA_LINES * CACHE_LINE_SIZE));
+}
+
+
+
+
+
 size_t MessageParser::parseFirstLine()
 {
-	auto idxLineEnd = mBuffer.find("\r\n");
+	// Skip any empty lines preceding the first line (RFC 7230 @ 3.5):
+	size_t idxLineStart = 0;
+	while (mBuffer.compare(idxLineStart, 2, "\r\n") == 0)
+	{
+		idxLineStart += 2;
+	}
+
+	auto idxLineEnd = mBuffer.find("\r\n", idxLineStart);
 	if (idxLineEnd == std::string::npos)
 	{
-		// Not a complete line yet
-		return mBuffer.size();
+		// Not a complete line yet, drop the empty lines so that they don't accumulate
+		// (the partial line may already include the CR of its terminating CRLF):
+		auto bufferSize = mBuffer.size();
+		auto partialSize = bufferSize - idxLineStart;
+		if ((partialSize > 0) && (partialSize - 1 > mLimits.mMaxFirstLineLength))
+		{
+			error(ecFirstLineTooLong, "The first line is too long");
+			return std::string::npos;
+		}
+		mBuffer.erase(0, idxLineStart);
+		return bufferSize;
+	}
+	if (idxLineEnd - idxLineStart > mLimits.mMaxFirstLineLength)
+	{
+		error(ecFirstLineTooLong, "The first line is too long");
+		return std::string::npos;
+	}
+	mFirstLine.assign(mBuffer, idxLineStart, idxLineEnd - idxLineStart);
+	if (mIsResponseMode)
+	{
+		if (!parseStatusLine())
+		{
+			error(ecInvalidStatusLine, Utils::printf("Invalid status line: \"%s\"", mFirstLine.c_str()));
+			return std::string::npos;
+		}
+	}
+	else
+	{
+		// The request line ends with the protocol version:
+		auto idxVersion = mFirstLine.rfind(' ');
+		mIsPersistentVersion = (
+			(idxVersion != std::string::npos) &&
+			Utils::isPersistentHttpVersion(std::string_view(mFirstLine).substr(idxVersion + 1))
+		);
 	}
-	mFirstLine = mBuffer.substr(0, idxLineEnd);
 	mBuffer.erase(0, idxLineEnd + 2);
-	mCallbacks.onFirstLine(mFirstLine);
+	HTTP_STATS(mStats, add(ParserStats::scFirstLineBytes, idxLineEnd + 2));
+	HTTP_STATS(mStats, add(ParserStats::scBufferCompactions, 1));
+	mCallbacks->onFirstLine(mFirstLine);
 	return idxLineEnd + 2;
 }
 
@@ -138,18 +453,67 @@ size_t MessageParser::parseFirstLine()
 
 
 
+bool MessageParser::parseStatusLine()
+{
+	// status-line = HTTP-version SP status-code SP reason-phrase (RFC 7230 @ 3.1.2);
+	// the SP before an empty reason phrase is commonly left out, so it is optional:
+	auto idxSpace = mFirstLine.find(' ');
+	if ((idxSpace == std::string::npos) || (mFirstLine.compare(0, 5, "HTTP/") != 0))
+	{
+		return false;
+	}
+	if ((mFirstLine.size() < idxSpace + 4) || ((mFirstLine.size() > idxSpace + 4) && (mFirstLine[idxSpace + 4] != ' ')))
+	{
+		return false;
+	}
+	int statusCode = 0;
+	for (size_t i = idxSpace + 1; i < idxSpace + 4; ++i)
+	{
+		if ((mFirstLine[i] < '0') || (mFirstLine[i] > '9'))
+		{
+			return false;
+		}
+		statusCode = statusCode * 10 + (mFirstLine[i] - '0');
+	}
+	if (statusCode < 100)
+	{
+		return false;
+	}
+	mStatusCode = statusCode;
+	mIsPersistentVersion = Utils::isPersistentHttpVersion(std::string_view(mFirstLine).substr(0, idxSpace));
+	return true;
+}
+
+
+
+
+
 size_t MessageParser::parseBody(const char * aData, size_t aSize)
 {
+	if (mShouldCloseConnection)
+	{
+		// The body has been rejected, the data is not a part of the message:
+		return 0;
+	}
+
 	if (mTransferEncodingParser == nullptr)
 	{
 		// We have no Transfer-encoding parser assigned. This should have happened when finishing the envelope
-		onError("No transfer encoding parser");
+		error(ecUnknownTransferEncoding, "No transfer encoding parser");
 		return std::string::npos;
 	}
 
 	// Parse the body using the transfer encoding parser:
 	// (Note that TE parser returns the number of bytes left, while we return the number of bytes consumed)
-	return aSize - mTransferEncodingParser->parse(aData, aSize);
+	auto bytesLeft = mTransferEncodingParser->parse(aData, aSize);
+	if (bytesLeft == std::string::npos)
+	{
+		// The error has already been reported through onError()
+		return std::string::npos;
+	}
+	auto bytesConsumed = aSize - bytesLeft;
+	HTTP_STATS(mStats, add(ParserStats::scBodyBytes, bytesConsumed));
+	return bytesConsumed;
 }
 
 
@@ -158,17 +522,159 @@ size_t MessageParser::parseBody(const char * aData, size_t aSize)
 
 void MessageParser::headersFinished()
 {
-	mCallbacks.onHeadersFinished();
+	HTTP_STATS(mStats, record(ParserStats::shHeadersLatency, ParserStats::now() - mFirstByteTime));
+	HTTP_STATS(mStats, record(ParserStats::shHeadersPerMessage, mNumHeaders));
+	mCallbacks->onHeadersFinished();
+	decideBodyFraming();
+	if (!restartTransferEncodingParser())
+	{
+		if (mSpareTransferEncodingParser == nullptr)
+		{
+			mSpareTransferEncodingParser = std::move(mTransferEncodingParser);
+		}
+		mTransferEncodingParser = TransferEncodingParser::create(*this, mTransferEncoding, mContentLength);
+		if (mTransferEncodingParser == nullptr)
+		{
+			error(ecUnknownTransferEncoding, Utils::printf("Unknown transfer encoding: %s", mTransferEncoding.c_str()));
+			return;
+		}
+	}
+	askExpectContinue();
+}
+
+
+
+
+
+bool MessageParser::restartTransferEncodingParser()
+{
+	if (
+		(mTransferEncodingParser != nullptr) &&
+		mTransferEncodingParser->restart(mTransferEncoding, mContentLength)
+	)
+	{
+		return true;
+	}
+	std::swap(mTransferEncodingParser, mSpareTransferEncodingParser);
+	return (
+		(mTransferEncodingParser != nullptr) &&
+		mTransferEncodingParser->restart(mTransferEncoding, mContentLength)
+	);
+}
+
+
+
+
+
+void MessageParser::decideBodyFraming()
+{
+	// Responses that never have a body, regardless of the headers (RFC 7230 @ 3.3.3):
+	if (mIsResponseMode)
+	{
+		auto isConnect = Utils::noCaseEqual(mRequestMethod, "CONNECT");
+		auto isSuccess = ((mStatusCode >= 200) && (mStatusCode < 300));
+		mIsSwitchingProtocols = ((mStatusCode == 101) || (isConnect && isSuccess));
+		if (
+			Utils::noCaseEqual(mRequestMethod, "HEAD") ||
+			(mStatusCode < 200) ||
+			(mStatusCode == 204) ||
+			(mStatusCode == 304) ||
+			(isConnect && isSuccess)
+		)
+		{
+			mTransferEncoding = "Identity";
+			mContentLength = 0;
+			return;
+		}
+	}
+
 	if (mTransferEncoding.empty())
 	{
 		mTransferEncoding = "Identity";
 	}
-	mTransferEncodingParser = TransferEncodingParser::create(*this, mTransferEncoding, mContentLength);
-	if (mTransferEncodingParser == nullptr)
+	if (mContentLength == std::string::npos)
+	{
+		if (mIsResponseMode && Utils::noCaseEqual(mTransferEncoding, "identity"))
+		{
+			// A response without a length is delimited by the connection close:
+			mIsBodyUntilClose = true;
+		}
+		else
+		{
+			// A request without a length has no body (RFC 7230 @ 3.3.3, point 6); the chunked encoding ignores it:
+			mContentLength = 0;
+		}
+	}
+}
+
+
+
+
+
+void MessageParser::askExpectContinue()
+{
+	// Only requests (responses are parsed after expectResponse()) with a body; HTTP/1.0 requests' expectations
+	// are ignored (RFC 7231 @ 5.1.1):
+	if (
+		!mHasExpectContinue ||
+		mIsFinished ||
+		mIsResponseMode ||
+		((mFirstLine.size() >= 8) && (mFirstLine.compare(mFirstLine.size() - 8, 8, "HTTP/1.0") == 0)) ||
+		(Utils::noCaseEqual(mTransferEncoding, "identity") && (mContentLength == 0))
+	)
 	{
-		onError(Utils::printf("Unknown transfer encoding: %s", mTransferEncoding.c_str()));
 		return;
 	}
+	switch (mCallbacks->onExpectContinue())
+	{
+		case eaContinue:
+		{
+			return;
+		}
+		case eaRejectAndDiscard:
+		{
+			mIsBodyRejected = true;
+			return;
+		}
+		case eaRejectAndClose:
+		{
+			mIsBodyRejected = true;
+			mShouldCloseConnection = true;
+			mIsFinished = true;
+			return;
+		}
+	}
+}
+
+
+
+
+
+void MessageParser::error(ErrorCode aErrorCode, const std::string & aErrorDescription)
+{
+	mErrorCode = aErrorCode;
+	onError(aErrorDescription);
+}
+
+
+
+
+
+void MessageParser::envelopeError()
+{
+	switch (mEnvelopeParser.errorCode())
+	{
+		case EnvelopeParser::ecLineTooLong:    error(ecHeaderLineTooLong,   "A header is too long"); return;
+		case EnvelopeParser::ecBlockTooLarge:  error(ecHeaderBlockTooLarge, "The headers are too large"); return;
+		case EnvelopeParser::ecTooManyHeaders: error(ecTooManyHeaders,      "Too many headers"); return;
+		case EnvelopeParser::ecMemoryLimit:    error(ecMemoryLimit,         "Memory watermark exceeded"); return;
+		case EnvelopeParser::ecMalformedLine:
+		case EnvelopeParser::ecNone:
+		{
+			break;
+		}
+	}
+	error(ecMalformedHeader, "Failed to parse the envelope");
 }
 
 
@@ -177,21 +683,44 @@ void MessageParser::headersFinished()
 
 void MessageParser::onHeaderLine(const std::string & aKey, const std::string & aValue)
 {
-	mCallbacks.onHeaderLine(aKey, aValue);
-	auto key = Utils::strToLower(aKey);
-	if (key == "content-length")
+	HTTP_STATS_CODE(mNumHeaders += 1;)
+	HTTP_STATS(mStats, add(ParserStats::scHeaders, 1));
+	mCallbacks->onHeaderLine(aKey, aValue);
+	if (Utils::noCaseEqual(aKey, "content-length"))
 	{
 		if (!Utils::stringToInteger(aValue, mContentLength))
 		{
-			onError(Utils::printf("Invalid content length header value: \"%s\"", aValue.c_str()));
+			error(ecInvalidContentLength, Utils::printf("Invalid content length header value: \"%s\"", aValue.c_str()));
 		}
 		return;
 	}
-	if (key == "transfer-encoding")
+	if (Utils::noCaseEqual(aKey, "transfer-encoding"))
 	{
 		mTransferEncoding = aValue;
 		return;
 	}
+	if (Utils::noCaseEqual(aKey, "expect"))
+	{
+		mHasExpectContinue = Utils::noCaseEqual(aValue, "100-continue");
+		return;
+	}
+	if (Utils::noCaseEqual(aKey, "connection"))
+	{
+		std::string_view options(aValue);
+		std::string_view option;
+		while (Utils::nextListElement(options, option))
+		{
+			if (Utils::noCaseEqual(option, "close"))
+			{
+				mHasConnectionClose = true;
+			}
+			else if (Utils::noCaseEqual(option, "keep-alive"))
+			{
+				mHasConnectionKeepAlive = true;
+			}
+		}
+		return;
+	}
 }
 
 
@@ -200,8 +729,14 @@ void MessageParser::onHeaderLine(const std::string & aKey, const std::string & a
 
 void MessageParser::onError(const std::string & aErrorDescription)
 {
+	// Errors reported by the transfer encoding parser don't set the code themselves:
+	if (mErrorCode == ecNone)
+	{
+		mErrorCode = ecInvalidBody;
+	}
 	mHasHadError = true;
-	mCallbacks.onError(aErrorDescription);
+	HTTP_STATS(mStats, add(ParserStats::scErrors, 1));
+	mCallbacks->onError(aErrorDescription);
 }
 
 
@@ -210,7 +745,10 @@ void MessageParser::onError(const std::string & aErrorDescription)
 
 void MessageParser::onBodyData(const void * aData, size_t aSize)
 {
-	mCallbacks.onBodyData(aData, aSize);
+	if (!mIsBodyRejected)
+	{
+		mCallbacks->onBodyData(aData, aSize);
+	}
 }
 
 
@@ -220,7 +758,9 @@ void MessageParser::onBodyData(const void * aData, size_t aSize)
 void MessageParser::onBodyFinished()
 {
 	mIsFinished = true;
-	mCallbacks.onBodyFinished();
+	HTTP_STATS(mStats, add(ParserStats::scMessages, 1));
+	HTTP_STATS(mStats, record(ParserStats::shBodyLatency, ParserStats::now() - mFirstByteTime));
+	mCallbacks->onBodyFinished();
 }
 
 
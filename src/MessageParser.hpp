@@ -1,7 +1,10 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include "EnvelopeParser.hpp"
+#include "MemoryGovernor.hpp"
+#include "ParserStats.hpp"
 #include "TransferEncodingParser.hpp"
 
 
@@ -22,6 +25,15 @@ class MessageParser:
 {
 public:
 
+	/** The ways to answer a request that expects "100 Continue" before sending its body (RFC 7231 @ 5.1.1). */
+	enum ExpectAction
+	{
+		eaContinue,          ///< Accept the body; the server sends continueResponse() and the body is parsed as usual
+		eaRejectAndClose,    ///< Refuse the body; the server sends a final response and closes the connection
+		eaRejectAndDiscard,  ///< Refuse the body; the server sends a final response, the body is read, but not reported
+	};
+
+
 	class Callbacks
 	{
 	public:
@@ -41,6 +53,13 @@ public:
 		/** Called when all the headers have been parsed. */
 		virtual void onHeadersFinished() = 0;
 
+		/** Called after onHeadersFinished() if the request has a body and the "Expect: 100-continue" header,
+		meaning that the client waits for the server's approval before sending the body.
+		The server should send its answer before returning to the socket: continueResponse() for eaContinue,
+		or a final response (such as 413 or 417) for the rejections.
+		The default accepts all bodies. */
+		virtual ExpectAction onExpectContinue() { return eaContinue; }
+
 		/** Called for each chunk of the incoming body data. */
 		virtual void onBodyData(const void * aData, size_t aSize) = 0;
 
@@ -49,6 +68,60 @@ public:
 	};
 
 
+	/** A single parser and its input for parseBatch(). */
+	struct BatchEntry
+	{
+		/** The parser to receive the data. */
+		MessageParser * mParser;
+
+		/** The incoming data for the parser. */
+		const char * mData;
+
+		/** The size of the incoming data. */
+		size_t mSize;
+
+		/** Output: the value returned by parse() for this entry. */
+		size_t mResult;
+	};
+
+
+	/** Limits on the parsed message head, bounding the memory used by the parser per connection.
+	A limit may be set to std::numeric_limits<size_t>::max() to disable it. */
+	struct Limits
+	{
+		/** Maximum length of the first line (request line or status line), excluding the CRLF. */
+		size_t mMaxFirstLineLength;
+
+		/** Limits on the headers. */
+		EnvelopeParser::Limits mHeaders;
+
+		/** Creates the default limits: 8 KiB first line, plus the EnvelopeParser::Limits defaults. */
+		Limits();
+	};
+
+
+	/** The reasons for the parser to fail, reported by errorCode() after onError() has been called. */
+	enum ErrorCode
+	{
+		ecNone,                     ///< No error
+		ecFirstLineTooLong,         ///< The first line is longer than Limits::mMaxFirstLineLength
+		ecHeaderLineTooLong,        ///< A header is longer than Limits::mHeaders.mMaxLineLength
+		ecHeaderBlockTooLarge,      ///< The headers are larger than Limits::mHeaders.mMaxBlockSize
+		ecTooManyHeaders,           ///< There are more headers than Limits::mHeaders.mMaxHeaderCount
+		ecMalformedHeader,          ///< A header line is not valid
+		ecInvalidContentLength,     ///< The Content-Length header value is not a valid number
+		ecUnknownTransferEncoding,  ///< The Transfer-Encoding is not supported
+		ecInvalidBody,              ///< The body doesn't conform to its transfer encoding
+		ecMemoryLimit,              ///< The MemoryGovernor watermark has been crossed, the data couldn't be buffered
+		ecInvalidStatusLine,        ///< The status line of a response is not valid
+		ecIncompleteMessage,        ///< The connection was closed (finish()) before the end of the message
+	};
+
+
+	/** The number of entries that parseBatch() prefetches ahead of the entry being parsed. */
+	static const size_t BATCH_PREFETCH_DISTANCE = 4;
+
+
 	/** Creates a new parser instance that will use the specified callbacks for reporting. */
 	MessageParser(Callbacks & aCallbacks);
 
@@ -56,21 +129,88 @@ public:
 	Returns the number of bytes consumed or std::string::npos number for error. */
 	size_t parse(const char * aData, size_t aSize);
 
-	/** Called when the server indicates no more data will be sent (HTTP 1.0 socket closed).
-	Finishes all parsing and calls apropriate callbacks (error if incomplete response). */
+	/** Parses the data for multiple parsers (typically multiple connections that have become readable at once),
+	calling parse() on each entry in turn and storing its return value in the entry's mResult.
+	While parsing one entry, prefetches the parser state and the start of the input of the entries
+	BATCH_PREFETCH_DISTANCE ahead, so that their cache misses overlap with useful work.
+	Each parser must appear at most once in the batch. */
+	static void parseBatch(BatchEntry * aEntries, size_t aCount);
+
+	/** Called when the peer indicates no more data will be sent (the socket has been closed).
+	Finishes a body that extends until the connection close and calls onBodyFinished(); reports an error
+	(ecIncompleteMessage) if a message has been started but not completed. */
 	void finish();
 
+	/** Switches the parser to parse the response to a request with the specified method, until the next reset().
+	The method and the status code decide whether the response has a body (RFC 7230 @ 3.3.3): responses to
+	HEAD, 1xx, 204 and 304 responses and 2xx responses to CONNECT have none, responses without Content-Length
+	and Transfer-Encoding have a body that extends until the connection is closed, ended by finish().
+	A 1xx response other than 101 is followed by the final response to the same request; reset() the parser
+	and call this again to parse it. To be called before any data of the response is parsed. */
+	void expectResponse(std::string_view aRequestMethod);
+
+	/** Returns true if the parser parses a response (expectResponse()), false if it parses a request. */
+	bool isResponseMode() const { return mIsResponseMode; }
+
+	/** Returns the status code of the parsed response; 0 before the status line is parsed or in request mode. */
+	int statusCode() const { return mStatusCode; }
+
+	/** Returns true if the connection can carry another message once this one is finished: the protocol
+	version and the Connection header options allow it (RFC 7230 @ 6.3), the body is not delimited by the
+	connection close, and the connection hasn't switched to another protocol (101, or 2xx to CONNECT). */
+	bool canReuseConnection() const;
+
 	/** Returns true if the entire response has been already parsed. */
 	bool isFinished() const { return mIsFinished; }
 
-	/** Resets the parser to the initial state, so that a new request can be parsed. */
+	/** Returns true if the body has been rejected through onExpectContinue(). */
+	bool isBodyRejected() const { return mIsBodyRejected; }
+
+	/** Returns true if the connection must be closed once the response is sent, because the body has been
+	rejected by eaRejectAndClose. The parser is finished, the data past the headers must not be parsed as
+	another message. */
+	bool shouldCloseConnection() const { return mShouldCloseConnection; }
+
+	/** Returns the complete interim response that accepts the body of a request with "Expect: 100-continue". */
+	static std::string_view continueResponse() { return "HTTP/1.1 100 Continue\r\n\r\n"; }
+
+	/** Resets the parser to the initial state, so that a new request can be parsed.
+	Switches the parser back to parsing requests. */
 	void reset();
 
+	/** Resets the parser to the initial state and switches it to report to the specified callbacks.
+	Keeps the buffers grown so far, so that a recycled parser doesn't allocate. */
+	void reset(Callbacks & aCallbacks);
+
+	/** Returns the approximate amount of memory held by the parser, including the buffers kept for reuse. */
+	size_t retainedMemory() const;
+
+	/** Attaches the statistics object to be updated by the parser; nullptr to detach.
+	The statistics are only collected if the library is compiled with HTTP_PARSER_STATS. */
+	void setStats(ParserStats * aStats);
+
+	/** Returns the attached statistics object, or nullptr if none. */
+	ParserStats * stats() const { return mStats; }
+
+	/** Sets the limits to be enforced while parsing the message head. */
+	void setLimits(const Limits & aLimits);
+
+	/** Returns the limits enforced while parsing the message head. */
+	const Limits & limits() const { return mLimits; }
+
+	/** Returns the reason of the parsing failure; ecNone if there was no error since the last reset(). */
+	ErrorCode errorCode() const { return mErrorCode; }
+
+	/** Returns the HTTP status code that a server should respond with to a request that failed with the error:
+	414 for a long request line, 431 for too large headers, 501 for unsupported transfer encoding,
+	503 when the MemoryGovernor watermark has been crossed, 400 otherwise. */
+	static int errorStatusCode(ErrorCode aErrorCode);
+
 
 protected:
 
 	/** The callbacks used for reporting. */
-	Callbacks & mCallbacks;
+	Callbacks * mCallbacks;
 
 	/** Set to true if an error has been encountered by the parser. */
 	bool mHasHadError;
@@ -78,27 +218,87 @@ protected:
 	/** True if the response has been fully parsed. */
 	bool mIsFinished;
 
+	/** True if the message has the "Expect: 100-continue" header. */
+	bool mHasExpectContinue;
+
+	/** True if the body has been rejected by onExpectContinue(); the body data is not reported. */
+	bool mIsBodyRejected;
+
+	/** True if the body has been rejected by eaRejectAndClose; the body is not parsed at all. */
+	bool mShouldCloseConnection;
+
+	/** True if the parser parses a response to a request with mRequestMethod. */
+	bool mIsResponseMode;
+
+	/** The method of the request whose response is parsed, in the response mode. */
+	std::string mRequestMethod;
+
+	/** The status code of the parsed response; 0 if not parsed yet or in the request mode. */
+	int mStatusCode;
+
+	/** True if the protocol version of the message makes the connection persistent by default. */
+	bool mIsPersistentVersion;
+
+	/** True if the Connection header has the "close" option. */
+	bool mHasConnectionClose;
+
+	/** True if the Connection header has the "keep-alive" option. */
+	bool mHasConnectionKeepAlive;
+
+	/** True if the body extends until the connection is closed. */
+	bool mIsBodyUntilClose;
+
+	/** True if the connection switches to another protocol after the message (101, or 2xx to CONNECT). */
+	bool mIsSwitchingProtocols;
+
 	/** The complete first line of the response. Empty if not parsed yet. */
 	std::string mFirstLine;
 
 	/** Buffer for the incoming data until the status line is parsed. */
 	std::string mBuffer;
 
+	/** The MemoryGovernor charges for the growth of mBuffer. */
+	MemoryGovernor::Account mMemoryAccount;
+
 	/** Parser for the envelope data (headers) */
 	EnvelopeParser mEnvelopeParser;
 
-	/** The specific parser for the transfer encoding used by this response. */
+	/** The specific parser for the transfer encoding used by this response.
+	Kept over reset() and reused by the next message if it has the same transfer encoding. */
 	TransferEncodingParserPtr mTransferEncodingParser;
 
+	/** The previously used transfer encoding parser of a different encoding, kept for reuse, so that
+	alternating between the identity and the chunked encodings doesn't allocate. */
+	TransferEncodingParserPtr mSpareTransferEncodingParser;
+
 	/** The transfer encoding to be used by the parser.
 	Filled while parsing headers, used when headers are finished. */
 	std::string mTransferEncoding;
 
-	/** The content length, parsed from the headers, if available.
+	/** The content length, parsed from the headers; std::string::npos until a Content-Length header is seen.
 	Unused for chunked encoding.
 	Filled while parsing headers, used when headers are finished. */
 	size_t mContentLength;
 
+	/** The statistics to update, or nullptr if not collecting. */
+	ParserStats * mStats;
+
+	/** The time (ParserStats::now()) when the first byte of the current message arrived; 0 if not yet.
+	Only used when collecting statistics. */
+	uint64_t mFirstByteTime;
+
+	/** Number of header lines in the current message. Only used when collecting statistics. */
+	size_t mNumHeaders;
+
+	/** The limits enforced while parsing the message head. */
+	Limits mLimits;
+
+	/** The reason of the parsing failure, ecNone if none. */
+	ErrorCode mErrorCode;
+
+
+	/** Issues prefetches for the parser state and the start of the specified incoming data. */
+	void prefetch(const char * aData, size_t aSize) const;
 
 	/** Parses the first line out of mBuffer.
 	Removes the first line from mBuffer, if appropriate.
@@ -113,6 +313,25 @@ protected:
 	/** Called internally when the headers-parsing has just finished. */
 	void headersFinished();
 
+	/** Restarts the current or the spare transfer encoding parser for the body framing, swapping them as needed.
+	Returns false if neither of them can parse the framing. */
+	bool restartTransferEncodingParser();
+
+	/** Decides the framing of the body from the mode, status code and headers, when the headers are finished. */
+	void decideBodyFraming();
+
+	/** Parses the status code out of mFirstLine, in the response mode. Returns false if not a valid status line. */
+	bool parseStatusLine();
+
+	/** Asks the callbacks about a body expected by "Expect: 100-continue", if applicable. */
+	void askExpectContinue();
+
+	/** Records the error code and reports the error through onError(). */
+	void error(ErrorCode aErrorCode, const std::string & aErrorDescription);
+
+	/** Reports the failure of mEnvelopeParser, translating its error code. */
+	void envelopeError();
+
 	// EnvelopeParser::Callbacks overrides:
 	virtual void onHeaderLine(const std::string & aKey, const std::string & aValue) override;
 
@@ -1,6 +1,5 @@
 #include "MultipartParser.hpp"
 #include <cstring>
-#include "NameValueParser.hpp"
 
 
 
@@ -16,16 +15,39 @@ MultipartParser::MultipartParser(const std::string & aContentType, Callbacks & a
 	mCallbacks(aCallbacks),
 	mIsValid(true),
 	mEnvelopeParser(*this),
-	mHasHadData(false)
+	mHasHadData(false),
+	mStats(nullptr)
+{
+	init(aContentType);
+}
+
+
+
+
+
+void MultipartParser::reset(const std::string & aContentType)
+{
+	mIsValid = true;
+	mEnvelopeParser.reset();
+	mIncomingData.clear();
+	mBoundary.clear();
+	mHasHadData = false;
+	init(aContentType);
+}
+
+
+
+
+
+void MultipartParser::init(const std::string & aContentType)
 {
 	// Check that the content type is multipart:
-	std::string ContentType(aContentType);
-	if (strncmp(ContentType.c_str(), "multipart/", 10) != 0)
+	if (strncmp(aContentType.c_str(), "multipart/", 10) != 0)
 	{
 		mIsValid = false;
 		return;
 	}
-	size_t idxSC = ContentType.find(';', 10);
+	size_t idxSC = aContentType.find(';', 10);
 	if (idxSC == std::string::npos)
 	{
 		mIsValid = false;
@@ -33,20 +55,21 @@ MultipartParser::MultipartParser(const std::string & aContentType, Callbacks & a
 	}
 
 	// Find the multipart boundary:
-	ContentType.erase(0, idxSC + 1);
-	NameValueParser CTParser(ContentType.c_str(), ContentType.size());
-	CTParser.finish();
-	if (!CTParser.isValid())
+	mContentTypeParser.reset();
+	mContentTypeParser.parse(aContentType.c_str() + idxSC + 1, aContentType.size() - idxSC - 1);
+	mContentTypeParser.finish();
+	if (!mContentTypeParser.isValid())
 	{
 		mIsValid = false;
 		return;
 	}
-	mBoundary = CTParser["boundary"];
-	mIsValid = !mBoundary.empty();
+	auto itrBoundary = mContentTypeParser.find("boundary");
+	mIsValid = (itrBoundary != mContentTypeParser.end()) && !itrBoundary->second.empty();
 	if (!mIsValid)
 	{
 		return;
 	}
+	mBoundary = itrBoundary->second;
 
 	// Set the envelope parser for parsing the body, so that our Parse() function parses the ignored prefix data as a body
 	mEnvelopeParser.setIsInHeaders(false);
@@ -74,7 +97,15 @@ void MultipartParser::parse(const char * aData, size_t aSize)
 	}
 
 	// Append to buffer, then parse it:
-	mIncomingData.append(aData, aSize);
+	HTTP_STATS(mStats, add(ParserStats::scMultipartBytes, aSize));
+	HTTP_STATS_CODE(auto oldCapacity = mIncomingData.capacity();)
+	if (!mMemoryAccount.append(mIncomingData, aData, aSize))
+	{
+		HTTP_STATS(mStats, add(ParserStats::scErrors, 1));
+		mIsValid = false;
+		return;
+	}
+	HTTP_STATS(mStats, addBuffered(aSize, oldCapacity, mIncomingData.capacity()));
 	for (;;)
 	{
 		if (mEnvelopeParser.isInHeaders())
@@ -82,6 +113,7 @@ void MultipartParser::parse(const char * aData, size_t aSize)
 			size_t BytesConsumed = mEnvelopeParser.parse(mIncomingData.data(), mIncomingData.size());
 			if (BytesConsumed == std::string::npos)
 			{
+				HTTP_STATS(mStats, add(ParserStats::scErrors, 1));
 				mIsValid = false;
 				return;
 			}
@@ -90,7 +122,7 @@ void MultipartParser::parse(const char * aData, size_t aSize)
 				// All the incoming data has been consumed and still waiting for more
 				return;
 			}
-			mIncomingData.erase(0, BytesConsumed);
+			consumeIncomingData(BytesConsumed);
 		}
 
 		// Search for boundary / boundary end:
@@ -102,14 +134,14 @@ void MultipartParser::parse(const char * aData, size_t aSize)
 			{
 				size_t BytesToReport = mIncomingData.size() - mBoundary.size() - 8;
 				mCallbacks.onPartData(mIncomingData.data(), BytesToReport);
-				mIncomingData.erase(0, BytesToReport);
+				consumeIncomingData(BytesToReport);
 			}
 			return;
 		}
 		if (idxBoundary > 0)
 		{
 			mCallbacks.onPartData(mIncomingData.data(), idxBoundary);
-			mIncomingData.erase(0, idxBoundary);
+			consumeIncomingData(idxBoundary);
 		}
 		idxBoundary = 4;
 		size_t LineEnd = mIncomingData.find("\r\n", idxBoundary);
@@ -120,7 +152,7 @@ void MultipartParser::parse(const char * aData, size_t aSize)
 			{
 				size_t BytesToReport = mIncomingData.size() - mBoundary.size() - 8;
 				mCallbacks.onPartData(mIncomingData.data(), BytesToReport);
-				mIncomingData.erase(0, BytesToReport);
+				consumeIncomingData(BytesToReport);
 			}
 			return;
 		}
@@ -131,7 +163,7 @@ void MultipartParser::parse(const char * aData, size_t aSize)
 		{
 			// Got a line, but it's not a boundary, report it as data:
 			mCallbacks.onPartData(mIncomingData.data(), LineEnd);
-			mIncomingData.erase(0, LineEnd);
+			consumeIncomingData(LineEnd);
 			continue;
 		}
 
@@ -147,8 +179,9 @@ void MultipartParser::parse(const char * aData, size_t aSize)
 				mIncomingData.clear();
 				return;
 			}
+			HTTP_STATS(mStats, add(ParserStats::scMultipartParts, 1));
 			mCallbacks.onPartStart();
-			mIncomingData.erase(0, LineEnd + 2);
+			consumeIncomingData(LineEnd + 2);
 
 			// Keep parsing for the headers that may have come with this data:
 			mEnvelopeParser.reset();
@@ -157,7 +190,7 @@ void MultipartParser::parse(const char * aData, size_t aSize)
 
 		// It's a line, but not a boundary. It can be fully sent to the data receiver, since a boundary cannot cross lines
 		mCallbacks.onPartData(mIncomingData.c_str(), LineEnd);
-		mIncomingData.erase(0, LineEnd);
+		consumeIncomingData(LineEnd);
 	}  // while (true)
 }
 
@@ -165,6 +198,26 @@ void MultipartParser::parse(const char * aData, size_t aSize)
 
 
 
+void MultipartParser::setStats(ParserStats * aStats)
+{
+	mStats = aStats;
+	mEnvelopeParser.setStats(aStats);
+}
+
+
+
+
+
+void MultipartParser::consumeIncomingData(size_t aNumBytes)
+{
+	mIncomingData.erase(0, aNumBytes);
+	HTTP_STATS(mStats, add(ParserStats::scBufferCompactions, 1));
+}
+
+
+
+
+
 void MultipartParser::onHeaderLine(const std::string & aKey, const std::string & aValue)
 {
 	mCallbacks.onPartHeader(aKey, aValue);
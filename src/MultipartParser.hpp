@@ -2,6 +2,9 @@
 
 #include <string>
 #include "EnvelopeParser.hpp"
+#include "MemoryGovernor.hpp"
+#include "NameValueParser.hpp"
+#include "ParserStats.hpp"
 
 
 
@@ -43,9 +46,20 @@ public:
 	/** Creates the parser, expects to find the boundary in aContentType */
 	MultipartParser(const std::string & aContentType, Callbacks & aCallbacks);
 
+	/** Reinitializes the parser for a new message with the specified content type, as if newly constructed.
+	Keeps the buffers grown so far, so that a reused parser doesn't allocate. */
+	void reset(const std::string & aContentType);
+
 	/** Parses more incoming data */
 	void parse(const char * aData, size_t aSize);
 
+	/** Returns true if the data parsed so far is valid; once false, further data is ignored. */
+	bool isValid() const { return mIsValid; }
+
+	/** Attaches the statistics object to be updated by the parser; nullptr to detach.
+	The statistics are only collected if the library is compiled with HTTP_PARSER_STATS. */
+	void setStats(ParserStats * aStats);
+
 
 protected:
 
@@ -61,12 +75,27 @@ protected:
 	/** Buffer for the incoming data until it is parsed */
 	std::string mIncomingData;
 
+	/** The MemoryGovernor charges for the growth of mIncomingData. */
+	MemoryGovernor::Account mMemoryAccount;
+
 	/** The boundary, excluding both the initial "--" and the terminating CRLF */
 	std::string mBoundary;
 
+	/** Parser for the parameters of the content type, kept for reuse. */
+	NameValueParser mContentTypeParser;
+
 	/** Set to true if some data for the current part has already been signalized to mCallbacks. Used for proper CRLF inserting. */
 	bool mHasHadData;
 
+	/** The statistics to update, or nullptr if not collecting. */
+	ParserStats * mStats;
+
+
+	/** Sets the parser up for the specified content type; used by the constructor and reset(). */
+	void init(const std::string & aContentType);
+
+	/** Removes the specified number of bytes from the front of mIncomingData. */
+	void consumeIncomingData(size_t aNumBytes);
 
 	/** Parse one line of incoming data. The CRLF has already been stripped from aData / aSize */
 	void parseLine(const char * aData, size_t aSize);
@@ -1,5 +1,6 @@
 #include "NameValueParser.hpp"
 #include <cassert>
+#include "CharTables.hpp"
 
 
 
@@ -32,6 +33,19 @@ NameValueParser::NameValueParser(const char * aData, size_t aSize, bool aAllowsK
 
 
 
+void NameValueParser::reset(bool aAllowsKeyOnly)
+{
+	mSpareNodes.reclaim(*this);
+	mState = psKeySpace;
+	mAllowsKeyOnly = aAllowsKeyOnly;
+	mCurrentKey.clear();
+	mCurrentValue.clear();
+}
+
+
+
+
+
 void NameValueParser::parse(const char * aData, size_t aSize)
 {
 	assert(mState != psFinished);  // Calling Parse() after Finish() is wrong!
@@ -50,11 +64,11 @@ void NameValueParser::parse(const char * aData, size_t aSize)
 			case psKeySpace:
 			{
 				// Skip whitespace until a non-whitespace is found, then start the key:
-				while ((i < aSize) && (aData[i] <= ' '))
+				while ((i < aSize) && CharTables::isSpaceOrControl(aData[i]))
 				{
 					i++;
 				}
-				if ((i < aSize) && (aData[i] > ' '))
+				if (i < aSize)
 				{
 					mState = psKey;
 					Last = i;
@@ -75,7 +89,7 @@ void NameValueParser::parse(const char * aData, size_t aSize)
 						mState = psEqual;
 						break;
 					}
-					else if (aData[i] <= ' ')
+					else if (CharTables::isSpaceOrControl(aData[i]))
 					{
 						mCurrentKey.append(aData + Last, i - Last);
 						i++;
@@ -93,7 +107,7 @@ void NameValueParser::parse(const char * aData, size_t aSize)
 						mCurrentKey.append(aData + Last, i - Last);
 						i++;
 						Last = i;
-						(*this)[mCurrentKey] = "";
+						mSpareNodes.assign(*this, mCurrentKey, std::string_view());
 						mCurrentKey.clear();
 						mState = psKeySpace;
 						break;
@@ -136,12 +150,12 @@ void NameValueParser::parse(const char * aData, size_t aSize)
 						}
 						i++;
 						Last = i;
-						(*this)[mCurrentKey] = "";
+						mSpareNodes.assign(*this, mCurrentKey, std::string_view());
 						mCurrentKey.clear();
 						mState = psKeySpace;
 						break;
 					}
-					else if (aData[i] > ' ')
+					else if (!CharTables::isSpaceOrControl(aData[i]))
 					{
 						mState = psInvalid;
 						return;
@@ -165,7 +179,7 @@ void NameValueParser::parse(const char * aData, size_t aSize)
 						}
 						i++;
 						Last = i;
-						(*this)[mCurrentKey] = "";
+						mSpareNodes.assign(*this, mCurrentKey, std::string_view());
 						mCurrentKey.clear();
 						mState = psKeySpace;
 						break;
@@ -203,7 +217,7 @@ void NameValueParser::parse(const char * aData, size_t aSize)
 					if (aData[i] == '\"')
 					{
 						mCurrentValue.append(aData + Last, i - Last);
-						(*this)[mCurrentKey] = mCurrentValue;
+						mSpareNodes.assign(*this, mCurrentKey, mCurrentValue);
 						mCurrentKey.clear();
 						mCurrentValue.clear();
 						mState = psAfterValue;
@@ -227,7 +241,7 @@ void NameValueParser::parse(const char * aData, size_t aSize)
 					if (aData[i] == '\'')
 					{
 						mCurrentValue.append(aData + Last, i - Last);
-						(*this)[mCurrentKey] = mCurrentValue;
+						mSpareNodes.assign(*this, mCurrentKey, mCurrentValue);
 						mCurrentKey.clear();
 						mCurrentValue.clear();
 						mState = psAfterValue;
@@ -251,7 +265,7 @@ void NameValueParser::parse(const char * aData, size_t aSize)
 					if (aData[i] == ';')
 					{
 						mCurrentValue.append(aData + Last, i - Last);
-						(*this)[mCurrentKey] = mCurrentValue;
+						mSpareNodes.assign(*this, mCurrentKey, mCurrentValue);
 						mCurrentKey.clear();
 						mCurrentValue.clear();
 						mState = psKeySpace;
@@ -280,7 +294,7 @@ void NameValueParser::parse(const char * aData, size_t aSize)
 						Last = i;
 						break;
 					}
-					else if (aData[i] < ' ')
+					else if (CharTables::isControl(aData[i]))
 					{
 						i++;
 						continue;
@@ -316,7 +330,7 @@ bool NameValueParser::finish()
 		{
 			if ((mAllowsKeyOnly) && !mCurrentKey.empty())
 			{
-				(*this)[mCurrentKey] = "";
+				mSpareNodes.assign(*this, mCurrentKey, std::string_view());
 				mState = psFinished;
 				return true;
 			}
@@ -325,7 +339,7 @@ bool NameValueParser::finish()
 		}
 		case psValueRaw:
 		{
-			(*this)[mCurrentKey] = mCurrentValue;
+			mSpareNodes.assign(*this, mCurrentKey, mCurrentValue);
 			mState = psFinished;
 			return true;
 		}
@@ -2,6 +2,7 @@
 
 #include <string>
 #include <map>
+#include "MapNodePool.hpp"
 
 
 
@@ -26,6 +27,10 @@ public:
 	/** Creates an empty parser, then parses the data given. Doesn't call Finish(), so more data can be parsed later */
 	NameValueParser(const char * aData, size_t aSize, bool aAllowsKeyOnly = true);
 
+	/** Makes the parser forget everything parsed so far, including the values, so that it can be reused.
+	Keeps the map nodes and buffers grown so far, so that a reused parser doesn't allocate. */
+	void reset(bool aAllowsKeyOnly = true);
+
 	/** Parses the data given */
 	void parse(const char * aData, size_t aSize);
 
@@ -67,6 +72,9 @@ protected:
 
 	/** Buffer for the current Value; */
 	std::string mCurrentValue;
+
+	/** Map nodes kept for reuse after reset(). */
+	MapNodePool<std::map<std::string, std::string>> mSpareNodes;
 } ;
 
 
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <utility>
+
+
+
+
+
+namespace Http {
+
+
+
+
+
+/** Recycles objects of a single type within a thread, so that the buffers grown by the objects while
+processing one request are reused for the next one instead of being freed and reallocated.
+The pooled type T needs to provide:
+	- a constructor taking the arguments passed to acquire(),
+	- a reset() method taking the same arguments, reinitializing the object while keeping its buffers,
+	- a retainedMemory() method returning the (approximate) number of bytes held by the object.
+Each thread has its own pool for each type, so no locking is involved. An object is returned into the pool
+of the thread that releases it, which needn't be the thread that acquired it.
+The pool limits both the number of objects and the memory they retain; objects over the limits are
+destroyed when released. */
+template <typename T>
+class ObjectPool
+{
+public:
+
+	/** Statistics of a single pool. */
+	struct Stats
+	{
+		/** Number of acquire() calls that were satisfied by a recycled object. */
+		size_t mHits;
+
+		/** Number of acquire() calls that had to create a new object. */
+		size_t mMisses;
+
+		/** Number of released objects that were destroyed because the pool was at its limits. */
+		size_t mDiscards;
+
+		/** Number of objects currently kept in the pool. */
+		size_t mRetainedObjects;
+
+		/** Memory currently retained by the objects kept in the pool, as reported by their retainedMemory(). */
+		size_t mRetainedBytes;
+	};
+
+
+	/** The deleter used by Ptr, returns the object into the current thread's pool. */
+	class Releaser
+	{
+	public:
+		void operator () (T * aObject) const
+		{
+			ObjectPool::current().release(aObject);
+		}
+	};
+
+	typedef std::unique_ptr<T, Releaser> Ptr;
+
+
+	/** The default limit on the number of objects kept in a pool. */
+	static const size_t DEFAULT_MAX_OBJECTS = 64;
+
+	/** The default limit on the memory retained by the objects kept in a pool. */
+	static const size_t DEFAULT_MAX_BYTES = 4 * 1024 * 1024;
+
+
+	ObjectPool():
+		mMaxObjects(DEFAULT_MAX_OBJECTS),
+		mMaxBytes(DEFAULT_MAX_BYTES),
+		mStats()
+	{
+		mFree.reserve(mMaxObjects);
+	}
+
+	ObjectPool(const ObjectPool &) = delete;
+	ObjectPool & operator = (const ObjectPool &) = delete;
+
+	~ObjectPool()
+	{
+		clear();
+	}
+
+	/** Returns the pool for T belonging to the current thread.
+	Objects mustn't be released from within the thread-local destructors of the thread, once its pool is gone. */
+	static ObjectPool & current()
+	{
+		thread_local ObjectPool pool;
+		return pool;
+	}
+
+	/** Returns an object initialized with the specified arguments.
+	A recycled object is reinitialized through its reset(), a new one is created only if the pool is empty. */
+	template <typename... Args>
+	Ptr acquire(Args &&... aArgs)
+	{
+		if (mFree.empty())
+		{
+			mStats.mMisses += 1;
+			return Ptr(new T(std::forward<Args>(aArgs)...));
+		}
+		mStats.mHits += 1;
+		auto entry = mFree.back();
+		mFree.pop_back();
+		mStats.mRetainedObjects -= 1;
+		mStats.mRetainedBytes -= entry.second;
+		entry.first->reset(std::forward<Args>(aArgs)...);
+		return Ptr(entry.first);
+	}
+
+	/** Takes back an object. Keeps it for reuse if within the limits, destroys it otherwise.
+	Normally called through the Ptr deleter. */
+	void release(T * aObject)
+	{
+		if (aObject == nullptr)
+		{
+			return;
+		}
+		auto bytes = aObject->retainedMemory();
+		if ((mFree.size() >= mMaxObjects) || (mStats.mRetainedBytes + bytes > mMaxBytes))
+		{
+			mStats.mDiscards += 1;
+			delete aObject;
+			return;
+		}
+		mFree.emplace_back(aObject, bytes);
+		mStats.mRetainedObjects += 1;
+		mStats.mRetainedBytes += bytes;
+	}
+
+	/** Sets the limits on the number of objects and the memory kept in the pool.
+	Objects over the new limits are destroyed immediately. */
+	void setLimits(size_t aMaxObjects, size_t aMaxBytes)
+	{
+		mMaxObjects = aMaxObjects;
+		mMaxBytes = aMaxBytes;
+		while (!mFree.empty() && ((mFree.size() > mMaxObjects) || (mStats.mRetainedBytes > mMaxBytes)))
+		{
+			discardLast();
+		}
+		mFree.reserve(mMaxObjects);
+	}
+
+	/** Returns the statistics of this pool. */
+	const Stats & stats() const { return mStats; }
+
+	/** Destroys all the objects kept in the pool. */
+	void clear()
+	{
+		while (!mFree.empty())
+		{
+			discardLast();
+		}
+	}
+
+
+protected:
+
+	/** The objects ready for reuse, together with the memory they retained when released. */
+	std::vector<std::pair<T *, size_t>> mFree;
+
+	/** The maximum number of objects kept in mFree. */
+	size_t mMaxObjects;
+
+	/** The maximum memory retained by the objects kept in mFree. */
+	size_t mMaxBytes;
+
+	/** The statistics reported by stats(). */
+	Stats mStats;
+
+
+	/** Destroys the last object in mFree. */
+	void discardLast()
+	{
+		auto entry = mFree.back();
+		mFree.pop_back();
+		mStats.mRetainedObjects -= 1;
+		mStats.mRetainedBytes -= entry.second;
+		delete entry.first;
+	}
+};
+
+
+
+
+
+}  // namespace Http
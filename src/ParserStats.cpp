@@ -0,0 +1,226 @@
+#include "ParserStats.hpp"
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+
+
+
+
+namespace Http {
+
+
+
+
+
+// Registry of the per-thread instances:
+
+namespace {
+
+/** The instances created by forThread() for the live threads, and the totals of the finished threads. */
+class Registry
+{
+public:
+
+	void add(ParserStats * aStats)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mLive.push_back(aStats);
+	}
+
+	/** Removes the instance, keeping its values in the totals. */
+	void remove(ParserStats * aStats)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mRetired.add(aStats->snapshot());
+		mLive.erase(std::remove(mLive.begin(), mLive.end(), aStats), mLive.end());
+	}
+
+	ParserStats::Snapshot aggregate()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		auto res = mRetired;
+		for (auto stats: mLive)
+		{
+			res.add(stats->snapshot());
+		}
+		return res;
+	}
+
+
+protected:
+
+	std::mutex mMutex;
+	std::vector<ParserStats *> mLive;
+	ParserStats::Snapshot mRetired;
+};
+
+
+
+Registry & registry()
+{
+	// Intentionally leaked, so that it outlives the thread-local instances of all threads:
+	static Registry * res = new Registry;
+	return *res;
+}
+
+
+
+/** The per-thread instance, registered for its lifetime. */
+class ThreadStats:
+	public ParserStats
+{
+public:
+
+	ThreadStats()
+	{
+		registry().add(this);
+	}
+
+	~ThreadStats()
+	{
+		registry().remove(this);
+	}
+};
+
+}  // anonymous namespace
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// ParserStats::Snapshot:
+
+ParserStats::Snapshot::Snapshot():
+	mCounters(),
+	mHistograms()
+{
+}
+
+
+
+
+
+void ParserStats::Snapshot::add(const Snapshot & aOther)
+{
+	for (size_t i = 0; i < scCount; ++i)
+	{
+		mCounters[i] += aOther.mCounters[i];
+	}
+	for (size_t h = 0; h < shCount; ++h)
+	{
+		for (size_t b = 0; b < NUM_BUCKETS; ++b)
+		{
+			mHistograms[h][b] += aOther.mHistograms[h][b];
+		}
+	}
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// ParserStats:
+
+ParserStats::ParserStats()
+{
+	clear();
+}
+
+
+
+
+
+ParserStats::Snapshot ParserStats::snapshot() const
+{
+	Snapshot res;
+	for (size_t i = 0; i < scCount; ++i)
+	{
+		res.mCounters[i] = mCounters[i].load(std::memory_order_relaxed);
+	}
+	for (size_t h = 0; h < shCount; ++h)
+	{
+		for (size_t b = 0; b < NUM_BUCKETS; ++b)
+		{
+			res.mHistograms[h][b] = mHistograms[h][b].load(std::memory_order_relaxed);
+		}
+	}
+	return res;
+}
+
+
+
+
+
+void ParserStats::clear()
+{
+	for (auto & ctr: mCounters)
+	{
+		ctr.store(0, std::memory_order_relaxed);
+	}
+	for (auto & histogram: mHistograms)
+	{
+		for (auto & bucket: histogram)
+		{
+			bucket.store(0, std::memory_order_relaxed);
+		}
+	}
+}
+
+
+
+
+
+ParserStats & ParserStats::forThread()
+{
+	thread_local ThreadStats stats;
+	return stats;
+}
+
+
+
+
+
+ParserStats::Snapshot ParserStats::aggregate()
+{
+	return registry().aggregate();
+}
+
+
+
+
+
+uint64_t ParserStats::now()
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()
+	).count());
+}
+
+
+
+
+
+size_t ParserStats::bucketIndex(uint64_t aValue)
+{
+	#if defined(__GNUC__) || defined(__clang__)
+		size_t res = (aValue == 0) ? 0 : static_cast<size_t>(64 - __builtin_clzll(aValue));
+	#else
+		size_t res = 0;
+		while (aValue != 0)
+		{
+			aValue >>= 1;
+			res += 1;
+		}
+	#endif
+	return std::min(res, NUM_BUCKETS - 1);
+}
+
+
+
+
+
+}  // namespace Http
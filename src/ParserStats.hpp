@@ -0,0 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+
+
+
+
+/** The parsers update the statistics only if the library is compiled with HTTP_PARSER_STATS defined
+to a nonzero value (the LIBCPPHTTPPARSER_STATS CMake option); otherwise the statistics code compiles to
+nothing and the attached ParserStats objects stay empty. */
+#ifndef HTTP_PARSER_STATS
+	#define HTTP_PARSER_STATS 0
+#endif
+
+#if HTTP_PARSER_STATS
+	/** Expands to the code only if the statistics are enabled. */
+	#define HTTP_STATS_CODE(...) __VA_ARGS__
+#else
+	#define HTTP_STATS_CODE(...)
+#endif
+
+/** Calls the specified method on the stats object, if the statistics are enabled and the object is assigned. */
+#define HTTP_STATS(aStats, aCall) HTTP_STATS_CODE(do { if ((aStats) != nullptr) { (aStats)->aCall; } } while (false))
+
+
+
+
+
+namespace Http {
+
+
+
+
+
+/** Statistics collected by the parsers that have it attached (MessageParser, MultipartParser, FormParser).
+Counts the processed bytes per parsing phase, the buffering activity and records log2 histograms of the
+latencies and headers per message.
+An instance must only be updated by a single thread at a time, so that the counters can be updated without
+atomic read-modify-write operations; it may be read from any thread at any time. The usual setup is to
+attach the instance returned by forThread() to all parsers used by a thread, and to read the totals over
+all threads by aggregate(). */
+class ParserStats
+{
+public:
+
+	enum Counter
+	{
+		scMessages,           ///< MessageParser: messages fully parsed
+		scFirstLineBytes,     ///< MessageParser: bytes of the first lines
+		scHeaderBytes,        ///< MessageParser: bytes of the headers, including the terminating empty line
+		scBodyBytes,          ///< MessageParser: bytes of the bodies, before removing the transfer encoding
+		scHeaders,            ///< MessageParser: header lines
+		scMultipartBytes,     ///< MultipartParser: bytes parsed
+		scMultipartParts,     ///< MultipartParser: parts started
+		scFormBytes,          ///< FormParser: bytes parsed
+		scFormFields,         ///< FormParser: simple (non-file) values parsed
+		scBufferedBytes,      ///< All: bytes copied into the parsers' internal buffers
+		scBufferCompactions,  ///< All: times the parsed data was removed from the front of an internal buffer
+		scBufferAllocations,  ///< All: times an internal buffer had to grow its capacity
+		scErrors,             ///< All: parsing errors
+		scCount,              ///< The number of counters; not a counter
+	};
+
+	enum Histogram
+	{
+		shHeadersLatency,    ///< MessageParser: ns from the first byte of a message to the end of its headers
+		shBodyLatency,       ///< MessageParser: ns from the first byte of a message to the end of its body
+		shHeadersPerMessage, ///< MessageParser: header lines per message
+		shCount,             ///< The number of histograms; not a histogram
+	};
+
+	/** The number of buckets in each histogram. Bucket 0 counts zero values, bucket i counts values in the
+	range [2^(i-1), 2^i), the last bucket also counts all larger values. */
+	static const size_t NUM_BUCKETS = 48;
+
+
+	/** A plain copy of the statistics, used for reading and aggregating. */
+	struct Snapshot
+	{
+		uint64_t mCounters[scCount];
+		uint64_t mHistograms[shCount][NUM_BUCKETS];
+
+		/** Creates a snapshot with all values zero. */
+		Snapshot();
+
+		/** Adds all values from the other snapshot to this one. */
+		void add(const Snapshot & aOther);
+	};
+
+
+	ParserStats();
+
+	ParserStats(const ParserStats &) = delete;
+	ParserStats & operator = (const ParserStats &) = delete;
+
+	/** Adds the value to the counter. */
+	void add(Counter aCounter, uint64_t aValue)
+	{
+		auto & ctr = mCounters[aCounter];
+		ctr.store(ctr.load(std::memory_order_relaxed) + aValue, std::memory_order_relaxed);
+	}
+
+	/** Records that aBytes were copied into a buffer whose capacity changed from aOldCapacity to aNewCapacity. */
+	void addBuffered(size_t aBytes, size_t aOldCapacity, size_t aNewCapacity)
+	{
+		add(scBufferedBytes, aBytes);
+		if (aNewCapacity != aOldCapacity)
+		{
+			add(scBufferAllocations, 1);
+		}
+	}
+
+	/** Records the value into the histogram. */
+	void record(Histogram aHistogram, uint64_t aValue)
+	{
+		auto & bucket = mHistograms[aHistogram][bucketIndex(aValue)];
+		bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	/** Returns the current value of the counter. */
+	uint64_t counter(Counter aCounter) const { return mCounters[aCounter].load(std::memory_order_relaxed); }
+
+	/** Returns a copy of all the current values. */
+	Snapshot snapshot() const;
+
+	/** Sets all values to zero. Must be called by the thread updating the instance. */
+	void clear();
+
+	/** Returns the instance belonging to the current thread, to be attached to the parsers used by the thread.
+	The instance is included in aggregate() for as long as the thread lives, and its values are kept in the
+	totals afterwards. */
+	static ParserStats & forThread();
+
+	/** Returns the sum of the statistics of all threads, current and finished, that have used forThread(). */
+	static Snapshot aggregate();
+
+	/** Returns the current time in nanoseconds, from a monotonic clock. Used for the latency histograms. */
+	static uint64_t now();
+
+	/** Returns the histogram bucket for the value. */
+	static size_t bucketIndex(uint64_t aValue);
+
+
+protected:
+
+	std::atomic<uint64_t> mCounters[scCount];
+	std::atomic<uint64_t> mHistograms[shCount][NUM_BUCKETS];
+};
+
+
+
+
+
+}  // namespace Http
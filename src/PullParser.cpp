@@ -0,0 +1,494 @@
+#include "PullParser.hpp"
+#include <algorithm>
+#include <cstring>
+#include "CharTables.hpp"
+#include "Utils.hpp"
+
+
+
+
+
+namespace Http {
+
+
+
+
+
+PullParser::PullParser():
+	mState(psFirstLine),
+	mInput(nullptr),
+	mInputSize(0),
+	mInputPos(0),
+	mLineBufferReported(false),
+	mHasPendingHeader(false),
+	mIsChunked(false),
+	mBodyLeft(0)
+{
+}
+
+
+
+
+
+void PullParser::setInput(const char * aData, size_t aSize)
+{
+	mInput = aData;
+	mInputSize = aSize;
+	mInputPos = 0;
+}
+
+
+
+
+
+PullParser::Event PullParser::next()
+{
+	switch (mState)
+	{
+		case psFirstLine:
+		{
+			// Skip any empty lines before the first line (RFC 7230, section 3.5):
+			std::string_view line;
+			do
+			{
+				if (!readLine(line))
+				{
+					return event(etNeedMoreData);
+				}
+				if (mState == psError)
+				{
+					return event(etError, mError);
+				}
+			} while (line.empty());
+			mState = psHeaders;
+			mHasPendingHeader = false;
+			mIsChunked = false;
+			mBodyLeft = 0;
+			return event(etFirstLine, line);
+		}
+
+		case psHeaders:
+		{
+			return nextHeader();
+		}
+
+		case psIdentityBody:
+		{
+			return nextBodyData(psMessageEnd);
+		}
+
+		case psChunkLength:
+		case psChunkData:
+		case psChunkDataCRLF:
+		case psTrailer:
+		{
+			return nextChunked();
+		}
+
+		case psMessageEnd:
+		{
+			mState = psFirstLine;
+			return event(etMessageEnd);
+		}
+
+		case psError:
+		{
+			return event(etError, mError);
+		}
+	}
+	return error("Invalid parser state");
+}
+
+
+
+
+
+void PullParser::reset()
+{
+	mState = psFirstLine;
+	mInput = nullptr;
+	mInputSize = 0;
+	mInputPos = 0;
+	mLineBuffer.clear();
+	mLineBufferReported = false;
+	mHasPendingHeader = false;
+	mIsChunked = false;
+	mBodyLeft = 0;
+	mError.clear();
+}
+
+
+
+
+
+bool PullParser::readLine(std::string_view & aLine)
+{
+	if (mLineBufferReported)
+	{
+		mLineBuffer.clear();
+		mLineBufferReported = false;
+	}
+
+	auto data = mInput + mInputPos;
+	auto size = mInputSize - mInputPos;
+	auto lf = (size > 0) ? static_cast<const char *>(memchr(data, '\n', size)) : nullptr;
+	if (lf == nullptr)
+	{
+		// Not a complete line yet, keep the start of the line until more data arrives:
+		mLineBuffer.append(data, size);
+		mInputPos = mInputSize;
+		return false;
+	}
+	auto lineSize = static_cast<size_t>(lf - data);
+	mInputPos += lineSize + 1;
+	if (mLineBuffer.empty())
+	{
+		aLine = std::string_view(data, lineSize);
+	}
+	else
+	{
+		mLineBuffer.append(data, lineSize);
+		mLineBufferReported = true;
+		aLine = mLineBuffer;
+	}
+	if (aLine.empty() || (aLine.back() != '\r'))
+	{
+		aLine = std::string_view();
+		error("Line not terminated by CRLF");
+		return true;
+	}
+	aLine.remove_suffix(1);
+	return true;
+}
+
+
+
+
+
+bool PullParser::peekNextLine(char & aFirstChar) const
+{
+	if (!mLineBuffer.empty() && !mLineBufferReported)
+	{
+		// The next line has already been started in the previous input:
+		aFirstChar = mLineBuffer[0];
+		return true;
+	}
+	if (mInputPos < mInputSize)
+	{
+		aFirstChar = mInput[mInputPos];
+		return true;
+	}
+	return false;
+}
+
+
+
+
+
+bool PullParser::splitHeader(std::string_view aLine, std::string_view & aKey, std::string_view & aValue)
+{
+	auto idxColon = aLine.find(':');
+	if ((idxColon == std::string_view::npos) || (idxColon == 0))
+	{
+		return false;
+	}
+	aKey = aLine.substr(0, idxColon);
+	for (auto ch: aKey)
+	{
+		if (!CharTables::isTChar(ch))
+		{
+			return false;
+		}
+	}
+	aValue = Utils::trimOws(aLine.substr(idxColon + 1));
+	return true;
+}
+
+
+
+
+
+bool PullParser::processHeader(std::string_view aKey, std::string_view aValue)
+{
+	if (Utils::noCaseEqual(aKey, "content-length"))
+	{
+		if (!Utils::stringToInteger(aValue, mBodyLeft))
+		{
+			error(Utils::printf("Invalid content length header value: \"%s\"", std::string(aValue).c_str()));
+			return false;
+		}
+		return true;
+	}
+	if (Utils::noCaseEqual(aKey, "transfer-encoding"))
+	{
+		if (Utils::noCaseEqual(aValue, "chunked"))
+		{
+			mIsChunked = true;
+		}
+		else if (Utils::noCaseEqual(aValue, "identity"))
+		{
+			mIsChunked = false;
+		}
+		else
+		{
+			error(Utils::printf("Unknown transfer encoding: %s", std::string(aValue).c_str()));
+			return false;
+		}
+	}
+	return true;
+}
+
+
+
+
+
+PullParser::Event PullParser::nextHeader()
+{
+	for (;;)
+	{
+		if (mHasPendingHeader)
+		{
+			// The header is reported once the next line is known not to be its continuation:
+			char nextLineStart;
+			if (!peekNextLine(nextLineStart))
+			{
+				return event(etNeedMoreData);
+			}
+			if (CharTables::isWhitespace(nextLineStart))
+			{
+				// obs-fold, replace with a single SP (RFC 7230, section 3.2.4):
+				std::string_view line;
+				if (!readLine(line))
+				{
+					return event(etNeedMoreData);
+				}
+				if (mState == psError)
+				{
+					return event(etError, mError);
+				}
+				line = Utils::trimOws(line);
+				if (!line.empty())
+				{
+					if (!mPendingValue.empty())
+					{
+						mPendingValue.push_back(' ');
+					}
+					mPendingValue.append(line);
+				}
+				continue;
+			}
+			mHasPendingHeader = false;
+			if (!processHeader(mPendingKey, mPendingValue))
+			{
+				return event(etError, mError);
+			}
+			return Event{etHeader, mPendingKey, mPendingValue};
+		}
+
+		std::string_view line;
+		if (!readLine(line))
+		{
+			return event(etNeedMoreData);
+		}
+		if (mState == psError)
+		{
+			return event(etError, mError);
+		}
+		if (line.empty())
+		{
+			// End of headers, decide how the body is to be parsed:
+			if (mIsChunked)
+			{
+				mState = psChunkLength;
+			}
+			else
+			{
+				mState = (mBodyLeft > 0) ? psIdentityBody : psMessageEnd;
+			}
+			return event(etHeadersFinished);
+		}
+		if (CharTables::isWhitespace(line[0]))
+		{
+			return error("Continuation line without a preceding header");
+		}
+		std::string_view key, value;
+		if (!splitHeader(line, key, value))
+		{
+			return error(Utils::printf("Invalid header line: \"%s\"", std::string(line).c_str()));
+		}
+		char nextLineStart;
+		if (peekNextLine(nextLineStart) && !CharTables::isWhitespace(nextLineStart))
+		{
+			// The next line is not a continuation, report the header directly from the input:
+			if (!processHeader(key, value))
+			{
+				return event(etError, mError);
+			}
+			return Event{etHeader, key, value};
+		}
+
+		// The next line is a continuation, or it's not known yet; keep the header until it is known:
+		mPendingKey.assign(key);
+		mPendingValue.assign(value);
+		mHasPendingHeader = true;
+	}
+}
+
+
+
+
+
+PullParser::Event PullParser::nextChunked()
+{
+	for (;;)
+	{
+		switch (mState)
+		{
+			case psChunkLength:
+			{
+				std::string_view line;
+				if (!readLine(line))
+				{
+					return event(etNeedMoreData);
+				}
+				if ((mState == psError) || !parseChunkLength(line))
+				{
+					return event(etError, mError);
+				}
+				continue;
+			}
+
+			case psChunkData:
+			{
+				return nextBodyData(psChunkDataCRLF);
+			}
+
+			case psChunkDataCRLF:
+			{
+				std::string_view line;
+				if (!readLine(line))
+				{
+					return event(etNeedMoreData);
+				}
+				if (mState == psError)
+				{
+					return event(etError, mError);
+				}
+				if (!line.empty())
+				{
+					return error("Invalid data past chunk data");
+				}
+				mState = psChunkLength;
+				continue;
+			}
+
+			case psTrailer:
+			{
+				std::string_view line;
+				if (!readLine(line))
+				{
+					return event(etNeedMoreData);
+				}
+				if (mState == psError)
+				{
+					return event(etError, mError);
+				}
+				if (line.empty())
+				{
+					mState = psFirstLine;
+					return event(etMessageEnd);
+				}
+				std::string_view key, value;
+				if (!splitHeader(line, key, value))
+				{
+					return error(Utils::printf("Invalid trailer line: \"%s\"", std::string(line).c_str()));
+				}
+				return Event{etTrailer, key, value};
+			}
+
+			default:
+			{
+				return error("Invalid parser state");
+			}
+		}
+	}
+}
+
+
+
+
+
+bool PullParser::parseChunkLength(std::string_view aLine)
+{
+	// Expected input: <hexnumber>[BWS;<extension>], the extensions are ignored
+	size_t value = 0;
+	auto numDigits = Utils::accumulateHexDigits(aLine.data(), aLine.size(), value);
+	if (numDigits == std::string::npos)
+	{
+		error("Chunk length is too large");
+		return false;
+	}
+	if (numDigits == 0)
+	{
+		error("Missing chunk length");
+		return false;
+	}
+	auto extension = Utils::trimOws(aLine.substr(numDigits));
+	if (!extension.empty())
+	{
+		if (extension[0] != ';')
+		{
+			error(Utils::printf("Invalid character in chunk length line: 0x%x", static_cast<unsigned char>(extension[0])));
+			return false;
+		}
+		for (auto ch: extension)
+		{
+			if (CharTables::isControl(ch) && !CharTables::isWhitespace(ch))
+			{
+				error(Utils::printf("Invalid character in chunk length line: 0x%x", static_cast<unsigned char>(ch)));
+				return false;
+			}
+		}
+	}
+	mBodyLeft = value;
+	mState = (value == 0) ? psTrailer : psChunkData;
+	return true;
+}
+
+
+
+
+
+PullParser::Event PullParser::nextBodyData(eState aNextState)
+{
+	auto size = std::min(mInputSize - mInputPos, mBodyLeft);
+	if (size == 0)
+	{
+		return event(etNeedMoreData);
+	}
+	auto res = event(etBodyData, std::string_view(mInput + mInputPos, size));
+	mInputPos += size;
+	mBodyLeft -= size;
+	if (mBodyLeft == 0)
+	{
+		mState = aNextState;
+	}
+	return res;
+}
+
+
+
+
+
+PullParser::Event PullParser::error(std::string aDescription)
+{
+	mState = psError;
+	mError = std::move(aDescription);
+	return event(etError, mError);
+}
+
+
+
+
+
+}  // namespace Http
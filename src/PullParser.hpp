@@ -0,0 +1,290 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+	#if __has_include(<coroutine>)
+		#include <coroutine>
+		#include <iterator>
+		#define HTTP_PULL_PARSER_COROUTINES 1
+	#endif
+#endif
+#ifndef HTTP_PULL_PARSER_COROUTINES
+	#define HTTP_PULL_PARSER_COROUTINES 0
+#endif
+
+
+
+
+
+namespace Http {
+
+
+
+
+
+/** Parses HTTP messages (request or response) in the pull style, as an alternative to MessageParser's callbacks.
+The caller supplies the incoming data by setInput(), then repeatedly calls next() to get the individual events,
+until it returns etNeedMoreData, upon which the next piece of data is to be supplied.
+The events hold views into the input data, so the body data is never copied. Only the lines that are split
+across two inputs, and the headers whose continuation (obs-fold) lines are not yet known, are copied into the
+parser's internal buffers, so the views stay valid only until the following call to next() or setInput().
+No virtual calls are made, so a consumer can process the events in a tight loop.
+The bodies may use the identity (with Content-Length) or the chunked transfer encoding. After the end of a
+message, the parser continues with the next message in the input (pipelining). */
+class PullParser
+{
+public:
+
+	enum EventType
+	{
+		etNeedMoreData,     ///< All the input has been consumed, supply more by setInput()
+		etFirstLine,        ///< mValue is the first line of the message (request line or status line)
+		etHeader,           ///< mKey and mValue are the name and value of a header
+		etHeadersFinished,  ///< All the headers have been reported
+		etBodyData,         ///< mValue is a part of the body, after removing the transfer encoding
+		etTrailer,          ///< mKey and mValue are the name and value of a chunked body's trailer field
+		etMessageEnd,       ///< The message is complete, the next message may follow
+		etError,            ///< mValue is the description of the error; the parser stays in the error state
+	};
+
+
+	/** A single parsed event. */
+	struct Event
+	{
+		EventType mType;
+
+		/** The name of the header or the trailer field; empty for the other event types. */
+		std::string_view mKey;
+
+		/** The first line, header value, body data or error description, depending on mType. */
+		std::string_view mValue;
+	};
+
+
+	PullParser();
+
+	/** Supplies the next part of the incoming data, to be parsed by the following calls to next().
+	Must only be called before the first call to next() or after next() has returned etNeedMoreData.
+	The data must stay valid until next() returns etNeedMoreData again. */
+	void setInput(const char * aData, size_t aSize);
+
+	/** Parses the input up to the next event and returns it. */
+	Event next();
+
+	/** Resets the parser to the initial state, so that a new stream can be parsed.
+	Keeps the buffers grown so far. */
+	void reset();
+
+	/** Returns the number of bytes of the current input consumed so far.
+	Useful after etMessageEnd, if the rest of the input is not HTTP (such as after a protocol upgrade). */
+	size_t inputConsumed() const { return mInputPos; }
+
+	/** Returns true if the parser is between messages (nothing of the next message has been parsed yet). */
+	bool isBetweenMessages() const { return (mState == psFirstLine) && (mLineBuffer.empty() || mLineBufferReported); }
+
+	#if HTTP_PULL_PARSER_COROUTINES
+		class Generator;
+
+		/** Returns a generator of the events for the current input, ending when more data is needed
+		(etNeedMoreData is not yielded). An etError event is yielded once and ends the generator as well. */
+		inline Generator events();
+	#endif
+
+
+protected:
+
+	enum eState
+	{
+		psFirstLine,       ///< Parsing the first line, skipping any empty lines before it
+		psHeaders,         ///< Parsing the header lines
+		psIdentityBody,    ///< Relaying the body of a known length
+		psChunkLength,     ///< Parsing the chunk length line
+		psChunkData,       ///< Relaying the chunk data
+		psChunkDataCRLF,   ///< Expecting the CRLF after the chunk data
+		psTrailer,         ///< Parsing the trailer fields after the last chunk
+		psMessageEnd,      ///< The body has been fully reported, the end of the message is to be reported
+		psError,           ///< An error has occurred, stuck until reset()
+	};
+
+	/** The current state of the parser. */
+	eState mState;
+
+	/** The input supplied by setInput(). */
+	const char * mInput;
+
+	/** The size of the input supplied by setInput(). */
+	size_t mInputSize;
+
+	/** The number of bytes of the input consumed so far. */
+	size_t mInputPos;
+
+	/** The beginning of a line that was split across inputs. */
+	std::string mLineBuffer;
+
+	/** Set when mLineBuffer holds a complete line that has already been reported, to be cleared by the next call. */
+	bool mLineBufferReported;
+
+	/** The header whose continuation lines (obs-fold) are being looked for, copied out of the input.
+	Only valid if mHasPendingHeader is set. */
+	std::string mPendingKey;
+	std::string mPendingValue;
+
+	/** Set if mPendingKey and mPendingValue hold a header that hasn't been reported yet. */
+	bool mHasPendingHeader;
+
+	/** Set if the message uses the chunked transfer encoding. */
+	bool mIsChunked;
+
+	/** The body length still to be reported, from the Content-Length header, or the current chunk. */
+	size_t mBodyLeft;
+
+	/** The description of the error, if in psError. */
+	std::string mError;
+
+
+	/** Reads the next complete line (excluding the CRLF) from the input into aLine.
+	Returns false if the line is not complete yet, the partial line is then kept in mLineBuffer.
+	If the line isn't properly terminated by CRLF, sets the error state and returns true (the caller checks mState). */
+	bool readLine(std::string_view & aLine);
+
+	/** Stores the first character of the next line into aFirstChar.
+	Returns false if not known yet (no more data). */
+	bool peekNextLine(char & aFirstChar) const;
+
+	/** Parses the header line, coming after the first line or after the last chunk, into the key and value.
+	Returns false if the line is not a valid header. */
+	static bool splitHeader(std::string_view aLine, std::string_view & aKey, std::string_view & aValue);
+
+	/** Processes a header that is about to be reported, noting the transfer encoding and content length.
+	Returns false if the header value is invalid (and an error has been set). */
+	bool processHeader(std::string_view aKey, std::string_view aValue);
+
+	/** Parses the header lines, returning the next event. */
+	Event nextHeader();
+
+	/** Parses the chunked body's framing, returning the next event. */
+	Event nextChunked();
+
+	/** Parses the chunk length line, setting the state to psChunkData or psTrailer.
+	Returns false if the line is invalid (and an error has been set). */
+	bool parseChunkLength(std::string_view aLine);
+
+	/** Reports the next part of the body data from the input, of at most mBodyLeft bytes.
+	Once all the data has been reported, switches to aNextState. */
+	Event nextBodyData(eState aNextState);
+
+	/** Puts the parser into the error state and returns the error event. */
+	Event error(std::string aDescription);
+
+	/** Returns the event of the specified type with no views. */
+	static Event event(EventType aType) { return Event{aType, std::string_view(), std::string_view()}; }
+
+	/** Returns the event of the specified type with the specified value view. */
+	static Event event(EventType aType, std::string_view aValue) { return Event{aType, std::string_view(), aValue}; }
+};
+
+
+
+
+
+#if HTTP_PULL_PARSER_COROUTINES
+
+/** A C++20 generator of the PullParser events for the current input, returned by PullParser::events().
+Usable in range-based for loops. */
+class PullParser::Generator
+{
+public:
+
+	struct promise_type
+	{
+		const Event * mCurrent = nullptr;
+
+		Generator get_return_object() { return Generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		std::suspend_always yield_value(const Event & aEvent) noexcept
+		{
+			mCurrent = &aEvent;
+			return {};
+		}
+		void return_void() {}
+		void unhandled_exception() { throw; }
+	};
+
+
+	class iterator
+	{
+	public:
+		explicit iterator(std::coroutine_handle<promise_type> aHandle): mHandle(aHandle) {}
+		const Event & operator * () const { return *mHandle.promise().mCurrent; }
+		const Event * operator -> () const { return mHandle.promise().mCurrent; }
+		iterator & operator ++ ()
+		{
+			mHandle.resume();
+			return *this;
+		}
+		bool operator == (std::default_sentinel_t) const { return mHandle.done(); }
+		bool operator != (std::default_sentinel_t) const { return !mHandle.done(); }
+
+	protected:
+		std::coroutine_handle<promise_type> mHandle;
+	};
+
+
+	explicit Generator(std::coroutine_handle<promise_type> aHandle): mHandle(aHandle) {}
+	Generator(Generator && aOther) noexcept: mHandle(aOther.mHandle) { aOther.mHandle = nullptr; }
+	Generator(const Generator &) = delete;
+	Generator & operator = (const Generator &) = delete;
+	Generator & operator = (Generator &&) = delete;
+
+	~Generator()
+	{
+		if (mHandle)
+		{
+			mHandle.destroy();
+		}
+	}
+
+	iterator begin()
+	{
+		mHandle.resume();
+		return iterator(mHandle);
+	}
+
+	std::default_sentinel_t end() { return std::default_sentinel; }
+
+
+protected:
+	std::coroutine_handle<promise_type> mHandle;
+};
+
+
+
+
+
+PullParser::Generator PullParser::events()
+{
+	for (;;)
+	{
+		auto evt = next();
+		if (evt.mType == etNeedMoreData)
+		{
+			co_return;
+		}
+		co_yield evt;
+		if (evt.mType == etError)
+		{
+			co_return;
+		}
+	}
+}
+
+#endif  // HTTP_PULL_PARSER_COROUTINES
+
+
+
+
+
+}  // namespace Http
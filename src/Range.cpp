@@ -0,0 +1,439 @@
+#include "Range.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include "Utils.hpp"
+
+
+
+
+
+namespace Http {
+
+
+
+
+
+// Range parsing helpers:
+
+namespace {
+
+/** Parses the run of decimal digits into aValue. Returns false if empty, not all digits, or too large. */
+bool parseRangeNumber(std::string_view aDigits, uint64_t & aValue)
+{
+	return (!aDigits.empty() && Utils::parseDecimalDigits(aDigits, aValue));
+}
+
+
+
+/** Appends the "bytes <first>-<last>/<length>" Content-Range value to aDest. */
+void appendContentRange(std::string & aDest, const ByteRange & aRange, uint64_t aResourceLength)
+{
+	char number[Utils::MAX_NUMBER_CHARS];
+	aDest.append("bytes ");
+	aDest.append(number, Utils::formatNumber(number, aRange.mOffset));
+	aDest.push_back('-');
+	aDest.append(number, Utils::formatNumber(number, aRange.last()));
+	aDest.push_back('/');
+	aDest.append(number, Utils::formatNumber(number, aResourceLength));
+}
+
+}  // anonymous namespace
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// RangeSet:
+
+RangeSet::RangeSet(size_t aMaxRanges):
+	mMaxRanges(aMaxRanges),
+	mStatus(rsWholeResource),
+	mResourceLength(0)
+{
+}
+
+
+
+
+
+RangeSet::Status RangeSet::parse(std::string_view aRangeHeader, uint64_t aResourceLength)
+{
+	mRanges.clear();
+	mResourceLength = aResourceLength;
+
+	// Only the bytes unit is known (RFC 7233 @ 2.1):
+	auto value = Utils::trimOws(aRangeHeader);
+	if ((value.size() < 6) || !Utils::noCaseEqual(value.substr(0, 6), "bytes="))
+	{
+		return finish(rsWholeResource);
+	}
+	value.remove_prefix(6);
+
+	size_t numSpecs = 0;
+	std::string_view spec;
+	while (Utils::nextListElement(value, spec))
+	{
+		if ((++numSpecs > mMaxRanges) || !addRangeSpec(spec))
+		{
+			return finish(rsWholeResource);
+		}
+	}
+	if (numSpecs == 0)
+	{
+		return finish(rsWholeResource);
+	}
+	if (mRanges.empty())
+	{
+		return finish(rsUnsatisfiable);
+	}
+	merge();
+	mStatus = rsPartial;
+	return mStatus;
+}
+
+
+
+
+
+uint64_t RangeSet::totalLength() const
+{
+	uint64_t res = 0;
+	for (const auto & range: mRanges)
+	{
+		res += range.mLength;
+	}
+	return res;
+}
+
+
+
+
+
+bool RangeSet::addRangeSpec(std::string_view aSpec)
+{
+	auto idxDash = aSpec.find('-');
+	if (idxDash == std::string_view::npos)
+	{
+		return false;
+	}
+	auto firstText = aSpec.substr(0, idxDash);
+	auto lastText = aSpec.substr(idxDash + 1);
+	if (firstText.empty())
+	{
+		// suffix-byte-range-spec: the last N bytes:
+		uint64_t suffixLength;
+		if (!parseRangeNumber(lastText, suffixLength))
+		{
+			return false;
+		}
+		if ((suffixLength > 0) && (mResourceLength > 0))
+		{
+			auto length = std::min(suffixLength, mResourceLength);
+			mRanges.push_back({mResourceLength - length, length});
+		}
+		return true;
+	}
+
+	// byte-range-spec: first-[last]:
+	uint64_t first, last = UINT64_MAX;
+	if (!parseRangeNumber(firstText, first))
+	{
+		return false;
+	}
+	if (!lastText.empty())
+	{
+		if (!parseRangeNumber(lastText, last) || (last < first))
+		{
+			return false;
+		}
+	}
+	if (first >= mResourceLength)
+	{
+		// Valid, but not satisfiable:
+		return true;
+	}
+	last = std::min(last, mResourceLength - 1);
+	mRanges.push_back({first, last - first + 1});
+	return true;
+}
+
+
+
+
+
+void RangeSet::merge()
+{
+	if (mRanges.size() < 2)
+	{
+		return;
+	}
+	auto byOffset = [](const ByteRange & aRange1, const ByteRange & aRange2)
+	{
+		return (aRange1.mOffset < aRange2.mOffset);
+	};
+	if (!std::is_sorted(mRanges.begin(), mRanges.end(), byOffset))
+	{
+		mergeUnsorted();
+		return;
+	}
+
+	// The ranges in the ascending order (the common case) are merged in a single pass:
+	size_t numMerged = 0;
+	for (size_t i = 1, count = mRanges.size(); i < count; ++i)
+	{
+		auto & last = mRanges[numMerged];
+		const auto & range = mRanges[i];
+		auto lastEnd = last.mOffset + last.mLength;
+		if (range.mOffset <= lastEnd)
+		{
+			// Overlapping or adjacent, extend the last range:
+			last.mLength = std::max(lastEnd, range.mOffset + range.mLength) - last.mOffset;
+		}
+		else
+		{
+			mRanges[++numMerged] = range;
+		}
+	}
+	mRanges.resize(numMerged + 1);
+}
+
+
+
+
+
+void RangeSet::mergeUnsorted()
+{
+	// Merge the pairs until there's none left to merge, as a merged range may reach the ones it didn't before.
+	// Quadratic, but the number of ranges is limited by mMaxRanges:
+	bool hasMerged = true;
+	while (hasMerged)
+	{
+		hasMerged = false;
+		for (size_t i = 0; i < mRanges.size(); ++i)
+		{
+			auto & range = mRanges[i];
+			for (size_t j = i + 1; j < mRanges.size();)
+			{
+				const auto & other = mRanges[j];
+				auto rangeEnd = range.mOffset + range.mLength;
+				auto otherEnd = other.mOffset + other.mLength;
+				if ((other.mOffset <= rangeEnd) && (range.mOffset <= otherEnd))
+				{
+					// Overlapping or adjacent, extend the earlier range over the later one:
+					auto offset = std::min(range.mOffset, other.mOffset);
+					range.mLength = std::max(rangeEnd, otherEnd) - offset;
+					range.mOffset = offset;
+					mRanges.erase(mRanges.begin() + static_cast<std::ptrdiff_t>(j));
+					hasMerged = true;
+				}
+				else
+				{
+					++j;
+				}
+			}
+		}
+	}
+}
+
+
+
+
+
+RangeSet::Status RangeSet::finish(Status aStatus)
+{
+	mRanges.clear();
+	mStatus = aStatus;
+	return aStatus;
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// RangeResponse:
+
+RangeResponse::RangeResponse():
+	mStatusCode(0),
+	mHeadSize(0),
+	mBodySize(0)
+{
+}
+
+
+
+
+
+void RangeResponse::plan(OutgoingResponse & aResponse, const RangeSet & aRanges)
+{
+	mBuffer.clear();
+	mSegments.clear();
+	mMemoryOffsets.clear();
+	auto resourceLength = aRanges.resourceLength();
+	aResponse.removeHeader("Content-Range");
+	aResponse.removeHeader("Accept-Ranges");
+	aResponse.addHeader("Accept-Ranges", "bytes");
+
+	switch (aRanges.status())
+	{
+		case RangeSet::rsWholeResource:
+		{
+			mStatusCode = 200;
+			mBodySize = resourceLength;
+			break;
+		}
+		case RangeSet::rsUnsatisfiable:
+		{
+			mStatusCode = 416;
+			mBodySize = 0;
+			char number[Utils::MAX_NUMBER_CHARS];
+			std::string contentRange("bytes */");
+			contentRange.append(number, Utils::formatNumber(number, resourceLength));
+			aResponse.addHeader("Content-Range", contentRange);
+			break;
+		}
+		case RangeSet::rsPartial:
+		{
+			mStatusCode = 206;
+			if (aRanges.size() == 1)
+			{
+				mBodySize = aRanges[0].mLength;
+				std::string contentRange;
+				appendContentRange(contentRange, aRanges[0], resourceLength);
+				aResponse.addHeader("Content-Range", contentRange);
+			}
+			break;
+		}
+	}
+
+	if ((mStatusCode != 206) || (aRanges.size() == 1))
+	{
+		// The body, if any, is a single segment of the resource:
+		aResponse.setContentLength(static_cast<size_t>(mBodySize));
+		addMemorySegment(aResponse.serialize(mStatusCode));
+		mHeadSize = mBuffer.size();
+		if (mStatusCode == 206)
+		{
+			addResourceSegment(aRanges[0].mOffset, aRanges[0].mLength);
+		}
+		else if (mBodySize > 0)
+		{
+			addResourceSegment(0, mBodySize);
+		}
+		resolveMemorySegments();
+		return;
+	}
+
+	// Multiple ranges, each in its own part of a multipart/byteranges body (RFC 7233 @ 4.1).
+	// The framing is built first, so that the Content-Length is known when serializing the head:
+	char boundary[BOUNDARY_LENGTH];
+	newBoundary(boundary);
+	std::string_view boundaryView(boundary, BOUNDARY_LENGTH);
+	std::string partContentType = aResponse.contentType();
+	std::string framing;
+	std::vector<size_t> partHeaderEnds;
+	partHeaderEnds.reserve(aRanges.size());
+	mBodySize = 0;
+	for (const auto & range: aRanges)
+	{
+		framing.append("\r\n--");
+		framing.append(boundaryView);
+		framing.append("\r\n");
+		if (!partContentType.empty())
+		{
+			framing.append("Content-Type: ");
+			framing.append(partContentType);
+			framing.append("\r\n");
+		}
+		framing.append("Content-Range: ");
+		appendContentRange(framing, range, resourceLength);
+		framing.append("\r\n\r\n");
+		partHeaderEnds.push_back(framing.size());
+		mBodySize += range.mLength;
+	}
+	framing.append("\r\n--");
+	framing.append(boundaryView);
+	framing.append("--\r\n");
+	mBodySize += framing.size();
+
+	std::string contentType("multipart/byteranges; boundary=");
+	contentType.append(boundaryView);
+	aResponse.setContentType(contentType);
+	aResponse.setContentLength(static_cast<size_t>(mBodySize));
+	addMemorySegment(aResponse.serialize(206));
+	mHeadSize = mBuffer.size();
+	size_t partStart = 0;
+	for (size_t i = 0, count = aRanges.size(); i < count; ++i)
+	{
+		addMemorySegment(std::string_view(framing).substr(partStart, partHeaderEnds[i] - partStart));
+		addResourceSegment(aRanges[i].mOffset, aRanges[i].mLength);
+		partStart = partHeaderEnds[i];
+	}
+	addMemorySegment(std::string_view(framing).substr(partStart));
+	resolveMemorySegments();
+}
+
+
+
+
+
+void RangeResponse::addMemorySegment(std::string_view aText)
+{
+	mMemoryOffsets.push_back(mBuffer.size());
+	mBuffer.append(aText);
+	mSegments.push_back({mBuffer.data(), 0, aText.size()});
+}
+
+
+
+
+
+void RangeResponse::addResourceSegment(uint64_t aOffset, uint64_t aSize)
+{
+	mSegments.push_back({nullptr, aOffset, aSize});
+}
+
+
+
+
+
+void RangeResponse::resolveMemorySegments()
+{
+	size_t idx = 0;
+	for (auto & segment: mSegments)
+	{
+		if (!segment.isResource())
+		{
+			segment.mData = mBuffer.data() + mMemoryOffsets[idx++];
+		}
+	}
+}
+
+
+
+
+
+void RangeResponse::newBoundary(char (& aDest)[BOUNDARY_LENGTH])
+{
+	// A counter, scrambled (splitmix64) with a per-process seed, so that the boundaries are unlikely
+	// to appear in the resource data:
+	static const uint64_t seed = static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+	static std::atomic<uint64_t> counter(0);
+	uint64_t value = seed + 0x9e3779b97f4a7c15ULL * (counter.fetch_add(1, std::memory_order_relaxed) + 1);
+	value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+	value = value ^ (value >> 31);
+	static const char HEX_DIGITS[] = "0123456789abcdef";
+	for (size_t i = 0; i < BOUNDARY_LENGTH; ++i)
+	{
+		aDest[i] = HEX_DIGITS[(value >> (4 * i)) & 0x0f];
+	}
+}
+
+
+
+
+
+}  // namespace Http
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Message.hpp"
+
+
+
+
+
+namespace Http {
+
+
+
+
+
+/** A contiguous range of bytes within a resource. */
+struct ByteRange
+{
+	/** Offset of the first byte of the range. */
+	uint64_t mOffset;
+
+	/** Number of bytes in the range; never 0. */
+	uint64_t mLength;
+
+	/** Returns the offset of the last byte of the range, as used by the Content-Range header. */
+	uint64_t last() const { return mOffset + mLength - 1; }
+};
+
+
+
+
+
+/** The byte ranges requested by the Range header (RFC 7233), resolved against the length of the resource.
+The overlapping and adjacent ranges are merged, so that no byte is sent twice; otherwise the ranges keep the order
+of the Range header, as the parts of a multipart/byteranges body should (RFC 7233 @ 4.1).
+A recycled instance doesn't allocate for the same or smaller number of ranges. */
+class RangeSet
+{
+public:
+
+	/** The outcome of parsing the Range header. */
+	enum Status
+	{
+		rsWholeResource,  ///< No usable Range header; the whole resource is to be sent with 200
+		rsPartial,        ///< The ranges are to be sent with 206
+		rsUnsatisfiable,  ///< None of the ranges overlaps the resource; 416 is to be sent
+	};
+
+	/** The default limit on the number of ranges in a single Range header. */
+	static const size_t DEFAULT_MAX_RANGES = 64;
+
+
+	/** Creates an empty set. Range headers with more than aMaxRanges ranges are ignored, so that a client
+	can't make the server send a tiny part of the resource for each of thousands of ranges (RFC 7233 @ 6.1). */
+	RangeSet(size_t aMaxRanges = DEFAULT_MAX_RANGES);
+
+	/** Parses the value of the Range header for a resource of the specified length.
+	Headers with an unknown unit or with invalid syntax are ignored (rsWholeResource), as allowed by RFC 7233 @ 3.1.
+	Returns the resulting status, also available by status() later. */
+	Status parse(std::string_view aRangeHeader, uint64_t aResourceLength);
+
+	/** Returns the status of the last parse(). */
+	Status status() const { return mStatus; }
+
+	/** Returns the length of the resource given to the last parse(). */
+	uint64_t resourceLength() const { return mResourceLength; }
+
+	/** Returns the number of ranges; 0 unless the status is rsPartial. */
+	size_t size() const { return mRanges.size(); }
+
+	/** Returns the specified range. */
+	const ByteRange & operator [] (size_t aIndex) const { return mRanges[aIndex]; }
+
+	std::vector<ByteRange>::const_iterator begin() const { return mRanges.begin(); }
+	std::vector<ByteRange>::const_iterator end() const { return mRanges.end(); }
+
+	/** Returns the total number of bytes in all the ranges. */
+	uint64_t totalLength() const;
+
+
+protected:
+
+	/** The maximum number of ranges accepted in a single header. */
+	size_t mMaxRanges;
+
+	/** The status of the last parse(). */
+	Status mStatus;
+
+	/** The length of the resource given to the last parse(). */
+	uint64_t mResourceLength;
+
+	/** The resolved ranges, merged, in the order of the Range header. */
+	std::vector<ByteRange> mRanges;
+
+
+	/** Parses a single range-spec and adds it to mRanges, if it overlaps the resource.
+	Returns false if the range-spec is not valid. */
+	bool addRangeSpec(std::string_view aSpec);
+
+	/** Merges the overlapping and adjacent ranges in mRanges. A merged range takes the place of the first one
+	of the ranges it has been merged from, the order of the others is kept. */
+	void merge();
+
+	/** Merges the ranges that are not in the ascending order, keeping their order. Called by merge(). */
+	void mergeUnsorted();
+
+	/** Sets the status and clears the ranges; returns the status. */
+	Status finish(Status aStatus);
+};
+
+
+
+
+
+/** A plan for sending the response to a (possibly) ranged request: the head and the body as a list of
+segments, either in memory (the head and the multipart/byteranges framing) or within the resource.
+The memory segments can be sent by write() / writev(), the resource segments, being plain file offsets,
+by sendfile() or splice(), so that the resource data is never copied through the userspace.
+Depending on the RangeSet status, the plan is a 200 response with the whole resource, a 206 response with
+a single range (Content-Range header) or with multiple ranges (multipart/byteranges body, RFC 7233 @ 4.1),
+or a 416 response without a body. */
+class RangeResponse
+{
+public:
+
+	/** A single part of the response data. */
+	struct Segment
+	{
+		/** The data to send from memory, or nullptr for a segment of the resource. */
+		const char * mData;
+
+		/** The offset within the resource, for a segment of the resource. */
+		uint64_t mResourceOffset;
+
+		/** The number of bytes in the segment. */
+		uint64_t mSize;
+
+		/** Returns true if the segment is to be sent from the resource rather than from memory. */
+		bool isResource() const { return (mData == nullptr); }
+	};
+
+	/** The length of the multipart/byteranges boundaries. */
+	static const size_t BOUNDARY_LENGTH = 16;
+
+
+	RangeResponse();
+
+	/** Plans the response with the headers of aResponse for the ranges in aRanges.
+	Sets the Content-Length, Content-Range, Accept-Ranges and (for multiple ranges) Content-Type headers in
+	aResponse, which keeps its other headers; the Content-Type already in aResponse is used for the parts of
+	a multipart/byteranges body.
+	The segments refer to the plan's own memory; they are valid until the next plan() call. */
+	void plan(OutgoingResponse & aResponse, const RangeSet & aRanges);
+
+	/** Returns the status code of the planned response: 200, 206 or 416. */
+	int statusCode() const { return mStatusCode; }
+
+	/** Returns the planned segments, the head first. */
+	const std::vector<Segment> & segments() const { return mSegments; }
+
+	/** Returns the size of the response body (the Content-Length value). */
+	uint64_t bodySize() const { return mBodySize; }
+
+	/** Returns the size of the whole response, including the head. */
+	uint64_t totalSize() const { return mHeadSize + mBodySize; }
+
+	/** Fills the gather list entry for the specified memory segment. */
+	static IoVec toIoVec(const Segment & aSegment)
+	{
+		IoVec res;
+		res.iov_base = const_cast<char *>(aSegment.mData);
+		res.iov_len = static_cast<size_t>(aSegment.mSize);
+		return res;
+	}
+
+
+protected:
+
+	/** The status code of the planned response. */
+	int mStatusCode;
+
+	/** The serialized head and the multipart framing, referenced by the memory segments. */
+	std::string mBuffer;
+
+	/** The planned segments. */
+	std::vector<Segment> mSegments;
+
+	/** The offsets within mBuffer of the memory segments, in the order of the segments.
+	Used while planning, until mBuffer doesn't change any more. */
+	std::vector<size_t> mMemoryOffsets;
+
+	/** The size of the head. */
+	uint64_t mHeadSize;
+
+	/** The size of the body. */
+	uint64_t mBodySize;
+
+
+	/** Appends the text to mBuffer and adds a memory segment for it.
+	The segment's mData is only a non-null placeholder until resolveMemorySegments() is called. */
+	void addMemorySegment(std::string_view aText);
+
+	/** Adds a segment of the resource. */
+	void addResourceSegment(uint64_t aOffset, uint64_t aSize);
+
+	/** Points the memory segments into mBuffer, using mMemoryOffsets. */
+	void resolveMemorySegments();
+
+	/** Writes a multipart boundary that is unique within the process into aDest. */
+	static void newBoundary(char (& aDest)[BOUNDARY_LENGTH]);
+};
+
+
+
+
+
+}  // namespace Http
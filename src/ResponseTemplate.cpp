@@ -0,0 +1,113 @@
+#include "ResponseTemplate.hpp"
+#include <cassert>
+#include <cstring>
+#include "DateCache.hpp"
+
+
+
+
+
+namespace Http {
+
+
+
+
+
+ResponseTemplate::ResponseTemplate(
+	const OutgoingResponse & aResponse,
+	int aStatusCode,
+	const std::string & aStatusText,
+	const std::vector<Slot> & aSlots
+)
+{
+	// Serialize the static headers, leaving out those that are overridden by the slots:
+	OutgoingResponse response(aResponse);
+	response.setAddDate(false);
+	for (const auto & slot: aSlots)
+	{
+		response.removeHeader(slot.mName);
+	}
+	mHead = response.serialize(aStatusCode, aStatusText);
+
+	// Insert the slots before the terminating empty line:
+	assert(mHead.size() >= 2);
+	mHead.resize(mHead.size() - 2);
+	for (const auto & slot: aSlots)
+	{
+		mHead.append(slot.mName);
+		mHead.append(": ");
+		mSlots.push_back({slot.mName, mHead.size(), slot.mWidth});
+		mHead.append(slot.mWidth, ' ');
+		mHead.append("\r\n");
+	}
+	mHead.append("\r\n");
+}
+
+
+
+
+
+void ResponseTemplate::copyTo(char * aDest) const
+{
+	memcpy(aDest, mHead.data(), mHead.size());
+}
+
+
+
+
+
+size_t ResponseTemplate::slotIndex(const std::string & aName) const
+{
+	for (size_t i = 0; i < mSlots.size(); ++i)
+	{
+		if (Utils::noCaseEqual(mSlots[i].mName, aName))
+		{
+			return i;
+		}
+	}
+	return std::string::npos;
+}
+
+
+
+
+
+bool ResponseTemplate::setSlot(char * aDest, size_t aSlotIndex, std::string_view aValue) const
+{
+	assert(aSlotIndex < mSlots.size());
+	const auto & slot = mSlots[aSlotIndex];
+	if (aValue.size() > slot.mWidth)
+	{
+		return false;
+	}
+	memcpy(aDest + slot.mOffset, aValue.data(), aValue.size());
+	memset(aDest + slot.mOffset + aValue.size(), ' ', slot.mWidth - aValue.size());
+	return true;
+}
+
+
+
+
+
+bool ResponseTemplate::setSlot(char * aDest, size_t aSlotIndex, unsigned long long aValue) const
+{
+	char number[Utils::MAX_NUMBER_CHARS];
+	return setSlot(aDest, aSlotIndex, std::string_view(number, Utils::formatNumber(number, aValue)));
+}
+
+
+
+
+
+bool ResponseTemplate::setDate(char * aDest, size_t aSlotIndex) const
+{
+	char date[Utils::HTTP_DATE_LENGTH];
+	DateCache::current(date);
+	return setSlot(aDest, aSlotIndex, std::string_view(date, sizeof(date)));
+}
+
+
+
+
+
+}  // namespace Http
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Message.hpp"
+
+
+
+
+
+namespace Http {
+
+
+
+
+
+/** A response head that is serialized once and then copied for each response, with only the dynamic
+header values patched into the copy.
+The dynamic headers (such as Content-Length, Date or ETag) are reserved as fixed-width slots when the
+template is compiled. The values written into the slots are padded with spaces, which is allowed by the
+header field grammar as trailing whitespace (RFC 7230 @ 3.2).
+Usage:
+	ResponseTemplate tmpl(response, 200, "OK", {ResponseTemplate::contentLengthSlot()});
+	...
+	std::string head = tmpl.head();
+	tmpl.setSlot(&head[0], 0, body.size());
+*/
+class ResponseTemplate
+{
+public:
+
+	/** Definition of a single dynamic header slot. */
+	struct Slot
+	{
+		/** Name of the header, as it is to be serialized. */
+		std::string mName;
+
+		/** Number of characters reserved for the value. */
+		size_t mWidth;
+	};
+
+	/** The width of the slot needed for a HTTP date ("Sun, 06 Nov 1994 08:49:37 GMT"). */
+	static const size_t DATE_WIDTH = 29;
+
+
+	/** Compiles the template out of the status and the headers in aResponse, reserving the specified slots
+	after the regular headers. The headers in aResponse that have the same name as any slot are left out. */
+	ResponseTemplate(
+		const OutgoingResponse & aResponse,
+		int aStatusCode,
+		const std::string & aStatusText,
+		const std::vector<Slot> & aSlots
+	);
+
+	/** Returns a slot definition for the Content-Length header, wide enough for any size. */
+	static Slot contentLengthSlot() { return { "Content-Length", Utils::MAX_NUMBER_CHARS }; }
+
+	/** Returns a slot definition for the Date header. */
+	static Slot dateSlot() { return { "Date", DATE_WIDTH }; }
+
+	/** Returns the serialized head, with the slots filled with spaces. */
+	const std::string & head() const { return mHead; }
+
+	/** Returns the size of the serialized head. */
+	size_t size() const { return mHead.size(); }
+
+	/** Copies the serialized head into aDest, which must be at least size() bytes long. */
+	void copyTo(char * aDest) const;
+
+	/** Returns the index of the slot with the specified header name (case-insensitive).
+	Returns std::string::npos if there's no such slot. */
+	size_t slotIndex(const std::string & aName) const;
+
+	/** Writes the value into the specified slot within a copy of the head in aDest.
+	Returns false, leaving the slot untouched, if the value is wider than the slot. */
+	bool setSlot(char * aDest, size_t aSlotIndex, std::string_view aValue) const;
+
+	/** Writes the number into the specified slot within a copy of the head in aDest.
+	Returns false, leaving the slot untouched, if the number is wider than the slot. */
+	bool setSlot(char * aDest, size_t aSlotIndex, unsigned long long aValue) const;
+
+
+	/** Writes the current date (from DateCache) into the specified slot within a copy of the head in aDest.
+	Returns false, leaving the slot untouched, if the slot is not wide enough. */
+	bool setDate(char * aDest, size_t aSlotIndex) const;
+
+
+protected:
+
+	/** A compiled slot - the position of the value within mHead. */
+	struct CompiledSlot
+	{
+		std::string mName;
+		size_t mOffset;
+		size_t mWidth;
+	};
+
+
+	/** The serialized head, with the slots filled with spaces. */
+	std::string mHead;
+
+	/** The slots, in the order in which they were specified. */
+	std::vector<CompiledSlot> mSlots;
+};
+
+
+
+
+
+}  // namespace Http
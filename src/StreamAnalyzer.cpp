@@ -0,0 +1,567 @@
+#include "StreamAnalyzer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "MessageParser.hpp"
+#include "Utils.hpp"
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+	#include <cerrno>
+#endif
+
+
+
+
+
+namespace Http {
+
+
+
+
+
+// Analysis helpers:
+
+namespace {
+
+/** The maximum length of the method token accepted by the message boundary scan. */
+const size_t MAX_METHOD_LENGTH = 20;
+
+/** The maximum length of the request target accepted by the message boundary scan. */
+const size_t MAX_TARGET_LENGTH = 16 * 1024;
+
+/** The size of the pieces in which the message bodies are fed into the parser. */
+const size_t BODY_FEED_SIZE = 16 * 1024;
+
+/** The number of shards created per thread, so that uneven shards don't leave threads idle. */
+const size_t SHARDS_PER_THREAD = 4;
+
+/** The minimum size of a shard; smaller streams are split into fewer shards. */
+const size_t MIN_SHARD_SIZE = 1024 * 1024;
+
+
+
+
+
+/** Returns true if aData at aPos begins with aPrefix. */
+inline bool hasPrefix(const char * aData, size_t aSize, size_t aPos, std::string_view aPrefix)
+{
+	return (aSize - aPos >= aPrefix.size()) && (memcmp(aData + aPos, aPrefix.data(), aPrefix.size()) == 0);
+}
+
+
+
+
+
+/** Returns true if the char is a digit. */
+inline bool isDigit(char aChar)
+{
+	return (aChar >= '0') && (aChar <= '9');
+}
+
+
+
+
+
+/** Returns true if a status line ("HTTP/1.x NNN") starts at aPos. */
+bool isStatusLine(const char * aData, size_t aSize, size_t aPos)
+{
+	// "HTTP/1.x NNN" followed by a space or the line end:
+	if ((aSize - aPos < 13) || !hasPrefix(aData, aSize, aPos, "HTTP/1."))
+	{
+		return false;
+	}
+	auto p = aData + aPos;
+	return (
+		isDigit(p[7]) && (p[8] == ' ') &&
+		isDigit(p[9]) && isDigit(p[10]) && isDigit(p[11]) &&
+		((p[12] == ' ') || (p[12] == '\r'))
+	);
+}
+
+
+
+
+
+/** Returns true if a request line ("METHOD target HTTP/1.x" CRLF) starts at aPos. */
+bool isRequestLine(const char * aData, size_t aSize, size_t aPos)
+{
+	// The method, uppercase letters:
+	auto pos = aPos;
+	auto methodEnd = std::min(aSize, aPos + MAX_METHOD_LENGTH + 1);
+	while ((pos < methodEnd) && (((aData[pos] >= 'A') && (aData[pos] <= 'Z')) || (aData[pos] == '-') || (aData[pos] == '_')))
+	{
+		pos += 1;
+	}
+	if ((pos == aPos) || (pos >= methodEnd) || (aData[pos] != ' '))
+	{
+		return false;
+	}
+
+	// The target, any visible chars:
+	pos += 1;
+	auto targetStart = pos;
+	auto targetEnd = std::min(aSize, pos + MAX_TARGET_LENGTH + 1);
+	while ((pos < targetEnd) && (static_cast<unsigned char>(aData[pos]) > ' ') && (aData[pos] != 0x7f))
+	{
+		pos += 1;
+	}
+	if ((pos == targetStart) || (pos >= targetEnd) || (aData[pos] != ' '))
+	{
+		return false;
+	}
+
+	// The version:
+	pos += 1;
+	return hasPrefix(aData, aSize, pos, "HTTP/1.") && (aSize - pos >= 10) && isDigit(aData[pos + 7]) && hasPrefix(aData, aSize, pos + 8, "\r\n");
+}
+
+
+
+
+
+/** Collects the information about a single message from the parser callbacks. */
+class MessageCollector:
+	public MessageParser::Callbacks
+{
+public:
+
+	/** The message being collected. */
+	StreamAnalyzer::MessageInfo * mInfo;
+
+
+	MessageCollector():
+		mInfo(nullptr)
+	{
+	}
+
+	virtual void onError(const std::string & aErrorDescription) override
+	{
+		if (mInfo->mError.empty())
+		{
+			mInfo->mError = aErrorDescription;
+		}
+	}
+
+	virtual void onFirstLine(const std::string & aFirstLine) override
+	{
+		mInfo->mFirstLine = aFirstLine;
+	}
+
+	virtual void onHeaderLine(const std::string & /* aKey */, const std::string & /* aValue */) override
+	{
+		mInfo->mNumHeaders += 1;
+	}
+
+	virtual void onHeadersFinished() override
+	{
+	}
+
+	virtual void onBodyData(const void * /* aData */, size_t aSize) override
+	{
+		mInfo->mBodySize += aSize;
+	}
+
+	virtual void onBodyFinished() override
+	{
+	}
+};
+
+
+
+
+
+/** Parses the single message starting at aOffset, reusing the specified parser and collector.
+For invalid or incomplete messages, the returned size spans up to the next possible message boundary. */
+StreamAnalyzer::MessageInfo parseMessage(
+	const char * aData,
+	size_t aSize,
+	size_t aOffset,
+	MessageParser & aParser,
+	MessageCollector & aCollector
+)
+{
+	StreamAnalyzer::MessageInfo info;
+	info.mOffset = aOffset;
+	info.mSize = 0;
+	info.mNumHeaders = 0;
+	info.mBodySize = 0;
+	aCollector.mInfo = &info;
+	aParser.reset(aCollector);
+
+	// Check that the message starts with a request or status line (possibly preceded by empty lines):
+	auto lineStart = aOffset;
+	while (hasPrefix(aData, aSize, lineStart, "\r\n"))
+	{
+		lineStart += 2;
+	}
+	if (!isRequestLine(aData, aSize, lineStart) && !isStatusLine(aData, aSize, lineStart))
+	{
+		info.mError = "Not a request line nor a status line";
+		auto next = StreamAnalyzer::findMessageStart(aData, aSize, aOffset + 1);
+		info.mSize = ((next == std::string::npos) ? aSize : next) - aOffset;
+		return info;
+	}
+
+	// Feed the head in one piece, so that the parser doesn't buffer any of the body:
+	std::string_view stream(aData, aSize);
+	auto headEnd = stream.find("\r\n\r\n", aOffset);
+	auto pos = aOffset;
+	auto feedSize = (headEnd == std::string_view::npos) ? (aSize - pos) : (headEnd + 4 - pos);
+	while (info.mError.empty() && !aParser.isFinished() && (feedSize > 0))
+	{
+		auto consumed = aParser.parse(aData + pos, feedSize);
+		if (consumed == std::string::npos)
+		{
+			break;
+		}
+		pos += consumed;
+		if (consumed < feedSize)
+		{
+			// The parser didn't take all the data, the message has ended:
+			break;
+		}
+		feedSize = std::min(aSize - pos, BODY_FEED_SIZE);
+	}
+
+	if (aParser.isFinished() && info.mError.empty())
+	{
+		info.mSize = pos - aOffset;
+		return info;
+	}
+
+	// The message is invalid or incomplete, skip to the next possible message start:
+	if (info.mError.empty())
+	{
+		info.mError = "The message is incomplete";
+	}
+	auto next = StreamAnalyzer::findMessageStart(aData, aSize, aOffset + 1);
+	info.mSize = ((next == std::string::npos) ? aSize : next) - aOffset;
+	return info;
+}
+
+
+
+
+
+/** A part of the stream that is parsed by a single thread. */
+struct Shard
+{
+	/** The offset of the first message in the shard. */
+	size_t mStart;
+
+	/** The offset of the first message of the next shard. */
+	size_t mEnd;
+
+	/** The offset just past the last message parsed in the shard (may lie beyond mEnd). */
+	size_t mParsedEnd;
+
+	/** The messages parsed in the shard. */
+	std::vector<StreamAnalyzer::MessageInfo> mMessages;
+};
+
+
+
+
+
+/** Parses all the messages starting within the shard. */
+void parseShard(const char * aData, size_t aSize, Shard & aShard, MessageParser & aParser, MessageCollector & aCollector)
+{
+	auto pos = aShard.mStart;
+	while (pos < aShard.mEnd)
+	{
+		aShard.mMessages.push_back(parseMessage(aData, aSize, pos, aParser, aCollector));
+		pos += aShard.mMessages.back().mSize;
+	}
+	aShard.mParsedEnd = pos;
+}
+
+}  // anonymous namespace
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// StreamAnalyzer::MappedFile:
+
+StreamAnalyzer::MappedFile::MappedFile():
+	mData(nullptr),
+	mSize(0)
+	#ifdef _WIN32
+		, mFile(INVALID_HANDLE_VALUE),
+		mMapping(nullptr)
+	#endif
+{
+}
+
+
+
+
+
+StreamAnalyzer::MappedFile::~MappedFile()
+{
+	close();
+}
+
+
+
+
+
+bool StreamAnalyzer::MappedFile::open(const std::string & aFileName)
+{
+	close();
+	#ifdef _WIN32
+		mFile = CreateFileA(aFileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (mFile == INVALID_HANDLE_VALUE)
+		{
+			mLastError = Utils::printf("Cannot open file %s: error %u", aFileName.c_str(), static_cast<unsigned>(GetLastError()));
+			return false;
+		}
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(mFile, &size))
+		{
+			mLastError = Utils::printf("Cannot query the size of file %s: error %u", aFileName.c_str(), static_cast<unsigned>(GetLastError()));
+			close();
+			return false;
+		}
+		mSize = static_cast<size_t>(size.QuadPart);
+		if (mSize == 0)
+		{
+			return true;
+		}
+		mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mMapping == nullptr)
+		{
+			mLastError = Utils::printf("Cannot map file %s: error %u", aFileName.c_str(), static_cast<unsigned>(GetLastError()));
+			close();
+			return false;
+		}
+		mData = static_cast<const char *>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+		if (mData == nullptr)
+		{
+			mLastError = Utils::printf("Cannot map file %s: error %u", aFileName.c_str(), static_cast<unsigned>(GetLastError()));
+			close();
+			return false;
+		}
+		return true;
+	#else
+		auto fd = ::open(aFileName.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			mLastError = Utils::printf("Cannot open file %s: %s", aFileName.c_str(), strerror(errno));
+			return false;
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0)
+		{
+			mLastError = Utils::printf("Cannot query the size of file %s: %s", aFileName.c_str(), strerror(errno));
+			::close(fd);
+			return false;
+		}
+		mSize = static_cast<size_t>(st.st_size);
+		if (mSize == 0)
+		{
+			::close(fd);
+			return true;
+		}
+		auto data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);  // The mapping stays valid after closing the descriptor
+		if (data == MAP_FAILED)
+		{
+			mLastError = Utils::printf("Cannot map file %s: %s", aFileName.c_str(), strerror(errno));
+			mSize = 0;
+			return false;
+		}
+		madvise(data, mSize, MADV_SEQUENTIAL);
+		mData = static_cast<const char *>(data);
+		return true;
+	#endif
+}
+
+
+
+
+
+void StreamAnalyzer::MappedFile::close()
+{
+	#ifdef _WIN32
+		if (mData != nullptr)
+		{
+			UnmapViewOfFile(mData);
+		}
+		if (mMapping != nullptr)
+		{
+			CloseHandle(mMapping);
+			mMapping = nullptr;
+		}
+		if (mFile != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(mFile);
+			mFile = INVALID_HANDLE_VALUE;
+		}
+	#else
+		if (mData != nullptr)
+		{
+			munmap(const_cast<char *>(mData), mSize);
+		}
+	#endif
+	mData = nullptr;
+	mSize = 0;
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// StreamAnalyzer:
+
+size_t StreamAnalyzer::findMessageStart(const char * aData, size_t aSize, size_t aStart)
+{
+	auto pos = aStart;
+	if ((pos > 0) && (pos <= aSize) && (aData[pos - 1] != '\n'))
+	{
+		// Not at a line start, skip to the next one:
+		auto lf = static_cast<const char *>(memchr(aData + pos, '\n', aSize - pos));
+		if (lf == nullptr)
+		{
+			return std::string::npos;
+		}
+		pos = static_cast<size_t>(lf - aData) + 1;
+	}
+	while (pos < aSize)
+	{
+		if (isRequestLine(aData, aSize, pos) || isStatusLine(aData, aSize, pos))
+		{
+			return pos;
+		}
+		auto lf = static_cast<const char *>(memchr(aData + pos, '\n', aSize - pos));
+		if (lf == nullptr)
+		{
+			break;
+		}
+		pos = static_cast<size_t>(lf - aData) + 1;
+	}
+	return std::string::npos;
+}
+
+
+
+
+
+void StreamAnalyzer::analyze(const char * aData, size_t aSize, unsigned aNumThreads, Callbacks & aCallbacks)
+{
+	if (aNumThreads == 0)
+	{
+		aNumThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	// Split the stream into shards at the likely message boundaries:
+	auto numShards = std::max<size_t>(1, std::min<size_t>(aNumThreads * SHARDS_PER_THREAD, aSize / MIN_SHARD_SIZE));
+	std::vector<Shard> shards;
+	shards.reserve(numShards);
+	size_t prevStart = 0;
+	for (size_t i = 1; i < numShards; ++i)
+	{
+		auto start = findMessageStart(aData, aSize, std::max(prevStart + 1, aSize / numShards * i));
+		if (start == std::string::npos)
+		{
+			break;
+		}
+		shards.push_back({prevStart, start, start, {}});
+		prevStart = start;
+	}
+	shards.push_back({prevStart, aSize, aSize, {}});
+
+	// Parse the shards in parallel:
+	std::atomic<size_t> nextShard(0);
+	auto worker = [&]()
+	{
+		MessageCollector collector;
+		MessageParser parser(collector);
+		for (;;)
+		{
+			auto idx = nextShard.fetch_add(1, std::memory_order_relaxed);
+			if (idx >= shards.size())
+			{
+				return;
+			}
+			parseShard(aData, aSize, shards[idx], parser, collector);
+		}
+	};
+	std::vector<std::thread> threads;
+	auto numThreads = std::min<size_t>(aNumThreads, shards.size());
+	for (size_t i = 1; i < numThreads; ++i)
+	{
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (auto & thr: threads)
+	{
+		thr.join();
+	}
+
+	// Merge in order. Each shard's results are valid from the point where the previous shard's last message
+	// ended; where that point isn't one of the shard's message starts (the shard started at a false
+	// boundary), the messages are re-parsed sequentially until they align with the shard's results again:
+	MessageCollector collector;
+	MessageParser parser(collector);
+	auto byOffset = [](const MessageInfo & aMessage, size_t aOffset) { return aMessage.mOffset < aOffset; };
+	size_t pos = 0;
+	for (const auto & shard: shards)
+	{
+		auto itr = std::lower_bound(shard.mMessages.begin(), shard.mMessages.end(), pos, byOffset);
+		while ((pos < shard.mEnd) && ((itr == shard.mMessages.end()) || (itr->mOffset != pos)))
+		{
+			auto msg = parseMessage(aData, aSize, pos, parser, collector);
+			pos += msg.mSize;
+			aCallbacks.onMessage(msg);
+			itr = std::lower_bound(itr, shard.mMessages.end(), pos, byOffset);
+		}
+		if ((itr != shard.mMessages.end()) && (itr->mOffset == pos))
+		{
+			for (auto end = shard.mMessages.end(); itr != end; ++itr)
+			{
+				aCallbacks.onMessage(*itr);
+			}
+			pos = shard.mParsedEnd;
+		}
+	}
+}
+
+
+
+
+
+bool StreamAnalyzer::analyzeFile(
+	const std::string & aFileName,
+	unsigned aNumThreads,
+	Callbacks & aCallbacks,
+	std::string & aError
+)
+{
+	MappedFile file;
+	if (!file.open(aFileName))
+	{
+		aError = file.lastError();
+		return false;
+	}
+	analyze(file.data(), file.size(), aNumThreads, aCallbacks);
+	return true;
+}
+
+
+
+
+
+}  // namespace Http
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <string>
+
+
+
+
+
+namespace Http {
+
+
+
+
+
+/** Analyzes captured streams of concatenated HTTP/1.x messages (such as archived request streams), using
+all available cores.
+The stream is split into shards at likely message boundaries, found by a fast scan for request and status
+lines. Each shard is parsed on its own thread by an independent MessageParser, and the results are then
+merged in stream order. A shard that was split at a false boundary (such as a request line quoted inside a
+body) is detected during the merge and the affected messages are re-parsed sequentially, so the result is
+the same as parsing the whole stream on a single thread. */
+class StreamAnalyzer
+{
+public:
+
+	/** Summary of a single message found in the stream. */
+	struct MessageInfo
+	{
+		/** Offset of the message start within the stream. */
+		size_t mOffset;
+
+		/** Size of the entire message, including the body. For invalid messages, the size of the data skipped
+		until the next possible message boundary. */
+		size_t mSize;
+
+		/** The first line of the message (request line or status line). */
+		std::string mFirstLine;
+
+		/** Number of header lines in the message. */
+		size_t mNumHeaders;
+
+		/** Number of body bytes (after removing the transfer encoding). */
+		size_t mBodySize;
+
+		/** Description of the error encountered while parsing the message; empty for valid messages. */
+		std::string mError;
+	};
+
+
+	class Callbacks
+	{
+	public:
+		// Force a virtual destructor in descendants:
+		virtual ~Callbacks() {}
+
+		/** Called for each message in the stream, in the stream order. */
+		virtual void onMessage(const MessageInfo & aMessage) = 0;
+	};
+
+
+	/** A read-only memory-mapped file. */
+	class MappedFile
+	{
+	public:
+
+		MappedFile();
+		~MappedFile();
+
+		MappedFile(const MappedFile &) = delete;
+		MappedFile & operator = (const MappedFile &) = delete;
+
+		/** Maps the specified file, unmapping any previously mapped one.
+		Returns true on success, false on failure (with the description available in lastError()). */
+		bool open(const std::string & aFileName);
+
+		/** Unmaps the file, if mapped. */
+		void close();
+
+		/** Returns the mapped file contents. */
+		const char * data() const { return mData; }
+
+		/** Returns the size of the mapped file. */
+		size_t size() const { return mSize; }
+
+		/** Returns the description of the last error encountered by open(). */
+		const std::string & lastError() const { return mLastError; }
+
+
+	protected:
+
+		/** The mapped file contents; nullptr if not mapped (or empty). */
+		const char * mData;
+
+		/** The size of the mapped file. */
+		size_t mSize;
+
+		/** The description of the last error encountered by open(). */
+		std::string mLastError;
+
+		#ifdef _WIN32
+			/** The handles of the file and the file mapping (HANDLE). */
+			void * mFile;
+			void * mMapping;
+		#endif
+	};
+
+
+	/** Returns the offset of the first likely message start at or after aStart: a request line
+	("METHOD target HTTP/1.x") or a status line ("HTTP/1.x NNN ...") that begins the stream or follows a LF.
+	Returns std::string::npos if there's none. */
+	static size_t findMessageStart(const char * aData, size_t aSize, size_t aStart);
+
+	/** Analyzes the stream in the specified memory, reporting all messages through the callbacks, in order.
+	aNumThreads is the number of threads to use; 0 means as many as there are cores.
+	The callbacks are called from the calling thread, after all the shards have been parsed. */
+	static void analyze(const char * aData, size_t aSize, unsigned aNumThreads, Callbacks & aCallbacks);
+
+	/** Memory-maps the specified file and analyzes its contents, as analyze() does.
+	Returns true on success, false if the file cannot be mapped (with the description in aError). */
+	static bool analyzeFile(
+		const std::string & aFileName,
+		unsigned aNumThreads,
+		Callbacks & aCallbacks,
+		std::string & aError
+	);
+};
+
+
+
+
+
+}  // namespace Http
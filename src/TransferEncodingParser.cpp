@@ -1,6 +1,7 @@
 #include "TransferEncodingParser.hpp"
 #include <cassert>
 #include <algorithm>
+#include "CharTables.hpp"
 #include "EnvelopeParser.hpp"
 #include "Utils.hpp"
 
@@ -72,62 +73,32 @@ protected:
 	{
 		// Expected input: <hexnumber>[;<trailer>]<CR><LF>
 		// Only the hexnumber is parsed into mChunkDataLengthLeft, the rest is postponed into psChunkLengthTrailer or psChunkLengthLF
-		for (size_t i = 0; i < aSize; i++)
+		// The number may be split across multiple calls, so the digits are accumulated into mChunkDataLengthLeft
+		auto numDigits = Utils::accumulateHexDigits(aData, aSize, mChunkDataLengthLeft);
+		if (numDigits == std::string::npos)
 		{
-			switch (aData[i])
+			error("Chunk length is too large");
+			return std::string::npos;
+		}
+		if (numDigits == aSize)
+		{
+			return aSize;
+		}
+		switch (aData[numDigits])
+		{
+			case '\r':
 			{
-				case '0':
-				case '1':
-				case '2':
-				case '3':
-				case '4':
-				case '5':
-				case '6':
-				case '7':
-				case '8':
-				case '9':
-				{
-					mChunkDataLengthLeft = mChunkDataLengthLeft * 16 + static_cast<decltype(mChunkDataLengthLeft)>(aData[i] - '0');
-					break;
-				}
-				case 'a':
-				case 'b':
-				case 'c':
-				case 'd':
-				case 'e':
-				case 'f':
-				{
-					mChunkDataLengthLeft = mChunkDataLengthLeft * 16 + static_cast<decltype(mChunkDataLengthLeft)>(aData[i] - 'a' + 10);
-					break;
-				}
-				case 'A':
-				case 'B':
-				case 'C':
-				case 'D':
-				case 'E':
-				case 'F':
-				{
-					mChunkDataLengthLeft = mChunkDataLengthLeft * 16 + static_cast<decltype(mChunkDataLengthLeft)>(aData[i] - 'A' + 10);
-					break;
-				}
-				case '\r':
-				{
-					mState = psChunkLengthLF;
-					return i + 1;
-				}
-				case ';':
-				{
-					mState = psChunkLengthTrailer;
-					return i + 1;
-				}
-				default:
-				{
-					error(Utils::printf("Invalid character in chunk length line: 0x%x", aData[i]));
-					return std::string::npos;
-				}
-			}  // switch (aData[i])
-		}  // for i - aData[]
-		return aSize;
+				mState = psChunkLengthLF;
+				return numDigits + 1;
+			}
+			case ';':
+			{
+				mState = psChunkLengthTrailer;
+				return numDigits + 1;
+			}
+		}
+		error(Utils::printf("Invalid character in chunk length line: 0x%x", static_cast<unsigned char>(aData[numDigits])));
+		return std::string::npos;
 	}
 
 
@@ -137,7 +108,7 @@ protected:
 	size_t parseChunkLengthTrailer(const char * aData, size_t aSize)
 	{
 		// Expected input: <trailer><CR><LF>
-		// The LF itself is not parsed, it is instead postponed into psChunkLengthLF
+		// The CR is consumed here, the LF itself is not parsed, it is instead postponed into psChunkLengthLF
 		for (size_t i = 0; i < aSize; i++)
 		{
 			switch (aData[i])
@@ -145,14 +116,14 @@ protected:
 				case '\r':
 				{
 					mState = psChunkLengthLF;
-					return i;
+					return i + 1;
 				}
 				default:
 				{
-					if (aData[i] < 32)
+					if (CharTables::isControl(aData[i]) && !CharTables::isWhitespace(aData[i]))
 					{
-						// Only printable characters are allowed in the trailer
-						error(Utils::printf("Invalid character in chunk length line: 0x%x", aData[i]));
+						// Only printable characters and whitespace are allowed in the trailer
+						error(Utils::printf("Invalid character in chunk length line: 0x%x", static_cast<unsigned char>(aData[i])));
 						return std::string::npos;
 					}
 				}
@@ -257,6 +228,7 @@ protected:
 		if (res == std::string::npos)
 		{
 			error("Error while parsing the trailer");
+			return std::string::npos;
 		}
 		if ((res < aSize) || !mTrailerParser.isInHeaders())
 		{
@@ -303,6 +275,23 @@ protected:
 		mState = psFinished;
 	}
 
+	virtual bool restart(const std::string & aTransferEncoding, size_t /* aContentLength */) override
+	{
+		if (!Utils::noCaseEqual(aTransferEncoding, "chunked"))
+		{
+			return false;
+		}
+		mState = psChunkLength;
+		mChunkDataLengthLeft = 0;
+		mTrailerParser.reset();
+		return true;
+	}
+
+	virtual size_t retainedMemory() const override
+	{
+		return sizeof(*this) + mTrailerParser.retainedMemory();
+	}
+
 
 	// EnvelopeParser::Callbacks overrides:
 	virtual void onHeaderLine(const std::string & /* aKey */, const std::string & /* aValue */) override
@@ -333,12 +322,22 @@ public:
 
 protected:
 
-	/** How many bytes of content are left before the message ends. */
+	/** How many bytes of content are left before the message ends.
+	std::string::npos if the body extends until the connection is closed. */
 	size_t mBytesLeft;
 
 	// TransferEncodingParser overrides:
 	virtual size_t parse(const char * aData, size_t aSize) override
 	{
+		if (mBytesLeft == std::string::npos)
+		{
+			// The body is delimited by the connection close, all data belongs to it:
+			if (aSize > 0)
+			{
+				mCallbacks.onBodyData(aData, aSize);
+			}
+			return 0;
+		}
 		auto size = std::min(aSize, mBytesLeft);
 		if (size > 0)
 		{
@@ -354,7 +353,12 @@ protected:
 
 	virtual void finish() override
 	{
-		if (mBytesLeft > 0)
+		if (mBytesLeft == std::string::npos)
+		{
+			mBytesLeft = 0;
+			mCallbacks.onBodyFinished();
+		}
+		else if (mBytesLeft > 0)
 		{
 			mCallbacks.onError("IdentityTransferEncoding: body was truncated");
 		}
@@ -363,6 +367,21 @@ protected:
 			// BodyFinished has already been called, just bail out
 		}
 	}
+
+	virtual bool restart(const std::string & aTransferEncoding, size_t aContentLength) override
+	{
+		if (!Utils::noCaseEqual(aTransferEncoding, "identity"))
+		{
+			return false;
+		}
+		mBytesLeft = aContentLength;
+		return true;
+	}
+
+	virtual size_t retainedMemory() const override
+	{
+		return sizeof(*this);
+	}
 };
 
 
@@ -378,12 +397,11 @@ TransferEncodingParserPtr TransferEncodingParser::create(
 	size_t aContentLength
 )
 {
-	auto transferEncoding = Utils::strToLower(aTransferEncoding);
-	if (transferEncoding == "chunked")
+	if (Utils::noCaseEqual(aTransferEncoding, "chunked"))
 	{
 		return std::make_shared<ChunkedTEParser>(aCallbacks);
 	}
-	if (transferEncoding == "identity")
+	if (Utils::noCaseEqual(aTransferEncoding, "identity"))
 	{
 		return std::make_shared<IdentityTEParser>(aCallbacks, aContentLength);
 	}
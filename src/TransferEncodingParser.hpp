@@ -59,6 +59,14 @@ public:
 	Flushes any buffers and calls appropriate callbacks. */
 	virtual void finish() = 0;
 
+	/** Reinitializes the parser for a new message, if it handles the specified encoding (case-insensitive).
+	Returns false if the encoding is different, the caller should then create() a new parser.
+	aContentLength has the same meaning as in create(). */
+	virtual bool restart(const std::string & aTransferEncoding, size_t aContentLength) = 0;
+
+	/** Returns the approximate amount of memory held by the parser. */
+	virtual size_t retainedMemory() const = 0;
+
 
 	////////////////////////////////////////////////////////////////////////////////
 	// The factory:
@@ -66,7 +74,8 @@ public:
 	/** Creates a new parser for the specified encoding (case-insensitive).
 	If the encoding is not known, returns a nullptr.
 	aContentLength is the length of the content, received in a Content-Length header, it is used for
-	the Identity encoding, it is ignored for the Chunked encoding. */
+	the Identity encoding, it is ignored for the Chunked encoding. For the Identity encoding, std::string::npos
+	means that the body extends until the connection is closed, the body is then finished by finish(). */
 	static TransferEncodingParserPtr create(
 		Callbacks & aCallbacks,
 		const std::string & aTransferEncoding,
@@ -2,6 +2,14 @@
 #include <algorithm>
 #include <cassert>
 #include <cstdarg>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	#include <immintrin.h>
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
 
 
 
@@ -19,42 +27,6 @@ namespace Http { namespace Utils {
 
 
 
-/** Returns the value of the single hex digit.
-Returns 0xff on failure. */
-static unsigned char hexToDec(char aHexChar)
-{
-	switch (aHexChar)
-	{
-		case '0': return 0;
-		case '1': return 1;
-		case '2': return 2;
-		case '3': return 3;
-		case '4': return 4;
-		case '5': return 5;
-		case '6': return 6;
-		case '7': return 7;
-		case '8': return 8;
-		case '9': return 9;
-		case 'a': return 10;
-		case 'b': return 11;
-		case 'c': return 12;
-		case 'd': return 13;
-		case 'e': return 14;
-		case 'f': return 15;
-		case 'A': return 10;
-		case 'B': return 11;
-		case 'C': return 12;
-		case 'D': return 13;
-		case 'E': return 14;
-		case 'F': return 15;
-	}
-	return 0xff;
-}
-
-
-
-
-
 std::vector<std::string> stringSplit(const std::string & aInput, const std::string & aSeparator)
 {
 	std::vector<std::string> results;
@@ -151,11 +123,249 @@ std::string printf(const char * format, ...)
 
 
 
-std::string strToLower(const std::string & s)
+size_t formatNumber(char * aDest, unsigned long long aNumber)
 {
-	std::string res;
-	res.resize(s.size());
-	std::transform(s.begin(), s.end(), res.begin(), ::tolower);
+	auto res = std::to_chars(aDest, aDest + MAX_NUMBER_CHARS, aNumber);
+	assert(res.ec == std::errc());
+	return static_cast<size_t>(res.ptr - aDest);
+}
+
+
+
+
+
+size_t formatHttpDate(char * aDest, std::time_t aTime)
+{
+	static const char dayNames[] = "ThuFriSatSunMonTueWed";  // 1970-01-01 was a Thursday
+	static const char monthNames[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+	// Split into days and seconds within the day, rounding towards the past:
+	long long t = static_cast<long long>(aTime);
+	long long days = t / 86400;
+	long long secs = t % 86400;
+	if (secs < 0)
+	{
+		secs += 86400;
+		days -= 1;
+	}
+	auto dayOfWeek = static_cast<int>(((days % 7) + 7) % 7);
+
+	// Convert days since epoch to the civil date (H. Hinnant's "civil_from_days"):
+	auto z = days + 719468;
+	auto era = ((z >= 0) ? z : z - 146096) / 146097;
+	auto doe = z - era * 146097;
+	auto yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	auto doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	auto mp = (5 * doy + 2) / 153;
+	auto day = static_cast<int>(doy - (153 * mp + 2) / 5 + 1);
+	auto month = static_cast<int>((mp < 10) ? mp + 3 : mp - 9);
+	auto year = static_cast<int>(yoe + era * 400 + ((month <= 2) ? 1 : 0));
+	auto hour = static_cast<int>(secs / 3600);
+	auto minute = static_cast<int>((secs / 60) % 60);
+	auto second = static_cast<int>(secs % 60);
+
+	auto twoDigits = [](char * aOut, int aValue)
+	{
+		aOut[0] = static_cast<char>('0' + aValue / 10);
+		aOut[1] = static_cast<char>('0' + aValue % 10);
+	};
+	memcpy(aDest, dayNames + 3 * dayOfWeek, 3);
+	aDest[3] = ',';
+	aDest[4] = ' ';
+	twoDigits(aDest + 5, day);
+	aDest[7] = ' ';
+	memcpy(aDest + 8, monthNames + 3 * (month - 1), 3);
+	aDest[11] = ' ';
+	twoDigits(aDest + 12, (year / 100) % 100);
+	twoDigits(aDest + 14, year % 100);
+	aDest[16] = ' ';
+	twoDigits(aDest + 17, hour);
+	aDest[19] = ':';
+	twoDigits(aDest + 20, minute);
+	aDest[22] = ':';
+	twoDigits(aDest + 23, second);
+	memcpy(aDest + 25, " GMT", 4);
+	return HTTP_DATE_LENGTH;
+}
+
+
+
+
+
+/** Parses the two ASCII decimal digits into aValue. Returns false if they're not digits. */
+static inline bool parseTwoDigits(const char * aText, int & aValue)
+{
+	auto d1 = static_cast<unsigned>(aText[0] - '0');
+	auto d2 = static_cast<unsigned>(aText[1] - '0');
+	aValue = static_cast<int>(d1 * 10 + d2);
+	return ((d1 < 10) && (d2 < 10));
+}
+
+
+
+
+
+/** Returns the month number (1 - 12) of the three-letter English month abbreviation, 0 if not valid. */
+static int parseMonthName(const char * aText)
+{
+	static const char monthNames[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+	for (int i = 0; i < 12; ++i)
+	{
+		if (memcmp(aText, monthNames + 3 * i, 3) == 0)
+		{
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+
+
+
+
+/** Parses the "hh:mm:ss" time into the number of seconds since midnight. Returns false if not valid. */
+static bool parseTimeOfDay(const char * aText, long long & aSeconds)
+{
+	int hour, minute, second;
+	if (
+		!parseTwoDigits(aText, hour) || (aText[2] != ':') ||
+		!parseTwoDigits(aText + 3, minute) || (aText[5] != ':') ||
+		!parseTwoDigits(aText + 6, second) ||
+		(hour > 23) || (minute > 59) || (second > 60)  // Allow a leap second
+	)
+	{
+		return false;
+	}
+	aSeconds = hour * 3600 + minute * 60 + second;
+	return true;
+}
+
+
+
+
+
+/** Converts the civil date and the time of day into the time since the epoch (H. Hinnant's "days_from_civil").
+Returns false if the day is not valid. */
+static bool civilToTime(int aYear, int aMonth, int aDay, long long aSeconds, std::time_t & aTime)
+{
+	static const int daysInMonth[] = { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	if ((aDay < 1) || (aDay > daysInMonth[aMonth - 1]))
+	{
+		return false;
+	}
+	auto isLeapYear = ((aYear % 4 == 0) && ((aYear % 100 != 0) || (aYear % 400 == 0)));
+	if ((aMonth == 2) && (aDay == 29) && !isLeapYear)
+	{
+		return false;
+	}
+	long long y = aYear - ((aMonth <= 2) ? 1 : 0);
+	auto era = ((y >= 0) ? y : y - 399) / 400;
+	auto yoe = y - era * 400;
+	auto doy = (153 * ((aMonth > 2) ? aMonth - 3 : aMonth + 9) + 2) / 5 + aDay - 1;
+	auto doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	auto days = era * 146097 + doe - 719468;
+	aTime = static_cast<std::time_t>(days * 86400 + aSeconds);
+	return true;
+}
+
+
+
+
+
+bool parseHttpDate(std::string_view aText, std::time_t & aTime)
+{
+	int day, month, year, yearLow;
+	long long seconds;
+	auto text = aText.data();
+
+	// IMF-fixdate: "Sun, 06 Nov 1994 08:49:37 GMT"
+	if ((aText.size() == HTTP_DATE_LENGTH) && (text[3] == ','))
+	{
+		if (
+			(text[4] != ' ') || !parseTwoDigits(text + 5, day) || (text[7] != ' ') ||
+			((month = parseMonthName(text + 8)) == 0) || (text[11] != ' ') ||
+			!parseTwoDigits(text + 12, year) || !parseTwoDigits(text + 14, yearLow) || (text[16] != ' ') ||
+			!parseTimeOfDay(text + 17, seconds) ||
+			(memcmp(text + 25, " GMT", 4) != 0)
+		)
+		{
+			return false;
+		}
+		return civilToTime(year * 100 + yearLow, month, day, seconds, aTime);
+	}
+
+	// asctime(): "Sun Nov  6 08:49:37 1994"
+	if ((aText.size() == 24) && (text[3] == ' '))
+	{
+		if (text[8] == ' ')
+		{
+			day = text[9] - '0';
+			if ((day < 1) || (day > 9))
+			{
+				return false;
+			}
+		}
+		else if (!parseTwoDigits(text + 8, day))
+		{
+			return false;
+		}
+		if (
+			((month = parseMonthName(text + 4)) == 0) || (text[7] != ' ') || (text[10] != ' ') ||
+			!parseTimeOfDay(text + 11, seconds) || (text[19] != ' ') ||
+			!parseTwoDigits(text + 20, year) || !parseTwoDigits(text + 22, yearLow)
+		)
+		{
+			return false;
+		}
+		return civilToTime(year * 100 + yearLow, month, day, seconds, aTime);
+	}
+
+	// RFC 850: "Sunday, 06-Nov-94 08:49:37 GMT", the day name has variable length:
+	auto idxComma = aText.find(',');
+	if ((idxComma == std::string_view::npos) || (aText.size() != idxComma + 24))
+	{
+		return false;
+	}
+	text += idxComma + 1;
+	if (
+		(text[0] != ' ') || !parseTwoDigits(text + 1, day) || (text[3] != '-') ||
+		((month = parseMonthName(text + 4)) == 0) || (text[7] != '-') ||
+		!parseTwoDigits(text + 8, year) || (text[10] != ' ') ||
+		!parseTimeOfDay(text + 11, seconds) ||
+		(memcmp(text + 19, " GMT", 4) != 0)
+	)
+	{
+		return false;
+	}
+	// Two-digit years are in the past century, rather than more than 50 years in the future (RFC 7231 @ 7.1.1.1);
+	// the pivot is fixed instead of depending on the current year:
+	year += (year < 70) ? 2000 : 1900;
+	return civilToTime(year, month, day, seconds, aTime);
+}
+
+
+
+
+
+/** Lower-cases the ASCII letters among the 8 chars packed in the word, using SWAR arithmetic. */
+static inline uint64_t asciiLowerWord(uint64_t aWord)
+{
+	auto heptets = aWord & 0x7f7f7f7f7f7f7f7fULL;
+	auto isAtLeastA = heptets + 0x3f3f3f3f3f3f3f3fULL;  // Sets the top bit for chars >= 'A'
+	auto isAboveZ = heptets + 0x2525252525252525ULL;    // Sets the top bit for chars > 'Z'
+	auto isUpper = (isAtLeastA ^ isAboveZ) & ~aWord & 0x8080808080808080ULL;
+	return aWord | (isUpper >> 2);
+}
+
+
+
+
+
+/** Loads 8 chars from the (unaligned) pointer into a word. */
+static inline uint64_t loadWord(const char * aData)
+{
+	uint64_t res;
+	memcpy(&res, aData, sizeof(res));
 	return res;
 }
 
@@ -163,49 +373,442 @@ std::string strToLower(const std::string & s)
 
 
 
-int noCaseCompare(const std::string & s1, const std::string & s2)
+std::string strToLower(std::string_view s)
 {
-	#ifdef _MSC_VER
-		// MSVC has stricmp that compares case-insensitive:
-		return _stricmp(s1.c_str(), s2.c_str());
-	#else
-		// Do it the hard way - convert both strings to lowercase:
-		return strToLower(s1).compare(strToLower(s2));
-	#endif  // else _MSC_VER
+	std::string res(s);
+	asciiLowerInPlace(res);
+	return res;
 }
 
 
 
 
 
-/** Converts one Hex character in a Base64 encoding into the data value */
-static inline int UnBase64(char c)
+void asciiLowerInPlace(char * aData, size_t aSize)
 {
-	if ((c >='A') && (c <= 'Z'))
+	size_t i = 0;
+	for (; i + 8 <= aSize; i += 8)
 	{
-		return c - 'A';
+		auto word = asciiLowerWord(loadWord(aData + i));
+		memcpy(aData + i, &word, sizeof(word));
 	}
-	if ((c >='a') && (c <= 'z'))
+	for (; i < aSize; i++)
 	{
-		return c - 'a' + 26;
+		aData[i] = asciiToLower(aData[i]);
 	}
-	if ((c >= '0') && (c <= '9'))
+}
+
+
+
+
+
+#ifdef __SSE2__
+/** Returns the ASCII-lowercased 16 chars. */
+static inline __m128i asciiLowerSse2(__m128i aChars)
+{
+	// Signed compares, chars above 0x7f are negative and thus never in range:
+	auto isUpper = _mm_and_si128(
+		_mm_cmpgt_epi8(aChars, _mm_set1_epi8('A' - 1)),
+		_mm_cmplt_epi8(aChars, _mm_set1_epi8('Z' + 1))
+	);
+	return _mm_or_si128(aChars, _mm_and_si128(isUpper, _mm_set1_epi8(0x20)));
+}
+#endif  // __SSE2__
+
+
+
+
+
+/** Returns the length of the common prefix of the two buffers, ignoring the case of ASCII letters. */
+static size_t noCaseCommonPrefix(const char * aData1, const char * aData2, size_t aSize)
+{
+	size_t i = 0;
+	#ifdef __SSE2__
+		for (; i + 16 <= aSize; i += 16)
+		{
+			auto c1 = asciiLowerSse2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(aData1 + i)));
+			auto c2 = asciiLowerSse2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(aData2 + i)));
+			auto equalMask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(c1, c2)));
+			if (equalMask != 0xffff)
+			{
+				return i + static_cast<size_t>(__builtin_ctz(~equalMask));
+			}
+		}
+	#endif  // __SSE2__
+	for (; i + 8 <= aSize; i += 8)
 	{
-		return c - '0' + 52;
+		if (asciiLowerWord(loadWord(aData1 + i)) != asciiLowerWord(loadWord(aData2 + i)))
+		{
+			break;
+		}
 	}
-	if (c == '+')
+	for (; i < aSize; i++)
 	{
-		return 62;
+		if (asciiToLower(aData1[i]) != asciiToLower(aData2[i]))
+		{
+			break;
+		}
 	}
-	if (c == '/')
+	return i;
+}
+
+
+
+
+
+int noCaseCompare(std::string_view s1, std::string_view s2)
+{
+	auto minSize = std::min(s1.size(), s2.size());
+	auto idx = noCaseCommonPrefix(s1.data(), s2.data(), minSize);
+	if (idx < minSize)
+	{
+		return
+			static_cast<int>(static_cast<unsigned char>(asciiToLower(s1[idx]))) -
+			static_cast<int>(static_cast<unsigned char>(asciiToLower(s2[idx])));
+	}
+	if (s1.size() == s2.size())
+	{
+		return 0;
+	}
+	return (s1.size() < s2.size()) ? -1 : 1;
+}
+
+
+
+
+
+bool noCaseEqual(std::string_view s1, std::string_view s2)
+{
+	return (
+		(s1.size() == s2.size()) &&
+		(noCaseCommonPrefix(s1.data(), s2.data(), s1.size()) == s1.size())
+	);
+}
+
+
+
+
+
+size_t noCaseHash(std::string_view s)
+{
+	// FNV-1a, over whole lowercased words where possible:
+	const uint64_t prime = 0x100000001b3ULL;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	size_t i = 0;
+	auto size = s.size();
+	for (; i + 8 <= size; i += 8)
 	{
-		return 63;
+		hash = (hash ^ asciiLowerWord(loadWord(s.data() + i))) * prime;
 	}
-	if (c == '=')
+	for (; i < size; i++)
 	{
-		return -1;
+		hash = (hash ^ static_cast<unsigned char>(asciiToLower(s[i]))) * prime;
 	}
-	return -2;
+	return static_cast<size_t>(hash ^ (hash >> 32));
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Base64 kernels:
+
+/** A vectorized Base64 decoding kernel.
+Decodes whole blocks from the start of aSrc, stopping at the first block that contains anything but the
+plain Base64 alphabet (padding, whitespace, garbage), which is left for the scalar code to handle.
+Returns the number of source characters consumed; each 4 of them produce 3 bytes in aDest. */
+typedef size_t (*Base64DecodeKernel)(const char * aSrc, size_t aSrcSize, char * aDest);
+
+/** A vectorized Base64 encoding kernel.
+Encodes whole blocks from the start of aSrc, the remainder is left for the scalar code.
+Returns the number of source bytes consumed; each 3 of them produce 4 characters in aDest. */
+typedef size_t (*Base64EncodeKernel)(const char * aSrc, size_t aSrcSize, char * aDest);
+
+/** The set of kernels chosen for the CPU we're running on. */
+struct Base64Kernels
+{
+	Base64DecodeKernel mDecode;
+	Base64EncodeKernel mEncode;
+};
+
+
+
+
+
+/** The scalar "kernel" that leaves everything to the scalar code. */
+static size_t base64NoKernel(const char * /* aSrc */, size_t /* aSrcSize */, char * /* aDest */)
+{
+	return 0;
+}
+
+
+
+
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define HTTP_UTILS_X86_KERNELS 1
+
+// The kernels below use the algorithms by Wojciech Mula and Daniel Lemire,
+// "Faster Base64 Encoding and Decoding Using AVX2 Instructions", and are compiled for their specific
+// instruction sets using the target attribute, so that the rest of the library stays baseline.
+
+/** Translates 16 Base64 characters into their 6-bit values.
+Returns false if any of the characters is outside the Base64 alphabet. */
+__attribute__((target("ssse3")))
+static inline bool base64DecodeTranslateSsse3(__m128i & aValues)
+{
+	const __m128i lutLo = _mm_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a
+	);
+	const __m128i lutHi = _mm_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10
+	);
+	const __m128i lutRoll = _mm_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71,
+		0,  0,  0, 0,   0,   0,   0,   0
+	);
+	const __m128i mask2f = _mm_set1_epi8(0x2f);
+	auto hiNibbles = _mm_and_si128(_mm_srli_epi32(aValues, 4), mask2f);
+	auto loNibbles = _mm_and_si128(aValues, mask2f);
+	auto hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+	auto lo = _mm_shuffle_epi8(lutLo, loNibbles);
+	if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0)
+	{
+		return false;
+	}
+	auto eq2f = _mm_cmpeq_epi8(aValues, mask2f);
+	auto roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(eq2f, hiNibbles));
+	aValues = _mm_add_epi8(aValues, roll);
+	return true;
+}
+
+
+
+
+
+__attribute__((target("ssse3")))
+static size_t base64DecodeSsse3(const char * aSrc, size_t aSrcSize, char * aDest)
+{
+	size_t consumed = 0;
+	while (aSrcSize - consumed >= 16)
+	{
+		auto values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(aSrc + consumed));
+		if (!base64DecodeTranslateSsse3(values))
+		{
+			break;
+		}
+
+		// Pack the 16 sextets into 12 bytes:
+		auto merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+		auto packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+		packed = _mm_shuffle_epi8(packed, _mm_setr_epi8(
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+		));
+		char out[16];
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out), packed);
+		memcpy(aDest, out, 12);
+		aDest += 12;
+		consumed += 16;
+	}
+	return consumed;
+}
+
+
+
+
+
+__attribute__((target("avx2")))
+static size_t base64DecodeAvx2(const char * aSrc, size_t aSrcSize, char * aDest)
+{
+	const __m256i lutLo = _mm256_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a
+	);
+	const __m256i lutHi = _mm256_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10
+	);
+	const __m256i lutRoll = _mm256_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71,
+		0,  0,  0, 0,   0,   0,   0,   0,
+		0, 16, 19, 4, -65, -65, -71, -71,
+		0,  0,  0, 0,   0,   0,   0,   0
+	);
+	const __m256i mask2f = _mm256_set1_epi8(0x2f);
+	size_t consumed = 0;
+	while (aSrcSize - consumed >= 32)
+	{
+		auto values = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(aSrc + consumed));
+		auto hiNibbles = _mm256_and_si256(_mm256_srli_epi32(values, 4), mask2f);
+		auto loNibbles = _mm256_and_si256(values, mask2f);
+		auto hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+		auto lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+		if (!_mm256_testz_si256(lo, hi))
+		{
+			break;
+		}
+		auto eq2f = _mm256_cmpeq_epi8(values, mask2f);
+		auto roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(eq2f, hiNibbles));
+		values = _mm256_add_epi8(values, roll);
+
+		// Pack the 32 sextets into 24 bytes:
+		auto merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+		auto packed = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+		packed = _mm256_shuffle_epi8(packed, _mm256_setr_epi8(
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+		));
+		packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1));
+		char out[32];
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out), packed);
+		memcpy(aDest, out, 24);
+		aDest += 24;
+		consumed += 32;
+	}
+
+	// Finish the tail in 16-char blocks:
+	return consumed + base64DecodeSsse3(aSrc + consumed, aSrcSize - consumed, aDest);
+}
+
+
+
+
+
+/** Spreads 12 input bytes (in a 16-byte register) into 16 sextets, one per byte. */
+__attribute__((target("ssse3")))
+static inline __m128i base64EncodeReshuffleSsse3(__m128i aIn)
+{
+	aIn = _mm_shuffle_epi8(aIn, _mm_set_epi8(
+		10, 11,  9, 10,
+		 7,  8,  6,  7,
+		 4,  5,  3,  4,
+		 1,  2,  0,  1
+	));
+	auto t0 = _mm_and_si128(aIn, _mm_set1_epi32(0x0fc0fc00));
+	auto t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+	auto t2 = _mm_and_si128(aIn, _mm_set1_epi32(0x003f03f0));
+	auto t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+	return _mm_or_si128(t1, t3);
+}
+
+
+
+
+
+/** Converts 16 sextets into their Base64 characters. */
+__attribute__((target("ssse3")))
+static inline __m128i base64EncodeTranslateSsse3(__m128i aIn)
+{
+	const __m128i lut = _mm_setr_epi8(
+		65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0
+	);
+	auto indices = _mm_subs_epu8(aIn, _mm_set1_epi8(51));
+	auto mask = _mm_cmpgt_epi8(aIn, _mm_set1_epi8(25));
+	indices = _mm_sub_epi8(indices, mask);
+	return _mm_add_epi8(aIn, _mm_shuffle_epi8(lut, indices));
+}
+
+
+
+
+
+__attribute__((target("ssse3")))
+static size_t base64EncodeSsse3(const char * aSrc, size_t aSrcSize, char * aDest)
+{
+	// Each step reads 16 bytes but consumes only 12:
+	size_t consumed = 0;
+	while (aSrcSize - consumed >= 16)
+	{
+		auto in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(aSrc + consumed));
+		auto out = base64EncodeTranslateSsse3(base64EncodeReshuffleSsse3(in));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(aDest), out);
+		aDest += 16;
+		consumed += 12;
+	}
+	return consumed;
+}
+
+
+
+
+
+__attribute__((target("avx2")))
+static size_t base64EncodeAvx2(const char * aSrc, size_t aSrcSize, char * aDest)
+{
+	const __m256i shuffle = _mm256_set_epi8(
+		10, 11,  9, 10, 7,  8,  6,  7, 4,  5,  3,  4, 1,  2,  0,  1,
+		10, 11,  9, 10, 7,  8,  6,  7, 4,  5,  3,  4, 1,  2,  0,  1
+	);
+	const __m256i lut = _mm256_setr_epi8(
+		65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0,
+		65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0
+	);
+
+	// Each step reads 12 + 16 bytes, one lane each, and consumes 24:
+	size_t consumed = 0;
+	while (aSrcSize - consumed >= 28)
+	{
+		auto lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(aSrc + consumed));
+		auto hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(aSrc + consumed + 12));
+		auto in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+		in = _mm256_shuffle_epi8(in, shuffle);
+		auto t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+		auto t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+		auto t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+		auto t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+		auto sextets = _mm256_or_si256(t1, t3);
+		auto indices = _mm256_subs_epu8(sextets, _mm256_set1_epi8(51));
+		auto mask = _mm256_cmpgt_epi8(sextets, _mm256_set1_epi8(25));
+		indices = _mm256_sub_epi8(indices, mask);
+		auto out = _mm256_add_epi8(sextets, _mm256_shuffle_epi8(lut, indices));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(aDest), out);
+		aDest += 32;
+		consumed += 24;
+	}
+
+	// Finish the tail in 12-byte blocks:
+	return consumed + base64EncodeSsse3(aSrc + consumed, aSrcSize - consumed, aDest);
+}
+
+#endif  // x86 with GCC / Clang
+
+
+
+
+
+/** Picks the best kernels for the CPU we're running on. */
+static Base64Kernels detectBase64Kernels()
+{
+	#ifdef HTTP_UTILS_X86_KERNELS
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+		{
+			return { &base64DecodeAvx2, &base64EncodeAvx2 };
+		}
+		if (__builtin_cpu_supports("ssse3"))
+		{
+			return { &base64DecodeSsse3, &base64EncodeSsse3 };
+		}
+	#endif  // HTTP_UTILS_X86_KERNELS
+	return { &base64NoKernel, &base64NoKernel };
+}
+
+
+
+
+
+/** Returns the kernels to use, detecting them on the first call. */
+static const Base64Kernels & base64Kernels()
+{
+	static const Base64Kernels kernels = detectBase64Kernels();
+	return kernels;
 }
 
 
@@ -215,32 +818,86 @@ static inline int UnBase64(char c)
 std::string base64Decode(const std::string & aBase64String)
 {
 	std::string res;
-	size_t i, len = aBase64String.size();
-	size_t o;
-	int c;
-	res.resize((len * 4) / 3 + 5, 0);  // Approximate the upper bound on the result length
-	for (o = 0, i = 0; i < len; i++)
-	{
-		c = UnBase64(aBase64String[i]);
-		if (c >= 0)
+	res.resize(base64DecodedMaxSize(aBase64String.size()));
+	res.resize(base64Decode(aBase64String.data(), aBase64String.size(), &res[0], res.size()));
+	return res;
+}
+
+
+
+
+
+size_t base64Decode(const char * aData, size_t aSize, char * aDest, size_t aDestSize)
+{
+	if (aDestSize < base64DecodedMaxSize(aSize))
+	{
+		return std::string::npos;
+	}
+	auto decodeKernel = base64Kernels().mDecode;
+	size_t i = 0;
+	size_t o = 0;
+	uint32_t acc = 0;  // The sextets of the quad being decoded
+	unsigned numSextets = 0;  // Number of sextets in acc
+	while (i < aSize)
+	{
+		if (numSextets == 0)
+		{
+			// On a quad boundary, let the kernel chew through as much as it can:
+			auto consumed = decodeKernel(aData + i, aSize - i, aDest + o);
+			i += consumed;
+			o += consumed / 4 * 3;
+			if (i >= aSize)
+			{
+				break;
+			}
+		}
+		auto c = CharTables::base64Value(aData[i++]);
+		if (c < 64)
 		{
-			switch (o & 7)
+			acc = (acc << 6) | c;
+			if (++numSextets == 4)
 			{
-				case 0: res[o >> 3] |= (c << 2); break;
-				case 6: res[o >> 3] |= (c >> 4); res[(o >> 3) + 1] |= (c << 4); break;
-				case 4: res[o >> 3] |= (c >> 2); res[(o >> 3) + 1] |= (c << 6); break;
-				case 2: res[o >> 3] |= c; break;
+				aDest[o++] = static_cast<char>(acc >> 16);
+				aDest[o++] = static_cast<char>(acc >> 8);
+				aDest[o++] = static_cast<char>(acc);
+				acc = 0;
+				numSextets = 0;
 			}
-			o += 6;
 		}
-		if (c == -1)
+		else if (c == CharTables::BASE64_PADDING)
 		{
-			// Error while decoding, invalid input. Return as much as we've decoded:
-			res.resize(o >> 3);
-			return res;
+			// Padding, no more data
+			break;
 		}
 	}
-	res.resize(o >> 3);
+
+	// Output the incomplete last quad, if any:
+	switch (numSextets)
+	{
+		case 2:
+		{
+			aDest[o++] = static_cast<char>(acc >> 4);
+			break;
+		}
+		case 3:
+		{
+			aDest[o++] = static_cast<char>(acc >> 10);
+			aDest[o++] = static_cast<char>(acc >> 2);
+			break;
+		}
+	}
+	return o;
+}
+
+
+
+
+
+std::string base64Encode(const std::string & aData)
+{
+	std::string res;
+	res.resize(base64EncodedSize(aData.size()));
+	base64Encode(aData.data(), aData.size(), &res[0], res.size());
 	return res;
 }
 
@@ -248,6 +905,51 @@ std::string base64Decode(const std::string & aBase64String)
 
 
 
+size_t base64Encode(const char * aData, size_t aSize, char * aDest, size_t aDestSize)
+{
+	static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	auto size = base64EncodedSize(aSize);
+	if (aDestSize < size)
+	{
+		return std::string::npos;
+	}
+	auto i = base64Kernels().mEncode(aData, aSize, aDest);
+	auto o = i / 3 * 4;
+	auto src = reinterpret_cast<const unsigned char *>(aData);
+	for (; i + 3 <= aSize; i += 3)
+	{
+		uint32_t triplet = (static_cast<uint32_t>(src[i]) << 16) | (static_cast<uint32_t>(src[i + 1]) << 8) | src[i + 2];
+		aDest[o++] = alphabet[(triplet >> 18) & 0x3f];
+		aDest[o++] = alphabet[(triplet >> 12) & 0x3f];
+		aDest[o++] = alphabet[(triplet >> 6) & 0x3f];
+		aDest[o++] = alphabet[triplet & 0x3f];
+	}
+	switch (aSize - i)
+	{
+		case 1:
+		{
+			aDest[o++] = alphabet[src[i] >> 2];
+			aDest[o++] = alphabet[(src[i] & 0x03) << 4];
+			aDest[o++] = '=';
+			aDest[o++] = '=';
+			break;
+		}
+		case 2:
+		{
+			aDest[o++] = alphabet[src[i] >> 2];
+			aDest[o++] = alphabet[((src[i] & 0x03) << 4) | (src[i + 1] >> 4)];
+			aDest[o++] = alphabet[(src[i + 1] & 0x0f) << 2];
+			aDest[o++] = '=';
+			break;
+		}
+	}
+	return o;
+}
+
+
+
+
+
 std::string replaceAllCharOccurrences(const std::string & aString, char aFrom, char aTo)
 {
 	std::string res(aString);
@@ -311,46 +1013,59 @@ static std::string UnicodeCharToUtf8(unsigned aUnicodeChar)
 std::pair<bool, std::string> urlDecode(const std::string & aText)
 {
 	std::string res;
+	if (!urlDecodeAppend(aText, true, res))
+	{
+		return std::make_pair(false, std::string());
+	}
+	return std::make_pair(true, res);
+}
+
+
+
+
+
+bool urlDecodeAppend(std::string_view aText, bool aIsPlusSpace, std::string & aOut)
+{
 	auto len = aText.size();
-	res.reserve(len);
+	aOut.reserve(aOut.size() + len);
 	for (size_t i = 0; i < len; i++)
 	{
-		if (aText[i] == '+')
+		if ((aText[i] == '+') && aIsPlusSpace)
 		{
-			res.push_back(' ');
+			aOut.push_back(' ');
 			continue;
 		}
 		if (aText[i] != '%')
 		{
-			res.push_back(aText[i]);
+			aOut.push_back(aText[i]);
 			continue;
 		}
 		if (i + 1 >= len)
 		{
 			// String too short for an encoded value
-			return std::make_pair(false, std::string());
+			return false;
 		}
 		if ((aText[i + 1] == 'u') || (aText[i + 1] == 'U'))
 		{
 			// Unicode char "%u0xxxx"
 			if (i + 6 >= len)
 			{
-				return std::make_pair(false, std::string());
+				return false;
 			}
 			if (aText[i + 2] != '0')
 			{
-				return std::make_pair(false, std::string());
+				return false;
 			}
-			unsigned v1 = hexToDec(aText[i + 3]);
-			unsigned v2 = hexToDec(aText[i + 4]);
-			unsigned v3 = hexToDec(aText[i + 5]);
-			unsigned v4 = hexToDec(aText[i + 6]);
+			unsigned v1 = hexDigitValue(aText[i + 3]);
+			unsigned v2 = hexDigitValue(aText[i + 4]);
+			unsigned v3 = hexDigitValue(aText[i + 5]);
+			unsigned v4 = hexDigitValue(aText[i + 6]);
 			if ((v1 == 0xff) || (v2 == 0xff) || (v4 == 0xff) || (v3 == 0xff))
 			{
 				// Invalid hex numbers
-				return std::make_pair(false, std::string());
+				return false;
 			}
-			res.append(UnicodeCharToUtf8((v1 << 12) | (v2 << 8) | (v3 << 4) | v4));
+			aOut.append(UnicodeCharToUtf8((v1 << 12) | (v2 << 8) | (v3 << 4) | v4));
 			i = i + 6;
 		}
 		else
@@ -358,20 +1073,69 @@ std::pair<bool, std::string> urlDecode(const std::string & aText)
 			// Regular char "%xx":
 			if (i + 2 >= len)
 			{
-				return std::make_pair(false, std::string());
+				return false;
 			}
-			auto v1 = hexToDec(aText[i + 1]);
-			auto v2 = hexToDec(aText[i + 2]);
+			auto v1 = hexDigitValue(aText[i + 1]);
+			auto v2 = hexDigitValue(aText[i + 2]);
 			if ((v1 == 0xff) || (v2 == 0xff))
 			{
 				// Invalid hex numbers
-				return std::make_pair(false, std::string());
+				return false;
 			}
-			res.push_back(static_cast<char>((v1 << 4) | v2));
+			aOut.push_back(static_cast<char>((v1 << 4) | v2));
 			i = i + 2;
 		}
 	}  // for i - aText[i]
-	return std::make_pair(true, res);
+	return true;
+}
+
+
+
+
+
+bool isPersistentHttpVersion(std::string_view aVersion)
+{
+	return (
+		(aVersion.size() >= 8) &&
+		(aVersion.substr(0, 7) == "HTTP/1.") &&
+		(aVersion.substr(7) != "0")
+	);
+}
+
+
+
+
+
+std::string_view trimOws(std::string_view aText)
+{
+	while (!aText.empty() && CharTables::isWhitespace(aText.front()))
+	{
+		aText.remove_prefix(1);
+	}
+	while (!aText.empty() && CharTables::isWhitespace(aText.back()))
+	{
+		aText.remove_suffix(1);
+	}
+	return aText;
+}
+
+
+
+
+
+bool nextListElement(std::string_view & aList, std::string_view & aElement)
+{
+	while (!aList.empty())
+	{
+		auto idxComma = aList.find(',');
+		aElement = trimOws(aList.substr(0, idxComma));
+		aList.remove_prefix((idxComma == std::string_view::npos) ? aList.size() : idxComma + 1);
+		if (!aElement.empty())
+		{
+			return true;
+		}
+	}
+	return false;
 }
 
 
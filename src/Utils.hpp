@@ -1,8 +1,13 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <limits>
+#include <ctime>
+#include <cstdint>
+#include <cstring>
+#include "CharTables.hpp"
 
 
 
@@ -21,16 +26,88 @@ std::vector<std::string> stringSplit(const std::string & aInput, const std::stri
 Returns the formatted string by value. */
 extern std::string printf(const char * format, ...);
 
-/** Returns a lower-cased copy of the string */
-extern std::string strToLower(const std::string & s);
+/** The maximum number of characters that formatNumber() writes. */
+static const size_t MAX_NUMBER_CHARS = 20;
 
-/** Case-insensitive string comparison.
+/** Writes the decimal representation of the number into aDest, which must have room for at least
+MAX_NUMBER_CHARS characters. Doesn't allocate and doesn't depend on the locale.
+Returns the number of characters written. */
+extern size_t formatNumber(char * aDest, unsigned long long aNumber);
+
+/** The number of characters that formatHttpDate() writes. */
+static const size_t HTTP_DATE_LENGTH = 29;
+
+/** Writes the time in the IMF-fixdate format used by HTTP (RFC 7231 @ 7.1.1.1), such as
+"Sun, 06 Nov 1994 08:49:37 GMT", into aDest, which must have room for at least HTTP_DATE_LENGTH chars.
+Doesn't depend on the locale and is thread-safe.
+Returns the number of characters written. */
+extern size_t formatHttpDate(char * aDest, std::time_t aTime);
+
+/** Parses the HTTP date (RFC 7231 @ 7.1.1.1) into aTime. Accepts the IMF-fixdate format produced by
+formatHttpDate() through a fixed-position fast path, as well as the obsolete RFC 850 and asctime() formats.
+Doesn't depend on the locale or the time zone and is thread-safe.
+Returns false if the text is not a valid HTTP date. */
+extern bool parseHttpDate(std::string_view aText, std::time_t & aTime);
+
+/** Returns a lower-cased copy of the string.
+Only the ASCII letters are converted, independent of the locale. */
+extern std::string strToLower(std::string_view s);
+
+/** Lower-cases the ASCII letters in the string in place, independent of the locale. */
+extern void asciiLowerInPlace(char * aData, size_t aSize);
+
+/** Lower-cases the ASCII letters in the string in place, independent of the locale. */
+inline void asciiLowerInPlace(std::string & aString)
+{
+	asciiLowerInPlace(&aString[0], aString.size());
+}
+
+/** Returns the ASCII character lower-cased; any other character is returned unchanged. */
+inline char asciiToLower(char aChar)
+{
+	return ((aChar >= 'A') && (aChar <= 'Z')) ? static_cast<char>(aChar | 0x20) : aChar;
+}
+
+/** Case-insensitive string comparison of ASCII strings, independent of the locale. Doesn't allocate.
 Returns 0 if the strings are the same, <0 if s1 < s2 and >0 if s1 > s2. */
-extern int noCaseCompare(const std::string & s1, const std::string & s2);
+extern int noCaseCompare(std::string_view s1, std::string_view s2);
+
+/** Returns true if the strings are the same, ignoring the case of ASCII letters. Doesn't allocate. */
+extern bool noCaseEqual(std::string_view s1, std::string_view s2);
+
+/** Returns a hash of the string that ignores the case of ASCII letters, so that noCaseEqual() strings hash
+the same. Doesn't allocate. */
+extern size_t noCaseHash(std::string_view s);
 
 /** Decodes a Base64-encoded string into the raw data */
 extern std::string base64Decode(const std::string & aBase64String);
 
+/** Decodes Base64-encoded data into the caller-provided buffer, without allocating.
+Characters outside the Base64 alphabet are skipped, decoding stops at the first padding character.
+Returns the number of bytes written into aDest, or std::string::npos if aDestSize is smaller than
+base64DecodedMaxSize(aSize). */
+extern size_t base64Decode(const char * aData, size_t aSize, char * aDest, size_t aDestSize);
+
+/** Returns the maximum number of bytes that decoding aBase64Size characters can produce. */
+inline size_t base64DecodedMaxSize(size_t aBase64Size)
+{
+	return (aBase64Size / 4) * 3 + ((aBase64Size % 4) * 3) / 4;
+}
+
+/** Encodes the raw data into a Base64 string, including the padding. */
+extern std::string base64Encode(const std::string & aData);
+
+/** Encodes the raw data into the caller-provided buffer, including the padding, without allocating.
+Returns the number of characters written into aDest, or std::string::npos if aDestSize is smaller than
+base64EncodedSize(aSize). */
+extern size_t base64Encode(const char * aData, size_t aSize, char * aDest, size_t aDestSize);
+
+/** Returns the number of characters that encoding aDataSize bytes into Base64 produces. */
+inline size_t base64EncodedSize(size_t aDataSize)
+{
+	return ((aDataSize + 2) / 3) * 4;
+}
+
 /** Replaces all occurrences of char aFrom inside aString with char aTo. */
 extern std::string replaceAllCharOccurrences(const std::string & aString, char aFrom, char aTo);
 
@@ -39,75 +116,228 @@ The first value specifies whether the decoding was successful.
 The second value is the decoded string, if successful. */
 extern std::pair<bool, std::string> urlDecode(const std::string & aString);
 
+/** URL-Decodes the given string, appending the result to aOut.
+If aIsPlusSpace is true, '+' is decoded as a space (query strings), otherwise it is kept (paths).
+Returns true if successful; on failure, aOut may contain a part of the decoded data. */
+extern bool urlDecodeAppend(std::string_view aText, bool aIsPlusSpace, std::string & aOut);
 
+/** Returns true if connections of the specified protocol version ("HTTP/1.1") are persistent unless the
+Connection header says otherwise: HTTP/1.1 and later 1.x versions (RFC 7230 @ 6.3). */
+extern bool isPersistentHttpVersion(std::string_view aVersion);
 
+/** Returns the string with the leading and trailing optional whitespace (SP and HTAB) removed. */
+extern std::string_view trimOws(std::string_view aText);
 
+/** Splits the next element off a comma-separated header value list (RFC 7230 @ 7), such as the value of
+the Connection or Accept-Encoding headers. Stores the element, without the whitespace around it, into aElement
+and removes it from aList. Empty elements are skipped. Returns false if there are no more elements. */
+extern bool nextListElement(std::string_view & aList, std::string_view & aElement);
 
-/** Parses any integer type. Checks bounds and returns errors out of band. */
-template <class T>
-bool stringToInteger(const std::string & astr, T & aNum)
+
+
+
+
+/** Returns true if all the 8 chars packed in the word are ASCII decimal digits. */
+inline bool isEightDigits(uint64_t aWord)
 {
+	return (
+		((aWord & 0xf0f0f0f0f0f0f0f0ULL) | (((aWord + 0x0606060606060606ULL) & 0xf0f0f0f0f0f0f0f0ULL) >> 4)) ==
+		0x3333333333333333ULL
+	);
+}
+
+
+
+
+
+/** Converts the 8 ASCII decimal digits, packed in the word in little-endian order, into their value. */
+inline uint64_t parseEightDigits(uint64_t aWord)
+{
+	aWord -= 0x3030303030303030ULL;
+	aWord = (aWord * 10) + (aWord >> 8);  // Pairs of digits
+	return (
+		((aWord & 0x000000ff000000ffULL) * (100 + (1000000ULL << 32))) +
+		(((aWord >> 16) & 0x000000ff000000ffULL) * (1 + (10000ULL << 32)))
+	) >> 32;
+}
+
+
+
+
+
+/** Parses a run of decimal digits (no sign) into a 64-bit value.
+Processes 8 digits at a time where possible, checks for overflow only once, at the end.
+Returns false if there's a non-digit or if the value doesn't fit. */
+inline bool parseDecimalDigits(std::string_view aDigits, uint64_t & aValue)
+{
+	// Skip the leading zeroes, so that the number of digits tells whether the value may overflow:
 	size_t i = 0;
-	bool positive = true;
-	T result = 0;
-	if (astr[0] == '+')
+	size_t size = aDigits.size();
+	while ((i < size) && (aDigits[i] == '0'))
 	{
 		i++;
 	}
-	else if (astr[0] == '-')
+	if (size - i > 20)  // UINT64_MAX has 20 digits
 	{
-		i++;
-		positive = false;
+		return false;
 	}
-	if (positive)
-	{
-		for (size_t size = astr.size(); i < size; i++)
+
+	// Up to 19 digits cannot overflow:
+	size_t safeEnd = (size - i == 20) ? size - 1 : size;
+	uint64_t value = 0;
+	#if (defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)) || defined(_MSC_VER)
+		while (safeEnd - i >= 8)
 		{
-			if ((astr[i] < '0') || (astr[i] > '9'))
+			uint64_t word;
+			memcpy(&word, aDigits.data() + i, sizeof(word));
+			if (!isEightDigits(word))
 			{
 				return false;
 			}
-			if (std::numeric_limits<T>::max() / 10 < result)
-			{
-				return false;
-			}
-			result *= 10;
-			T digit = static_cast<T>(astr[i] - '0');
-			if (std::numeric_limits<T>::max() - digit < result)
+			value = value * 100000000ULL + parseEightDigits(word);
+			i += 8;
+		}
+	#endif
+	for (; i < safeEnd; i++)
+	{
+		auto digit = static_cast<unsigned char>(aDigits[i] - '0');
+		if (digit > 9)
+		{
+			return false;
+		}
+		value = value * 10 + digit;
+	}
+
+	// The 20th digit needs the single overflow check:
+	if (safeEnd < size)
+	{
+		auto digit = static_cast<unsigned char>(aDigits[safeEnd] - '0');
+		if ((digit > 9) || (value > (std::numeric_limits<uint64_t>::max() - digit) / 10))
+		{
+			return false;
+		}
+		value = value * 10 + digit;
+	}
+	aValue = value;
+	return true;
+}
+
+
+
+
+
+/** Parses any integer type. Checks bounds and returns errors out of band. */
+template <class T>
+bool stringToInteger(std::string_view astr, T & aNum)
+{
+	static_assert(std::numeric_limits<T>::is_integer && (sizeof(T) <= sizeof(uint64_t)), "Unsupported integer type");
+	bool positive = true;
+	if (!astr.empty())
+	{
+		if (astr[0] == '+')
+		{
+			astr.remove_prefix(1);
+		}
+		else if (astr[0] == '-')
+		{
+			// Unsigned result cannot be signed!
+			if (!std::numeric_limits<T>::is_signed)
 			{
 				return false;
 			}
-			result += digit;
+			astr.remove_prefix(1);
+			positive = false;
 		}
 	}
+	uint64_t value;
+	if (!parseDecimalDigits(astr, value))
+	{
+		return false;
+	}
+	auto maxValue = static_cast<uint64_t>(std::numeric_limits<T>::max());
+	if (positive)
+	{
+		if (value > maxValue)
+		{
+			return false;
+		}
+		aNum = static_cast<T>(value);
+	}
 	else
 	{
-		// Unsigned result cannot be signed!
-		if (!std::numeric_limits<T>::is_signed)
+		// The magnitude of min() is one more than max():
+		if (value > maxValue + 1)
 		{
 			return false;
 		}
+		aNum = (value == 0) ? 0 : static_cast<T>(-static_cast<T>(value - 1) - 1);
+	}
+	return true;
+}
+
+
+
+
+
+/** Returns the value of the single hex digit.
+Returns 0xff on failure. */
+inline unsigned char hexDigitValue(char aHexChar)
+{
+	return CharTables::hexValue(aHexChar);
+}
+
+
 
-		for (size_t size = astr.size(); i < size; i++)
+
+
+/** Accumulates the hex digits at the start of the data into aValue, which may already hold the leading digits
+of a number split across several buffers (such as a chunk length). Stops at the first non-hex-digit character.
+The overflow is checked only once after the digits, so the only branch per digit is the end of the number.
+Returns the number of digits consumed, or std::string::npos if the value doesn't fit into size_t. */
+inline size_t accumulateHexDigits(const char * aData, size_t aSize, size_t & aValue)
+{
+	const size_t numBits = static_cast<size_t>(std::numeric_limits<size_t>::digits);
+	size_t value = aValue;
+	size_t overflowBits = 0;
+	size_t numDigits = 0;
+	for (; numDigits < aSize; numDigits++)
+	{
+		auto digit = CharTables::hexValue(aData[numDigits]);
+		if (digit == CharTables::INVALID)
 		{
-			if ((astr[i] < '0') || (astr[i] > '9'))
-			{
-				return false;
-			}
-			if (std::numeric_limits<T>::min() / 10 > result)
-			{
-				return false;
-			}
-			result *= 10;
-			T digit = static_cast<T>(astr[i] - '0');
-			if (std::numeric_limits<T>::min() + digit > result)
-			{
-				return false;
-			}
-			result -= digit;
+			break;
 		}
+		overflowBits |= value >> (numBits - 4);
+		value = (value << 4) | digit;
+	}
+	if (overflowBits != 0)
+	{
+		return std::string::npos;
+	}
+	aValue = value;
+	return numDigits;
+}
+
+
+
+
+
+/** Parses an unsigned hexadecimal number (no sign, no "0x" prefix) into any integer type.
+Checks bounds and returns errors out of band. An empty string is an error, as is a value that doesn't fit size_t. */
+template <class T>
+bool hexStringToInteger(std::string_view aStr, T & aNum)
+{
+	static_assert(std::numeric_limits<T>::is_integer && (sizeof(T) <= sizeof(uint64_t)), "Unsupported integer type");
+	size_t value = 0;
+	if (aStr.empty() || (accumulateHexDigits(aStr.data(), aStr.size(), value) != aStr.size()))
+	{
+		return false;
+	}
+	if (value > static_cast<uint64_t>(std::numeric_limits<T>::max()))
+	{
+		return false;
 	}
-	aNum = result;
+	aNum = static_cast<T>(value);
 	return true;
 }
 
@@ -0,0 +1,367 @@
+// AllocationBudget.cpp
+
+// Checks that the recycled parsers keep to their heap allocation budgets, as promised by the README:
+// once an object has processed a message of a given shape, further messages of the same shape make no allocations.
+// Counts the allocations through the replaced global operator new; returns a non-zero exit code on any overrun.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include "../src/Compression.hpp"
+#include "../src/ConditionalRequest.hpp"
+#include "../src/EnvelopeParser.hpp"
+#include "../src/FormParser.hpp"
+#include "../src/HeaderTape.hpp"
+#include "../src/Message.hpp"
+#include "../src/MessageParser.hpp"
+#include "../src/MultipartParser.hpp"
+#include "../src/NameValueParser.hpp"
+#include "../src/PullParser.hpp"
+#include "../src/Range.hpp"
+#include "../src/TransferEncodingParser.hpp"
+
+
+
+
+
+/** The number of allocations made through the global operator new so far. */
+static size_t gNumAllocations = 0;
+
+
+
+
+
+void * operator new(size_t aSize)
+{
+	gNumAllocations += 1;
+	if (auto res = std::malloc((aSize == 0) ? 1 : aSize))
+	{
+		return res;
+	}
+	throw std::bad_alloc();
+}
+
+
+
+
+
+void operator delete(void * aPtr) noexcept
+{
+	std::free(aPtr);
+}
+
+
+
+
+
+void operator delete(void * aPtr, size_t) noexcept
+{
+	std::free(aPtr);
+}
+
+
+
+
+
+using namespace Http;
+
+namespace
+{
+
+/** The number of messages processed before the counting starts, so that all the buffers have grown. */
+const int NUM_WARMUP_MESSAGES = 10;
+
+/** The number of messages over which the allocations are counted. */
+const int NUM_MEASURED_MESSAGES = 100;
+
+/** The number of checks that went over their budget. */
+int gNumFailures = 0;
+
+
+
+const char REQUEST_CHUNKED[] =
+	"POST /upload HTTP/1.1\r\n"
+	"Host: example.com\r\n"
+	"User-Agent: some-fairly-long-user-agent-string/1.0\r\n"
+	"Transfer-Encoding: chunked\r\n"
+	"\r\n"
+	"5\r\nhello\r\n"
+	"6\r\n world\r\n"
+	"0\r\n"
+	"Trailer: x\r\n"
+	"\r\n";
+
+const char REQUEST_IDENTITY[] =
+	"POST /upload HTTP/1.1\r\n"
+	"Host: example.com\r\n"
+	"Content-Length: 5\r\n"
+	"\r\n"
+	"hello";
+
+const char CHUNKED_BODY[] =
+	"5\r\nhello\r\n"
+	"6\r\n world\r\n"
+	"0\r\n"
+	"\r\n";
+
+const char MULTIPART_CONTENT_TYPE[] = "multipart/form-data; boundary=----WebKitFormBoundary7MA4YWxkTrZu0gW";
+
+const char MULTIPART_BODY[] =
+	"------WebKitFormBoundary7MA4YWxkTrZu0gW\r\n"
+	"Content-Disposition: form-data; name=\"text\"\r\n"
+	"\r\n"
+	"some text\r\n"
+	"------WebKitFormBoundary7MA4YWxkTrZu0gW\r\n"
+	"Content-Disposition: form-data; name=\"file\"; filename=\"a.txt\"\r\n"
+	"Content-Type: text/plain\r\n"
+	"\r\n"
+	"file contents\r\n"
+	"------WebKitFormBoundary7MA4YWxkTrZu0gW--\r\n";
+
+const char NAME_VALUE[] = "form-data; name=\"file\"; filename=\"some-file-name.txt\"";
+
+const char HEADER_BLOCK[] =
+	"Host: example.com\r\n"
+	"Accept-Encoding: gzip, deflate\r\n"
+	"If-None-Match: \"abc\", W/\"def\"\r\n"
+	"Range: bytes=0-99,200-299,-50\r\n"
+	"X-Folded: first\r\n"
+	" second\r\n"
+	"\r\n";
+
+
+
+
+
+/** Runs the message processing through the warmup, then counts its allocations and compares them with
+the budget, which is the maximum allowed average number of allocations per message. */
+template <typename Fn>
+void check(const char * aName, double aBudget, Fn && aProcessMessage)
+{
+	for (int i = 0; i < NUM_WARMUP_MESSAGES; ++i)
+	{
+		aProcessMessage();
+	}
+	auto before = gNumAllocations;
+	for (int i = 0; i < NUM_MEASURED_MESSAGES; ++i)
+	{
+		aProcessMessage();
+	}
+	auto perMessage = static_cast<double>(gNumAllocations - before) / NUM_MEASURED_MESSAGES;
+	bool isOk = (perMessage <= aBudget);
+	std::printf("%-28s %6.2f allocations / message (budget %.2f)%s\n", aName, perMessage, aBudget, isOk ? "" : "  OVER BUDGET");
+	if (!isOk)
+	{
+		gNumFailures += 1;
+	}
+}
+
+
+
+/** Ignores all the events of MessageParser, except for the errors, which fail the check. */
+class MessageCallbacks:
+	public MessageParser::Callbacks
+{
+	void onError(const std::string & aErrorDescription) override
+	{
+		std::printf("MessageParser error: %s\n", aErrorDescription.c_str());
+		gNumFailures += 1;
+	}
+	void onFirstLine(const std::string &) override {}
+	void onHeaderLine(const std::string &, const std::string &) override {}
+	void onHeadersFinished() override {}
+	void onBodyData(const void *, size_t) override {}
+	void onBodyFinished() override {}
+};
+
+
+
+/** Ignores all the events of TransferEncodingParser, except for the errors, which fail the check. */
+class TransferEncodingCallbacks:
+	public TransferEncodingParser::Callbacks
+{
+	void onError(const std::string & aErrorDescription) override
+	{
+		std::printf("TransferEncodingParser error: %s\n", aErrorDescription.c_str());
+		gNumFailures += 1;
+	}
+	void onBodyData(const void *, size_t) override {}
+	void onBodyFinished() override {}
+};
+
+
+
+/** Ignores all the events of MultipartParser. */
+class MultipartCallbacks:
+	public MultipartParser::Callbacks
+{
+	void onPartStart() override {}
+	void onPartHeader(const std::string &, const std::string &) override {}
+	void onPartData(const char *, size_t) override {}
+	void onPartEnd() override {}
+};
+
+
+
+/** Ignores the files of FormParser. */
+class FormCallbacks:
+	public FormParser::Callbacks
+{
+	void onFileStart(FormParser &, const std::string &) override {}
+	void onFileData(FormParser &, const char *, size_t) override {}
+	void onFileEnd(FormParser &) override {}
+};
+
+}  // anonymous namespace
+
+
+
+
+
+int main()
+{
+	MessageCallbacks messageCallbacks;
+	MessageParser messageParser(messageCallbacks);
+	check("MessageParser chunked", 0, [&]()
+		{
+			// Feed the message in small pieces, so that the lines split across the parse() calls:
+			messageParser.reset();
+			const size_t size = sizeof(REQUEST_CHUNKED) - 1;
+			for (size_t ofs = 0; ofs < size; ofs += 13)
+			{
+				messageParser.parse(REQUEST_CHUNKED + ofs, std::min<size_t>(13, size - ofs));
+			}
+		}
+	);
+	check("MessageParser mixed", 0, [&]()
+		{
+			messageParser.reset();
+			messageParser.parse(REQUEST_CHUNKED, sizeof(REQUEST_CHUNKED) - 1);
+			messageParser.reset();
+			messageParser.parse(REQUEST_IDENTITY, sizeof(REQUEST_IDENTITY) - 1);
+		}
+	);
+
+	TransferEncodingCallbacks teCallbacks;
+	auto teParser = TransferEncodingParser::create(teCallbacks, "chunked", 0);
+	check("ChunkedTEParser", 0, [&]()
+		{
+			teParser->restart("chunked", 0);
+			teParser->parse(CHUNKED_BODY, sizeof(CHUNKED_BODY) - 1);
+		}
+	);
+
+	MultipartCallbacks multipartCallbacks;
+	std::string multipartContentType(MULTIPART_CONTENT_TYPE);
+	MultipartParser multipartParser(multipartContentType, multipartCallbacks);
+	check("MultipartParser", 0, [&]()
+		{
+			multipartParser.reset(multipartContentType);
+			multipartParser.parse(MULTIPART_BODY, sizeof(MULTIPART_BODY) - 1);
+		}
+	);
+
+	NameValueParser nameValueParser;
+	check("NameValueParser", 0, [&]()
+		{
+			nameValueParser.reset();
+			nameValueParser.parse(NAME_VALUE, sizeof(NAME_VALUE) - 1);
+			nameValueParser.finish();
+		}
+	);
+
+	IncomingRequest formRequest("POST", "/upload", "HTTP/1.1");
+	formRequest.addHeader("Content-Type", MULTIPART_CONTENT_TYPE);
+	FormCallbacks formCallbacks;
+	FormParser formParser(formRequest, formCallbacks);
+	check("FormParser multipart", 0, [&]()
+		{
+			formParser.reset(formRequest, formCallbacks);
+			formParser.parse(MULTIPART_BODY, sizeof(MULTIPART_BODY) - 1);
+			formParser.finish();
+		}
+	);
+
+	PullParser pullParser;
+	check("PullParser", 0, [&]()
+		{
+			pullParser.reset();
+			pullParser.setInput(REQUEST_CHUNKED, sizeof(REQUEST_CHUNKED) - 1);
+			for (;;)
+			{
+				auto event = pullParser.next();
+				if (event.mType == PullParser::etError)
+				{
+					std::printf("PullParser error: %.*s\n", static_cast<int>(event.mValue.size()), event.mValue.data());
+					gNumFailures += 1;
+					break;
+				}
+				if ((event.mType == PullParser::etMessageEnd) || (event.mType == PullParser::etNeedMoreData))
+				{
+					break;
+				}
+			}
+		}
+	);
+
+	HeaderTape headerTape;
+	check("HeaderTape", 0, [&]()
+		{
+			headerTape.clear();
+			if (EnvelopeParser::parseTape(HEADER_BLOCK, sizeof(HEADER_BLOCK) - 1, headerTape) == std::string::npos)
+			{
+				std::printf("HeaderTape: failed to parse the header block\n");
+				gNumFailures += 1;
+			}
+			headerTape.find(hiRange);
+		}
+	);
+
+	RangeSet rangeSet;
+	check("RangeSet", 0, [&]()
+		{
+			rangeSet.parse("bytes=0-99,200-299,-50", 10000);
+		}
+	);
+
+	check("ConditionalRequest", 0, [&]()
+		{
+			ConditionalRequest conditions;
+			for (const auto & entry: headerTape)
+			{
+				conditions.addHeader(static_cast<HeaderId>(entry.mId), HeaderTape::rawValue(HEADER_BLOCK, entry));
+			}
+			if (conditions.evaluate("GET", "\"def\"", ConditionalRequest::NO_DATE) != ConditionalRequest::coNotModified)
+			{
+				std::printf("ConditionalRequest: unexpected outcome\n");
+				gNumFailures += 1;
+			}
+		}
+	);
+
+	// zlib allocates its state through malloc(), it's only the library's own buffers that are counted here:
+	std::string body;
+	for (int i = 0; i < 200; ++i)
+	{
+		body.append("Some fairly compressible response body text. ");
+	}
+	Compressor compressor(Compressor::ccGzip);
+	std::string compressed;
+	check("Compressor", 0, [&]()
+		{
+			compressor.reset(Compressor::ccGzip);
+			compressed.clear();
+			compressor.write(body.data(), body.size(), compressed);
+			compressor.finish(compressed);
+		}
+	);
+
+	if (gNumFailures > 0)
+	{
+		std::printf("%d check(s) failed\n", gNumFailures);
+		return 1;
+	}
+	return 0;
+}
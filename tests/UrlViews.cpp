@@ -0,0 +1,117 @@
+// UrlViews.cpp
+
+// Checks that the views returned by IncomingRequest's URL accessors stay valid for the lifetime of the request,
+// even when another index of the URL components is built after the view has been taken.
+// Returns a non-zero exit code on failure.
+
+#include <cstdio>
+#include <string>
+#include "../src/Message.hpp"
+
+
+
+
+
+using namespace Http;
+
+namespace
+{
+
+/** The number of checks that failed. */
+int gNumFailures = 0;
+
+
+
+
+
+/** Reports a failure if the view doesn't hold the expected value. */
+void expectEqual(const char * aName, std::string_view aActual, std::string_view aExpected)
+{
+	if (aActual != aExpected)
+	{
+		std::printf(
+			"%s: expected \"%.*s\", got \"%.*s\"\n",
+			aName,
+			static_cast<int>(aExpected.size()), aExpected.data(),
+			static_cast<int>(aActual.size()), aActual.data()
+		);
+		gNumFailures += 1;
+	}
+}
+
+
+
+
+
+/** Returns a URL with the path "/abc/def" and many query parameters, k0=v 0 ... kN=v N, so that indexing
+the query appends a lot of decoded data after the path segments. */
+std::string makeUrl(int aNumParams)
+{
+	std::string url("/abc/def?");
+	for (int i = 0; i < aNumParams; ++i)
+	{
+		url.append((i == 0) ? "" : "&");
+		url.append("k" + std::to_string(i) + "=v%20" + std::to_string(i));
+	}
+	return url;
+}
+
+}  // anonymous namespace
+
+
+
+
+
+int main()
+{
+	auto url = makeUrl(200);
+
+	// A path segment view held across the query indexing:
+	{
+		IncomingRequest request("GET", url, "HTTP/1.1");
+		auto segment = request.pathSegment(0);
+		std::string_view value;
+		if (!request.queryParam("k0", value))
+		{
+			std::printf("Query parameter k0 not found\n");
+			gNumFailures += 1;
+		}
+		expectEqual("pathSegment(0) after queryParam()", segment, "abc");
+		expectEqual("queryParam(k0)", value, "v 0");
+	}
+
+	// A query parameter view held across the path indexing:
+	{
+		IncomingRequest request("GET", url, "HTTP/1.1");
+		auto name = request.queryParamName(199);
+		auto value = request.queryParamValue(199);
+		expectEqual("pathSegment(1)", request.pathSegment(1), "def");
+		expectEqual("queryParamName(199) after pathSegment()", name, "k199");
+		expectEqual("queryParamValue(199) after pathSegment()", value, "v 199");
+	}
+
+	// The same on a recycled request, whose buffer was reserved for a shorter URL:
+	{
+		IncomingRequest request("GET", "/x?a=b", "HTTP/1.1");
+		request.pathSegment(0);
+		request.queryParamCount();
+		request.reset("GET", url, "HTTP/1.1");
+		auto segment = request.pathSegment(0);
+		request.queryParamCount();
+		expectEqual("pathSegment(0) after reset() and queryParamCount()", segment, "abc");
+	}
+
+	// The path ends at the fragment even without a query:
+	{
+		IncomingRequest request("GET", "/index.html#top", "HTTP/1.1");
+		expectEqual("urlPath() with a fragment", request.urlPath(), "/index.html");
+		expectEqual("urlFragment()", request.urlFragment(), "top");
+	}
+
+	if (gNumFailures > 0)
+	{
+		std::printf("%d check(s) failed\n", gNumFailures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,121 @@
+// HttpStreamAnalyzer.cpp
+
+// Analyzes a file of captured concatenated HTTP/1.x messages in parallel and prints a summary.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include "../src/StreamAnalyzer.hpp"
+
+
+
+
+
+/** Collects the statistics over all messages, optionally printing each message. */
+class Summary:
+	public Http::StreamAnalyzer::Callbacks
+{
+public:
+
+	/** If true, each message is printed as it is reported. */
+	bool mIsVerbose;
+
+	size_t mNumMessages;
+	size_t mNumErrors;
+	size_t mNumHeaders;
+	size_t mBodyBytes;
+
+	/** Number of messages per method (requests) or per "HTTP/1.x NNN" (responses). */
+	std::map<std::string, size_t> mKinds;
+
+
+	Summary(bool aIsVerbose):
+		mIsVerbose(aIsVerbose),
+		mNumMessages(0),
+		mNumErrors(0),
+		mNumHeaders(0),
+		mBodyBytes(0)
+	{
+	}
+
+	virtual void onMessage(const Http::StreamAnalyzer::MessageInfo & aMessage) override
+	{
+		mNumMessages += 1;
+		mNumHeaders += aMessage.mNumHeaders;
+		mBodyBytes += aMessage.mBodySize;
+		if (!aMessage.mError.empty())
+		{
+			mNumErrors += 1;
+		}
+		if (mIsVerbose)
+		{
+			printf("%zu\t%zu\t%zu\t%zu\t%s\t%s\n",
+				aMessage.mOffset, aMessage.mSize, aMessage.mNumHeaders, aMessage.mBodySize,
+				aMessage.mFirstLine.c_str(), aMessage.mError.c_str()
+			);
+		}
+		const auto & firstLine = aMessage.mFirstLine;
+		auto kindEnd = (firstLine.compare(0, 5, "HTTP/") == 0) ? firstLine.find(' ', firstLine.find(' ') + 1) : firstLine.find(' ');
+		mKinds[firstLine.substr(0, kindEnd)] += 1;
+	}
+};
+
+
+
+
+
+int main(int argc, char * argv[])
+{
+	unsigned numThreads = 0;
+	bool isVerbose = false;
+	const char * fileName = nullptr;
+	for (int i = 1; i < argc; ++i)
+	{
+		if ((strcmp(argv[i], "-j") == 0) && (i + 1 < argc))
+		{
+			numThreads = static_cast<unsigned>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "-v") == 0)
+		{
+			isVerbose = true;
+		}
+		else
+		{
+			fileName = argv[i];
+		}
+	}
+	if (fileName == nullptr)
+	{
+		fprintf(stderr, "Usage: %s [-j <numThreads>] [-v] <file>\n", argv[0]);
+		fprintf(stderr, "  -j  Number of threads to use (default: number of cores)\n");
+		fprintf(stderr, "  -v  Print each message: offset, size, headers, body size, first line, error\n");
+		return 1;
+	}
+
+	Summary summary(isVerbose);
+	auto startTime = std::chrono::steady_clock::now();
+	Http::StreamAnalyzer::MappedFile file;
+	if (!file.open(fileName))
+	{
+		fprintf(stderr, "%s\n", file.lastError().c_str());
+		return 2;
+	}
+	Http::StreamAnalyzer::analyze(file.data(), file.size(), numThreads, summary);
+	auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+	printf("Messages:   %zu\n", summary.mNumMessages);
+	printf("Errors:     %zu\n", summary.mNumErrors);
+	printf("Headers:    %zu\n", summary.mNumHeaders);
+	printf("Body bytes: %zu\n", summary.mBodyBytes);
+	for (const auto & kind: summary.mKinds)
+	{
+		printf("  %-16s %zu\n", kind.first.c_str(), kind.second);
+	}
+	printf("Processed %zu bytes in %.3f s (%.1f MiB/s)\n",
+		file.size(), elapsed, (elapsed > 0) ? (static_cast<double>(file.size()) / elapsed / 1048576) : 0.0
+	);
+	return 0;
+}